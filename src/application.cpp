@@ -17,56 +17,133 @@
 
 #include <cstdlib>
 #include <iostream>
-#include <chrono>
 
 #include "application.hpp"
 
 namespace bpmap
 {
+    // The renderers bind the same number of resources whatever the scene, so
+    // the bindless tables start with those constants plus some headroom for
+    // resources created later. They grow if that isn't enough.
+    static vk::device_desc_t get_device_desc()
+    {
+        static constexpr uint32_t headroom = 16;
+
+        vk::device_desc_t desc;
+        desc.bindless_buffers = renderer_t::bindless_buffers_count + headroom;
+        desc.bindless_images =
+            renderer_t::bindless_images_count +
+            gui_renderer_t::bindless_images_count +
+            headroom;
+        desc.bindless_samplers = gui_renderer_t::bindless_samplers_count + headroom;
+
+        return desc;
+    }
 
     application_t::application_t(
                                   uint32_t res_x,
                                   uint32_t res_y,
-                                  const string_t& app_name
+                                  const string_t& app_name,
+                                  const string_t& scene_path,
+                                  loop_mode_t loop_mode,
+                                  const string_t& export_path,
+                                  bool_t stream
                                 ) :
         gui(window),
         renderer(vulkan, scene, shader_registry, sampler_registry),
         gui_renderer(gui, vulkan, shader_registry, sampler_registry, renderer),
         shader_registry(vulkan),
-        sampler_registry(vulkan)
+        sampler_registry(vulkan),
+        scheduler(window, renderer, loop_mode),
+        scene_path(scene_path)
     {
         verify(window.init({res_x, res_y, app_name}));
+        verify(vulkan.init(window, get_device_desc()));
 
-        // TODO: remove hardcoded scene and add an option to select from UI.
-        verify(load_scene("scene.bpmap", scene));
-        verify(vulkan.init(window));
+        // The export needs the geometry on the host, so it is never streamed.
+        // TODO: add an option to select the scene from UI.
+        if(stream && export_path.empty())
+        {
+            verify(renderer.stream_scene(scene_path, scene));
+        }
+        else
+        {
+            verify(load_scene(scene_path, scene));
+        }
+
+        if(!export_path.empty())
+        {
+            verify(export_binary_scene(export_path, scene));
+            log("Exported ", scene_path, " to ", export_path);
+        }
 
         verify(renderer.init());
 
         verify(gui_renderer.init());
         verify(renderer.build_command_buffers());
         verify(renderer.submit_command_buffers());
+
+        if(watcher.init([this]() { scheduler.post_frame_request(); }))
+        {
+            watch_scene();
+        }
+        else
+        {
+            log("Scene hot reload is not available");
+        }
     }
 
-    void application_t::loop()
+    void application_t::watch_scene()
+    {
+        watcher.watch(scene_path);
+
+        for(auto& source : scene.sources)
+        {
+            watcher.watch(source.path);
+        }
+
+        if(!scene.environment_path.empty())
+        {
+            watcher.watch(scene.environment_path);
+        }
+    }
+
+    void application_t::reload_scene()
     {
-        static constexpr uint32_t frame_limit = 60;
+        auto changed_files = watcher.consume_changes();
+
+        if(changed_files.empty())
+        {
+            return;
+        }
 
-        auto t0 = std::chrono::high_resolution_clock::now();
+        auto status = renderer.reload_scene(scene_path, changed_files, scene);
 
-        uint32_t frames = 0;
-        while(!window.closed())
+        if(status != error_t::success)
         {
-            window.poll_events();
-            auto t1 = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            log_error("Reloading ", scene_path, " failed: ", get_error_message(status));
+            return;
+        }
+
+        // Objects or an environment may have been added.
+        watch_scene();
+        log("Reloaded ", scene_path);
+    }
 
-            if(duration >= 1E9 / frame_limit)
+    void application_t::loop()
+    {
+        while(scheduler.wait_for_frame())
+        {
+            reload_scene();
+
+            auto status = renderer.submit_next_batch();
+
+            if(status != error_t::success)
             {
-                t0 = t1;
-                gui_renderer.render_frame();
+                log_error("Rendering a batch failed: ", get_error_message(status));
             }
-            frames++;
+
+            gui_renderer.render_frame();
         }
     }
 }
@@ -26,6 +26,9 @@
 #include "gui/gui.hpp"
 #include "scene/scene.hpp"
 #include "scene/scene_loader.hpp"
+#include "scene/binary_scene.hpp"
+#include "scheduler.hpp"
+#include "core/file_watcher.hpp"
 
 namespace bpmap
 {
@@ -40,10 +43,28 @@ namespace bpmap
         scene_t scene;
         vk::shader_registry_t shader_registry;
         vk::sampler_registry_t sampler_registry;
+        frame_scheduler_t scheduler;
+        string_t scene_path;
+
+        // Declared last so it stops before the scheduler it wakes goes away.
+        file_watcher_t watcher;
+
+        void watch_scene();
+        void reload_scene();
 
     public:
 
-        application_t(uint32_t res_x, uint32_t res_y, const string_t& name);
+        application_t(
+                       uint32_t res_x,
+                       uint32_t res_y,
+                       const string_t& name,
+                       const string_t& scene_path,
+                       loop_mode_t loop_mode = loop_mode_t::interactive,
+                       const string_t& export_path = "",
+                       bool_t stream = false
+                     );
+
+        void set_loop_mode(loop_mode_t mode) { scheduler.set_mode(mode); }
 
         void loop();
     };
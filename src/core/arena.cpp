@@ -0,0 +1,145 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+
+#include "arena.hpp"
+
+namespace bpmap
+{
+    monotonic_arena_t::monotonic_arena_t(size_t min_block_size) :
+        min_block_size(min_block_size)
+    {
+    }
+
+
+    void monotonic_arena_t::add_block(size_t size)
+    {
+        // Blocks grow with the arena so the number of blocks stays
+        // logarithmic in the size.
+        size = std::max({size, min_block_size, get_capacity()});
+
+        blocks.push_back({std::make_unique_for_overwrite<uint8_t[]>(size), size});
+        current = blocks.size() - 1;
+        offset = 0;
+    }
+
+
+    void* monotonic_arena_t::allocate(size_t size, size_t alignment)
+    {
+        while(current < blocks.size())
+        {
+            auto& block = blocks[current];
+
+            auto base = (uintptr_t) block.data.get();
+            auto begin = (base + offset + alignment - 1) & ~uintptr_t(alignment - 1);
+
+            if(begin + size <= base + block.size)
+            {
+                offset = begin + size - base;
+                return (void*) begin;
+            }
+
+            if(current + 1 == blocks.size())
+            {
+                break;
+            }
+
+            current++;
+            offset = 0;
+        }
+
+        add_block(size + alignment - 1);
+
+        return allocate(size, alignment);
+    }
+
+
+    void monotonic_arena_t::reset()
+    {
+        if(blocks.size() > 1)
+        {
+            auto capacity = get_capacity();
+
+            blocks.clear();
+            blocks.push_back({std::make_unique_for_overwrite<uint8_t[]>(capacity), capacity});
+        }
+
+        current = 0;
+        offset = 0;
+    }
+
+
+    void monotonic_arena_t::release()
+    {
+        darray_t<block_t>().swap(blocks);
+
+        current = 0;
+        offset = 0;
+    }
+
+
+    void monotonic_arena_t::reserve(size_t size)
+    {
+        reset();
+
+        if(get_capacity() < size)
+        {
+            release();
+            add_block(size);
+        }
+
+        current = 0;
+        offset = 0;
+    }
+
+
+    size_t monotonic_arena_t::get_capacity() const
+    {
+        size_t capacity = 0;
+
+        for(auto& block : blocks)
+        {
+            capacity += block.size;
+        }
+
+        return capacity;
+    }
+
+
+    void frame_arena_t::init(size_t frames_count, size_t min_block_size)
+    {
+        arenas.clear();
+
+        for(size_t i = 0; i < frames_count; ++i)
+        {
+            arenas.emplace_back(min_block_size);
+        }
+
+        current = 0;
+    }
+
+
+    monotonic_arena_t& frame_arena_t::begin_frame(size_t frame_index)
+    {
+        current = frame_index;
+        arenas[current].reset();
+
+        return arenas[current];
+    }
+}
@@ -0,0 +1,119 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+
+#include "common.hpp"
+
+namespace bpmap
+{
+    // Bump allocator for memory which dies all at once. Nothing is freed
+    // before reset or release, reset keeps the memory for the next use and
+    // merges the blocks into one, so a reused arena settles on a single
+    // block which fits everything and stops calling malloc.
+    class monotonic_arena_t
+    {
+        struct block_t
+        {
+            std::unique_ptr<uint8_t[]> data;
+            size_t size;
+        };
+
+        darray_t<block_t> blocks;
+        size_t current = 0;
+        size_t offset = 0;
+        size_t min_block_size;
+
+        void add_block(size_t size);
+
+    public:
+        static constexpr size_t default_block_size = 64 * 1024;
+
+        monotonic_arena_t(size_t min_block_size = default_block_size);
+
+        monotonic_arena_t(monotonic_arena_t&&) = default;
+        monotonic_arena_t& operator=(monotonic_arena_t&&) = default;
+
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        template <typename T>
+        T* allocate_array(size_t count)
+        {
+            return (T*) allocate(count * sizeof(T), alignof(T));
+        }
+
+        // Invalidate everything allocated so far.
+        void reset();
+        void release();
+
+        // Same as reset, then makes sure size bytes fit in a single block.
+        void reserve(size_t size);
+
+        size_t get_capacity() const;
+    };
+
+    // One arena per frame in flight. The memory of a frame stays valid until
+    // the same frame slot begins again, so it may be referenced until the
+    // frame's fence is signaled.
+    class frame_arena_t
+    {
+        darray_t<monotonic_arena_t> arenas;
+        size_t current = 0;
+
+    public:
+        void init(size_t frames_count, size_t min_block_size = monotonic_arena_t::default_block_size);
+
+        // Resets and returns the arena of the frame slot.
+        monotonic_arena_t& begin_frame(size_t frame_index);
+
+        monotonic_arena_t& get() { return arenas[current]; }
+    };
+
+    // Lets the standard containers allocate from an arena. Deallocation does
+    // nothing, the memory is reclaimed when the arena is reset.
+    template <typename T>
+    struct arena_allocator_t
+    {
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        monotonic_arena_t* arena;
+
+        arena_allocator_t(monotonic_arena_t& arena) : arena(&arena) {}
+
+        template <typename U>
+        arena_allocator_t(const arena_allocator_t<U>& other) : arena(other.arena) {}
+
+        T* allocate(size_t count) { return arena->allocate_array<T>(count); }
+        void deallocate(T*, size_t) {}
+
+        template <typename U>
+        bool_t operator==(const arena_allocator_t<U>& other) const { return arena == other.arena; }
+    };
+
+    template <typename T>
+    using arena_array_t = std::vector<T, arena_allocator_t<T>>;
+}
+
+#endif // ARENA_HPP
@@ -0,0 +1,124 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "batch_transform.hpp"
+#include "thread_pool.hpp"
+
+namespace bpmap
+{
+    // Ranges up to this size aren't worth waking the pool for.
+    static constexpr size_t parallel_range_size = 64 * 1024;
+
+    using matrix3x4_t = array_t<float_t, 12>;
+
+
+    // Written so the compiler vectorizes it across the interleaved
+    // components. Deinterleaving into SoA batches first was measured to be
+    // slower, the loop is bound by memory bandwidth either way.
+    template <bool_t is_normal>
+    static void transform_range(const matrix3x4_t& m, float_t* __restrict xyz, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            auto p = xyz + i * 3;
+
+            auto x = p[0];
+            auto y = p[1];
+            auto z = p[2];
+
+            auto tx = m[0] * x + m[1] * y + m[2] * z + m[3];
+            auto ty = m[4] * x + m[5] * y + m[6] * z + m[7];
+            auto tz = m[8] * x + m[9] * y + m[10] * z + m[11];
+
+            if constexpr(is_normal)
+            {
+                auto length_squared = tx * tx + ty * ty + tz * tz;
+                auto scale = (length_squared > 0.0f) ? 1.0f / std::sqrt(length_squared) : 0.0f;
+
+                tx *= scale;
+                ty *= scale;
+                tz *= scale;
+            }
+
+            p[0] = tx;
+            p[1] = ty;
+            p[2] = tz;
+        }
+    }
+
+
+    template <bool_t is_normal>
+    static void transform(const matrix3x4_t& m, float_t* xyz, size_t count)
+    {
+        if(count <= parallel_range_size)
+        {
+            transform_range<is_normal>(m, xyz, count);
+            return;
+        }
+
+        auto ranges_count = (count + parallel_range_size - 1) / parallel_range_size;
+
+        thread_pool_t::get_global().parallel_for(ranges_count, [&m, xyz, count](size_t i)
+        {
+            auto first = i * parallel_range_size;
+            auto size = std::min(parallel_range_size, count - first);
+
+            transform_range<is_normal>(m, xyz + first * 3, size);
+        });
+    }
+
+
+    void transform_points(const transform3d_embedded_t& t, point3d_t* points, size_t count)
+    {
+        matrix3x4_t m;
+        std::copy(t.components, t.components + m.size(), m.begin());
+
+        transform<false>(m, points->components, count);
+    }
+
+
+    void transform_normals(const transform3d_embedded_t& t, codirection3d_t* normals, size_t count)
+    {
+        auto& a = t.components;
+
+        // The cofactor matrix is the inverse transpose scaled by the
+        // determinant, its sign is all that matters after renormalizing and
+        // it works for singular transforms too.
+        float_t c[9] =
+        {
+            a[5] * a[10] - a[6] * a[9], a[6] * a[8] - a[4] * a[10], a[4] * a[9] - a[5] * a[8],
+            a[2] * a[9] - a[1] * a[10], a[0] * a[10] - a[2] * a[8], a[1] * a[8] - a[0] * a[9],
+            a[1] * a[6] - a[2] * a[5], a[2] * a[4] - a[0] * a[6], a[0] * a[5] - a[1] * a[4]
+        };
+
+        auto determinant = a[0] * c[0] + a[1] * c[1] + a[2] * c[2];
+        auto sign = (determinant < 0.0f) ? -1.0f : 1.0f;
+
+        matrix3x4_t m =
+        {
+            sign * c[0], sign * c[1], sign * c[2], 0.0f,
+            sign * c[3], sign * c[4], sign * c[5], 0.0f,
+            sign * c[6], sign * c[7], sign * c[8], 0.0f
+        };
+
+        transform<true>(m, normals->components, count);
+    }
+}
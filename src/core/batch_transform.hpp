@@ -0,0 +1,36 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef BATCH_TRANSFORM_HPP
+#define BATCH_TRANSFORM_HPP
+
+#include "algebra.hpp"
+
+namespace bpmap
+{
+    // Both work in place on the global thread pool for large ranges. Only
+    // the upper 3x4 part of the transform is used.
+
+    void transform_points(const transform3d_embedded_t& t, point3d_t* points, size_t count);
+
+    // Uses the inverse transpose of the linear part and renormalizes, so
+    // non uniform scales and mirroring keep the normals correct.
+    void transform_normals(const transform3d_embedded_t& t, codirection3d_t* normals, size_t count);
+}
+
+#endif // BATCH_TRANSFORM_HPP
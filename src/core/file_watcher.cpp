@@ -0,0 +1,206 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <filesystem>
+
+#if defined(__linux__)
+    #define BPMAP_HAS_INOTIFY
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+#include "file_watcher.hpp"
+
+namespace bpmap
+{
+    // The directory and the name of a file, with the directory absolute so
+    // different spellings of a path end up the same.
+    static pair_t<string_t, string_t> split_path(const string_t& path)
+    {
+        auto absolute = std::filesystem::absolute(path).lexically_normal();
+
+        return {absolute.parent_path().string(), absolute.filename().string()};
+    }
+
+
+    bool_t file_watcher_t::init(std::function<void()> f)
+    {
+#if defined(BPMAP_HAS_INOTIFY)
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if(fd < 0)
+        {
+            return false;
+        }
+
+        if(pipe2(stop_pipe, O_CLOEXEC) != 0)
+        {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        on_change = std::move(f);
+        thread = std::thread([this]() { run(); });
+
+        return true;
+#else
+        return false;
+#endif
+    }
+
+
+    bool_t file_watcher_t::watch(const string_t& path)
+    {
+#if defined(BPMAP_HAS_INOTIFY)
+        if(fd < 0)
+        {
+            return false;
+        }
+
+        auto [directory, name] = split_path(path);
+
+        std::lock_guard lock(mutex);
+
+        // The same directory always gives the same descriptor.
+        auto descriptor = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+        if(descriptor < 0)
+        {
+            return false;
+        }
+
+        directories[descriptor] = directory;
+        files[directory + "/" + name] = path;
+
+        return true;
+#else
+        return false;
+#endif
+    }
+
+
+    hash_set_t<string_t> file_watcher_t::consume_changes()
+    {
+        std::lock_guard lock(mutex);
+
+        hash_set_t<string_t> result;
+        result.swap(changes);
+
+        return result;
+    }
+
+
+    void file_watcher_t::run()
+    {
+#if defined(BPMAP_HAS_INOTIFY)
+        alignas(inotify_event) char_t buffer[4096];
+
+        pollfd descriptors[2] = {{fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+
+        while(true)
+        {
+            if(poll(descriptors, 2, -1) < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+
+                return;
+            }
+
+            if(descriptors[1].revents != 0)
+            {
+                return;
+            }
+
+            auto length = read(fd, buffer, sizeof(buffer));
+
+            if(length <= 0)
+            {
+                continue;
+            }
+
+            auto changed = false;
+
+            {
+                std::lock_guard lock(mutex);
+
+                for(auto p = buffer; p < buffer + length; )
+                {
+                    auto event = (const inotify_event*) p;
+                    p += sizeof(inotify_event) + event->len;
+
+                    auto directory = directories.find(event->wd);
+
+                    if(event->len == 0 || directory == directories.end())
+                    {
+                        continue;
+                    }
+
+                    auto file = files.find(directory->second + "/" + event->name);
+
+                    if(file != files.end())
+                    {
+                        changes.insert(file->second);
+                        changed = true;
+                    }
+                }
+            }
+
+            if(changed && on_change)
+            {
+                on_change();
+            }
+        }
+#endif
+    }
+
+
+    void file_watcher_t::stop()
+    {
+#if defined(BPMAP_HAS_INOTIFY)
+        if(fd < 0)
+        {
+            return;
+        }
+
+        // A pipe this empty can't be full, the write always wakes the thread.
+        char_t stop = 0;
+        [[maybe_unused]] auto written = write(stop_pipe[1], &stop, 1);
+
+        thread.join();
+
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+        close(fd);
+
+        fd = -1;
+#endif
+    }
+
+
+    file_watcher_t::~file_watcher_t()
+    {
+        stop();
+    }
+}
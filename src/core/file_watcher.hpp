@@ -0,0 +1,72 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef FILE_WATCHER_HPP
+#define FILE_WATCHER_HPP
+
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "common.hpp"
+
+namespace bpmap
+{
+    // Reports watched files which were written or replaced. The directories
+    // are watched instead of the files, so saves which write a new file and
+    // rename it over the old one are seen too. Only available where inotify
+    // is.
+    class file_watcher_t
+    {
+        int_t fd = -1;
+        int_t stop_pipe[2] = {-1, -1};
+        std::thread thread;
+
+        std::mutex mutex;
+        // Watch descriptor to directory, and file in a watched directory to
+        // the path it was watched with.
+        hash_table_t<int_t, string_t> directories;
+        hash_table_t<string_t, string_t> files;
+        hash_set_t<string_t> changes;
+
+        std::function<void()> on_change;
+
+        void run();
+        void stop();
+
+    public:
+        file_watcher_t() = default;
+        file_watcher_t(const file_watcher_t&) = delete;
+        file_watcher_t& operator=(const file_watcher_t&) = delete;
+
+        // on_change is called from the watcher thread after new changes
+        // arrived. Returns false when files can't be watched.
+        bool_t init(std::function<void()> on_change = {});
+
+        // Can be called again for the same file.
+        bool_t watch(const string_t& path);
+
+        // The watched paths changed since the last call, as they were given
+        // to watch.
+        hash_set_t<string_t> consume_changes();
+
+        ~file_watcher_t();
+    };
+}
+
+#endif // FILE_WATCHER_HPP
@@ -0,0 +1,125 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "hash.hpp"
+
+namespace bpmap
+{
+    // Structured like XXH64: four independent lanes over 32 byte stripes,
+    // then the tail and a final avalanche.
+    static constexpr uint64_t prime0 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t prime1 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t prime2 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t prime3 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t prime4 = 0x27D4EB2F165667C5ull;
+
+    static uint64_t rotate_left(uint64_t x, int_t bits)
+    {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    static uint64_t read_word(const uint8_t* p)
+    {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+
+        return word;
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t word)
+    {
+        lane += word * prime1;
+        lane = rotate_left(lane, 31);
+
+        return lane * prime0;
+    }
+
+    static uint64_t merge(uint64_t hash, uint64_t lane)
+    {
+        hash ^= round(0, lane);
+
+        return hash * prime0 + prime3;
+    }
+
+    static uint64_t avalanche(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= prime1;
+        hash ^= hash >> 29;
+        hash *= prime2;
+
+        return hash ^ (hash >> 32);
+    }
+
+
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+    {
+        auto p = (const uint8_t*) data;
+        auto end = p + size;
+        uint64_t hash;
+
+        if(size >= 32)
+        {
+            uint64_t lanes[4] = {seed + prime0 + prime1, seed + prime1, seed, seed - prime0};
+
+            for(; end - p >= 32; p += 32)
+            {
+                for(auto i = 0; i < 4; ++i)
+                {
+                    lanes[i] = round(lanes[i], read_word(p + 8 * i));
+                }
+            }
+
+            hash = rotate_left(lanes[0], 1) +
+                   rotate_left(lanes[1], 7) +
+                   rotate_left(lanes[2], 12) +
+                   rotate_left(lanes[3], 18);
+
+            for(auto lane : lanes)
+            {
+                hash = merge(hash, lane);
+            }
+        }
+        else
+        {
+            hash = seed + prime4;
+        }
+
+        hash += size;
+
+        for(; end - p >= 8; p += 8)
+        {
+            hash ^= round(0, read_word(p));
+            hash = rotate_left(hash, 27) * prime0 + prime3;
+        }
+
+        for(; p != end; ++p)
+        {
+            hash ^= *p * prime4;
+            hash = rotate_left(hash, 11) * prime0;
+        }
+
+        return avalanche(hash);
+    }
+
+
+    uint64_t hash_combine(uint64_t hash, uint64_t value)
+    {
+        return avalanche(merge(hash, value));
+    }
+}
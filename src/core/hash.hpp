@@ -0,0 +1,35 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include "common.hpp"
+
+namespace bpmap
+{
+    // 64 bit non cryptographic hash of a block of memory, fast enough to run
+    // over whole asset files. The result doesn't depend on the alignment of
+    // data but it does on the byte order of the host.
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+    // Mixes value into hash, the order of the calls matters.
+    uint64_t hash_combine(uint64_t hash, uint64_t value);
+}
+
+#endif // HASH_HPP
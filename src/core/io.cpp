@@ -18,19 +18,37 @@
 
 #include <cstdio>
 
+#if defined(__unix__) || defined(__APPLE__)
+    #define BPMAP_HAS_MMAP
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 #include "io.hpp"
 
 namespace bpmap
 {
     using file_t = FILE*;
 
-    size_t get_size(file_t f)
+    static bool_t get_size(file_t f, size_t& size)
     {
-        fseek(f, 0, SEEK_END);
-        auto size = ftell(f);
-        fseek(f, 0, SEEK_SET);
+        if(fseek(f, 0, SEEK_END) != 0)
+        {
+            return false;
+        }
+
+        auto end = ftell(f);
+
+        if(end < 0 || fseek(f, 0, SEEK_SET) != 0)
+        {
+            return false;
+        }
+
+        size = end;
 
-        return size;
+        return true;
     }
 
     bool read_whole_file(const string_t& path, darray_t<uint8_t>& data)
@@ -42,15 +60,123 @@ namespace bpmap
             return false;
         }
 
-        auto size = get_size(handle);
+        size_t size;
+        auto success = get_size(handle, size);
+
+        if(success)
+        {
+            data.resize(size);
+            success = size == 0 || fread(data.data(), size, 1, handle) == 1;
+        }
+
+        fclose(handle);
+
+        return success;
+    }
+
+
+#if defined(BPMAP_HAS_MMAP)
+    static void advise(void* address, size_t size, const mapped_file_desc_t& desc)
+    {
+        // Only hints, the mapping works the same when they are refused.
+        if(desc.sequential)
+        {
+            madvise(address, size, MADV_SEQUENTIAL);
+        }
+
+        if(desc.will_need)
+        {
+            madvise(address, size, MADV_WILLNEED);
+        }
+
+#if defined(MADV_HUGEPAGE)
+        if(size >= desc.huge_pages_size)
+        {
+            madvise(address, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+#endif
+
+
+    bool_t mapped_file_t::open(const string_t& path, const mapped_file_desc_t& desc)
+    {
+        close();
 
-        data.resize(size);
+#if defined(BPMAP_HAS_MMAP)
+        auto fd = ::open(path.c_str(), O_RDONLY);
 
-        if(fread(data.data(), size, 1, handle) < 1)
+        if(fd < 0)
         {
             return false;
         }
 
+        struct stat info;
+
+        if(fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size = info.st_size;
+
+        // Empty files can't be mapped, they are just empty views.
+        if(size != 0)
+        {
+            auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if(address == MAP_FAILED)
+            {
+                ::close(fd);
+                size = 0;
+                return false;
+            }
+
+            advise(address, size, desc);
+
+            data = (const uint8_t*) address;
+            mapped = true;
+        }
+
+        // The mapping stays valid without the descriptor.
+        ::close(fd);
+
         return true;
+#else
+        (void) desc;
+
+        if(!read_whole_file(path, contents))
+        {
+            return false;
+        }
+
+        data = contents.data();
+        size = contents.size();
+
+        return true;
+#endif
+    }
+
+
+    void mapped_file_t::close()
+    {
+#if defined(BPMAP_HAS_MMAP)
+        if(mapped)
+        {
+            munmap((void*) data, size);
+        }
+#endif
+
+        contents.clear();
+        data = nullptr;
+        size = 0;
+        mapped = false;
+    }
+
+
+    mapped_file_t::~mapped_file_t()
+    {
+        close();
     }
 }
@@ -27,6 +27,43 @@ namespace bpmap
 {
     bool read_whole_file(const string_t& path, darray_t<uint8_t>& data);
 
+    struct mapped_file_desc_t
+    {
+        // The file is mostly read front to back, the kernel reads further
+        // ahead and drops the pages behind sooner.
+        bool_t sequential = true;
+        // Start reading the whole file in right away.
+        bool_t will_need = true;
+        // Ask for huge pages for files of at least this size, fewer TLB misses
+        // on large assets where the file system supports them.
+        size_t huge_pages_size = 2 * 1024 * 1024;
+    };
+
+    // Read only view of a whole file. It is memory mapped where the platform
+    // supports it and read into memory otherwise.
+    class mapped_file_t
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        bool_t mapped = false;
+        darray_t<uint8_t> contents;
+
+    public:
+        mapped_file_t() = default;
+        mapped_file_t(const mapped_file_t&) = delete;
+        mapped_file_t& operator=(const mapped_file_t&) = delete;
+
+        bool_t open(const string_t& path, const mapped_file_desc_t& desc = mapped_file_desc_t());
+        void close();
+
+        const uint8_t* get_data() const { return data; }
+        size_t get_size() const { return size; }
+
+        string_view_t get_text() const { return string_view_t((const char_t*) data, size); }
+
+        ~mapped_file_t();
+    };
+
     template <typename... Ts>
     void log(Ts... types)
     {
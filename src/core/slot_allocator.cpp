@@ -0,0 +1,279 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <bit>
+#include <mutex>
+#include <algorithm>
+
+#include "slot_allocator.hpp"
+
+namespace bpmap
+{
+    // Guards the pairing between thread caches and allocators, never taken on
+    // the allocate/free path once a thread has its cache.
+    static std::mutex registry_mutex;
+
+    thread_local slot_allocator_t::thread_caches_t slot_allocator_t::thread_caches;
+
+
+    slot_allocator_t::thread_caches_t::~thread_caches_t()
+    {
+        std::lock_guard lock(registry_mutex);
+
+        // Slots cached by an exiting thread go back to their allocator.
+        for(auto& cache : caches)
+        {
+            auto owner = cache->owner.load();
+
+            if(owner == nullptr)
+            {
+                continue;
+            }
+
+            owner->release(*cache, cache->count);
+
+            auto& owner_caches = owner->caches;
+            owner_caches.erase(std::find(owner_caches.begin(), owner_caches.end(), cache.get()));
+        }
+    }
+
+
+    void slot_allocator_t::init(uint32_t c, uint32_t max_c)
+    {
+        {
+            std::lock_guard lock(registry_mutex);
+
+            for(auto cache : caches)
+            {
+                cache->owner = nullptr;
+            }
+
+            caches.clear();
+        }
+
+        max_capacity = std::max(c, max_c);
+        words_count = (max_capacity + bits_per_word - 1) / bits_per_word;
+        words = std::make_unique<std::atomic<uint64_t>[]>(words_count);
+
+        // The bits past the capacity are marked as taken so they are never
+        // handed out before the allocator grows.
+        for(auto i = 0u; i < words_count; ++i)
+        {
+            words[i].store(~uint64_t(0), std::memory_order_relaxed);
+        }
+
+        clear_range(0, c);
+        capacity.store(c, std::memory_order_release);
+
+        search_hint.store(0, std::memory_order_relaxed);
+        allocated.store(0, std::memory_order_relaxed);
+    }
+
+
+    void slot_allocator_t::clear_range(uint32_t begin, uint32_t end)
+    {
+        for(auto slot = begin; slot < end;)
+        {
+            auto bit = slot % bits_per_word;
+            auto bits = std::min(bits_per_word - bit, end - slot);
+            auto mask = (bits == bits_per_word? ~uint64_t(0) : (uint64_t(1) << bits) - 1) << bit;
+
+            words[slot / bits_per_word].fetch_and(~mask, std::memory_order_release);
+
+            slot += bits;
+        }
+    }
+
+
+    bool_t slot_allocator_t::grow(uint32_t seen_capacity)
+    {
+        std::lock_guard lock(grow_mutex);
+
+        auto current = capacity.load(std::memory_order_acquire);
+
+        // Somebody else grew it meanwhile.
+        if(current != seen_capacity)
+        {
+            return true;
+        }
+
+        if(current == max_capacity)
+        {
+            return false;
+        }
+
+        auto new_capacity = std::min(max_capacity, std::max(2 * current, current + bits_per_word));
+
+        // The new slots are freed before the capacity is published, a slot
+        // may thus briefly be handed out above get_capacity().
+        clear_range(current, new_capacity);
+        capacity.store(new_capacity, std::memory_order_release);
+
+        return true;
+    }
+
+
+    slot_allocator_t::cache_t& slot_allocator_t::get_cache()
+    {
+        for(auto& cache : thread_caches.caches)
+        {
+            if(cache->owner == this)
+            {
+                return *cache;
+            }
+        }
+
+        auto cache = std::make_unique<cache_t>();
+        cache->owner = this;
+        cache->count = 0;
+
+        {
+            std::lock_guard lock(registry_mutex);
+            caches.push_back(cache.get());
+        }
+
+        // Drop the caches of destroyed allocators while at it.
+        auto& thread_list = thread_caches.caches;
+        std::erase_if(thread_list, [](const auto& c) { return c->owner == nullptr; });
+
+        return *thread_list.emplace_back(std::move(cache));
+    }
+
+
+    bool_t slot_allocator_t::refill(cache_t& cache)
+    {
+        auto active_words = (get_capacity() + bits_per_word - 1) / bits_per_word;
+
+        if(active_words == 0)
+        {
+            return false;
+        }
+
+        auto start = search_hint.load(std::memory_order_relaxed);
+
+        for(auto i = 0u; i < active_words; ++i)
+        {
+            auto index = (start + i) % active_words;
+            auto& word = words[index];
+            auto value = word.load(std::memory_order_relaxed);
+
+            while(value != ~uint64_t(0))
+            {
+                // Take up to a batch of the lowest free bits at once.
+                auto free_bits = ~value;
+                uint64_t claimed = 0;
+
+                for(auto n = 0u; n < batch_size && free_bits != 0; ++n)
+                {
+                    claimed |= free_bits & (~free_bits + 1);
+                    free_bits &= free_bits - 1;
+                }
+
+                if(
+                    word.compare_exchange_weak(
+                                                value,
+                                                value | claimed,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed
+                                              )
+                  )
+                {
+                    while(claimed != 0)
+                    {
+                        cache.slots[cache.count++] = index * bits_per_word + std::countr_zero(claimed);
+                        claimed &= claimed - 1;
+                    }
+
+                    // Next searches start at a word which likely still has
+                    // free slots.
+                    search_hint.store(free_bits == 0? (index + 1) % active_words : index, std::memory_order_relaxed);
+
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+
+    void slot_allocator_t::release(uint32_t slot)
+    {
+        auto bit = uint64_t(1) << (slot % bits_per_word);
+        words[slot / bits_per_word].fetch_and(~bit, std::memory_order_release);
+    }
+
+
+    void slot_allocator_t::release(cache_t& cache, uint32_t count)
+    {
+        for(auto i = 0u; i < count; ++i)
+        {
+            release(cache.slots[i]);
+        }
+
+        std::copy(cache.slots.begin() + count, cache.slots.begin() + cache.count, cache.slots.begin());
+        cache.count -= count;
+    }
+
+
+    uint32_t slot_allocator_t::allocate()
+    {
+        auto& cache = get_cache();
+
+        if(cache.count == 0 && !refill(cache))
+        {
+            return invalid_slot;
+        }
+
+        allocated.fetch_add(1, std::memory_order_relaxed);
+
+        return cache.slots[--cache.count];
+    }
+
+
+    void slot_allocator_t::free(uint32_t slot)
+    {
+        if(slot >= max_capacity)
+        {
+            return;
+        }
+
+        auto& cache = get_cache();
+
+        // A full cache hands its oldest half back to the bitmap.
+        if(cache.count == cache_size)
+        {
+            release(cache, batch_size);
+        }
+
+        cache.slots[cache.count++] = slot;
+
+        allocated.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+
+    slot_allocator_t::~slot_allocator_t()
+    {
+        std::lock_guard lock(registry_mutex);
+
+        for(auto cache : caches)
+        {
+            cache->owner = nullptr;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SLOT_ALLOCATOR_HPP
+#define SLOT_ALLOCATOR_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "common.hpp"
+
+namespace bpmap
+{
+    // Hands out indices in [0, capacity) from any thread. The free slots are
+    // kept in a bitmap of atomic words, a set bit marks a taken slot. Each
+    // thread claims small batches of slots with a single CAS and serves most
+    // allocate/free calls from its own cache, so threads only meet on the
+    // bitmap once per batch.
+    //
+    // The capacity can grow up to the maximum given to init, the bitmap for
+    // the maximum is allocated upfront so growing never moves it.
+    class slot_allocator_t
+    {
+        static constexpr uint32_t bits_per_word = 64;
+        static constexpr uint32_t batch_size = 16;
+        static constexpr uint32_t cache_size = 2 * batch_size;
+
+        struct cache_t
+        {
+            // Cleared when the allocator goes away before the thread.
+            std::atomic<slot_allocator_t*> owner;
+            uint32_t count;
+            array_t<uint32_t, cache_size> slots;
+        };
+
+        struct thread_caches_t
+        {
+            darray_t<std::unique_ptr<cache_t>> caches;
+            ~thread_caches_t();
+        };
+
+        static thread_local thread_caches_t thread_caches;
+
+        std::unique_ptr<std::atomic<uint64_t>[]> words;
+        uint32_t words_count = 0;
+        uint32_t max_capacity = 0;
+        std::atomic<uint32_t> capacity = 0;
+        std::mutex grow_mutex;
+
+        // Word to start the next search from, spreads threads over the bitmap.
+        std::atomic<uint32_t> search_hint = 0;
+        std::atomic<uint32_t> allocated = 0;
+
+        // All thread caches which hold slots of this allocator. Only touched
+        // under the registry mutex when a thread first allocates, when it
+        // exits and when the allocator is destroyed.
+        darray_t<cache_t*> caches;
+
+        void clear_range(uint32_t begin, uint32_t end);
+        cache_t& get_cache();
+        bool_t refill(cache_t& cache);
+        void release(uint32_t slot);
+        void release(cache_t& cache, uint32_t count);
+
+    public:
+        static constexpr uint32_t invalid_slot = ~uint32_t(0);
+
+        slot_allocator_t() = default;
+        slot_allocator_t(const slot_allocator_t&) = delete;
+        slot_allocator_t& operator=(const slot_allocator_t&) = delete;
+
+        void init(uint32_t capacity, uint32_t max_capacity = 0);
+
+        // Returns invalid_slot when all slots are taken.
+        uint32_t allocate();
+        void free(uint32_t slot);
+
+        // Doubles the capacity if it is still the one seen by the caller when
+        // allocate failed. Returns false once the maximum is reached.
+        bool_t grow(uint32_t seen_capacity);
+
+        uint32_t get_capacity() const { return capacity.load(std::memory_order_acquire); }
+        uint32_t get_max_capacity() const { return max_capacity; }
+        uint32_t get_allocated() const { return allocated.load(std::memory_order_relaxed); }
+
+        ~slot_allocator_t();
+    };
+}
+
+#endif // SLOT_ALLOCATOR_HPP
@@ -0,0 +1,171 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <bitmap_tree.hpp>
+
+#include "io.hpp"
+#include "slot_allocator.hpp"
+#include "slot_allocator_benchmark.hpp"
+
+namespace bpmap
+{
+    static constexpr size_t slots_per_round = 32;
+    static constexpr uint32_t exhaustion_capacity = 1000;
+
+    template <typename F>
+    static double_t run_threads(size_t threads, const F& f)
+    {
+        using clock_t = std::chrono::steady_clock;
+
+        darray_t<std::thread> workers;
+        auto start = clock_t::now();
+
+        for(size_t i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([&f, i]() { f(i); });
+        }
+
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        return std::chrono::duration<double_t>(clock_t::now() - start).count();
+    }
+
+    // The allocator the bindless slots came from before slot_allocator_t.
+    static double_t benchmark_locked_tree(size_t threads, size_t rounds)
+    {
+        bmt::tree_t<uint64_t> tree;
+        std::mutex mutex;
+
+        return run_threads(threads, [&](size_t)
+        {
+            array_t<uint64_t, slots_per_round> slots;
+
+            for(size_t i = 0; i < rounds; ++i)
+            {
+                for(auto& slot : slots)
+                {
+                    std::lock_guard lock(mutex);
+                    slot = tree.allocate();
+                }
+
+                for(auto slot : slots)
+                {
+                    std::lock_guard lock(mutex);
+                    tree.deallocate(slot);
+                }
+            }
+        });
+    }
+
+    static double_t benchmark_lock_free(size_t threads, size_t rounds, slot_allocator_t& allocator)
+    {
+        return run_threads(threads, [&](size_t)
+        {
+            array_t<uint32_t, slots_per_round> slots;
+
+            for(size_t i = 0; i < rounds; ++i)
+            {
+                for(auto& slot : slots)
+                {
+                    slot = allocator.allocate();
+                }
+
+                for(auto slot : slots)
+                {
+                    allocator.free(slot);
+                }
+            }
+        });
+    }
+
+    // Every thread allocates until the allocator runs out, together they
+    // must end up with each slot exactly once.
+    static bool_t check_exhaustion(size_t threads)
+    {
+        slot_allocator_t allocator;
+        allocator.init(exhaustion_capacity);
+
+        darray_t<darray_t<uint32_t>> taken(threads);
+
+        run_threads(threads, [&](size_t thread)
+        {
+            for(auto slot = allocator.allocate(); slot != slot_allocator_t::invalid_slot; slot = allocator.allocate())
+            {
+                taken[thread].push_back(slot);
+            }
+        });
+
+        darray_t<uint32_t> slots;
+
+        for(auto& thread_slots : taken)
+        {
+            slots.insert(slots.end(), thread_slots.begin(), thread_slots.end());
+        }
+
+        std::sort(slots.begin(), slots.end());
+
+        auto unique = std::adjacent_find(slots.begin(), slots.end()) == slots.end();
+        auto in_range = slots.empty() || slots.back() < exhaustion_capacity;
+
+        if(slots.size() != exhaustion_capacity || !unique || !in_range)
+        {
+            log_error(
+                       "Exhausting a ", exhaustion_capacity, " slot allocator from ", threads, " threads gave ",
+                       slots.size(), " slots", unique ? "" : ", some twice", in_range ? "" : ", some out of range"
+                     );
+            return false;
+        }
+
+        log("Exhausting a ", exhaustion_capacity, " slot allocator from ", threads, " threads gave every slot once");
+
+        return true;
+    }
+
+    bool_t benchmark_slot_allocator(size_t threads, size_t rounds)
+    {
+        threads = std::max<size_t>(threads, 1);
+
+        slot_allocator_t allocator;
+        allocator.init(threads * slots_per_round * 4);
+
+        auto operations = double_t(2 * slots_per_round * rounds * threads);
+        auto locked_tree = benchmark_locked_tree(threads, rounds);
+        auto lock_free = benchmark_lock_free(threads, rounds, allocator);
+
+        log(
+             "Slot allocation with ", threads, " threads, ", rounds, " rounds: mutex and bitmap tree ",
+             locked_tree / operations * 1e9, " ns/op, slot_allocator_t ", lock_free / operations * 1e9, " ns/op"
+           );
+
+        if(allocator.get_allocated() != 0)
+        {
+            log_error("slot_allocator_t leaked ", allocator.get_allocated(), " slots");
+            return false;
+        }
+
+        return check_exhaustion(threads);
+    }
+}
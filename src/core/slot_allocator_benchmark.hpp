@@ -0,0 +1,34 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SLOT_ALLOCATOR_BENCHMARK_HPP
+#define SLOT_ALLOCATOR_BENCHMARK_HPP
+
+#include "common.hpp"
+
+namespace bpmap
+{
+    // Each thread runs the given number of rounds of 32 allocations followed
+    // by 32 frees, once on slot_allocator_t and once on a bitmap tree behind
+    // a mutex, and logs the cost per operation. Then the threads exhaust a
+    // 1000 slot allocator and the slots they got are checked to be unique.
+    // Returns false if that check fails.
+    bool_t benchmark_slot_allocator(size_t threads, size_t rounds);
+}
+
+#endif // SLOT_ALLOCATOR_BENCHMARK_HPP
@@ -0,0 +1,93 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "thread_pool.hpp"
+
+namespace bpmap
+{
+    thread_pool_t::thread_pool_t(uint32_t threads_count)
+    {
+        if(threads_count == 0)
+        {
+            threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        for(auto i = 1u; i < threads_count; ++i)
+        {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+
+    void thread_pool_t::work()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock lock(mutex);
+                task_available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if(tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+
+    void thread_pool_t::submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+
+        task_available.notify_one();
+    }
+
+
+    thread_pool_t& thread_pool_t::get_global()
+    {
+        static thread_pool_t pool;
+        return pool;
+    }
+
+
+    thread_pool_t::~thread_pool_t()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+
+        task_available.notify_all();
+
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+}
@@ -0,0 +1,133 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "common.hpp"
+
+namespace bpmap
+{
+    class thread_pool_t
+    {
+        darray_t<std::thread> workers;
+        deque_t<std::function<void()>> tasks;
+
+        std::mutex mutex;
+        std::condition_variable task_available;
+        bool_t stopping = false;
+
+        void work();
+
+    public:
+        // Zero means one thread per hardware thread.
+        thread_pool_t(uint32_t threads_count = 0);
+        thread_pool_t(const thread_pool_t&) = delete;
+        thread_pool_t& operator=(const thread_pool_t&) = delete;
+
+        // The calling thread counts too.
+        uint32_t get_size() const { return workers.size() + 1; }
+
+        void submit(std::function<void()> task);
+
+        // Calls f(i) for every i in [0, count) and returns when all calls
+        // are done. The caller takes part in the work, so nested calls from
+        // inside a task can't deadlock even when all workers are busy.
+        template <typename F>
+        void parallel_for(size_t count, F&& f);
+
+        // Shared pool used by the loaders.
+        static thread_pool_t& get_global();
+
+        ~thread_pool_t();
+    };
+
+
+    template <typename F>
+    void thread_pool_t::parallel_for(size_t count, F&& f)
+    {
+        if(count == 0)
+        {
+            return;
+        }
+
+        if(count == 1 || workers.empty())
+        {
+            for(size_t i = 0; i < count; ++i)
+            {
+                f(i);
+            }
+
+            return;
+        }
+
+        // Helpers may start after the caller returned, so everything they
+        // touch is kept alive by them.
+        struct state_t
+        {
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> done = 0;
+            size_t count;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+
+        auto state = std::make_shared<state_t>();
+        state->count = count;
+
+        auto body = std::function<void(size_t)>(std::forward<F>(f));
+
+        auto run = [state, body]()
+        {
+            size_t processed = 0;
+
+            for(auto i = state->next++; i < state->count; i = state->next++)
+            {
+                body(i);
+                processed++;
+            }
+
+            if(processed != 0 && state->done.fetch_add(processed) + processed == state->count)
+            {
+                std::lock_guard lock(state->mutex);
+                state->finished.notify_all();
+            }
+        };
+
+        auto helpers = std::min<size_t>(workers.size(), count - 1);
+
+        for(size_t i = 0; i < helpers; ++i)
+        {
+            submit(run);
+        }
+
+        run();
+
+        std::unique_lock lock(state->mutex);
+        state->finished.wait(lock, [&state]() { return state->done.load() == state->count; });
+    }
+}
+
+#endif // THREAD_POOL_HPP
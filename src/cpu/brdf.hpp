@@ -0,0 +1,216 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_BRDF_HPP
+#define CPU_BRDF_HPP
+
+#include "geometry.hpp"
+#include "glsl.hpp"
+
+// Mirror of brdf.glslh.
+namespace bpmap::cpu
+{
+    static constexpr float_t pi = 3.1415927410125732421875f;
+    static constexpr float_t sqrt_two_over_pi = 0.4501581455517614f;
+
+    inline float_t pow5(float_t x)
+    {
+        auto x_sq = x * x;
+
+        return x_sq * x_sq * x;
+    }
+
+    inline vec3_t diffuse_lambert(const vec3_t& base_color)
+    {
+        return base_color * (1 / pi);
+    }
+
+    inline float_t d_beckmann(float_t roughness, float_t dot_n_h)
+    {
+        auto a = roughness * roughness;
+        auto a_sq = a * a;
+        auto dot_n_h_sq = dot_n_h * dot_n_h;
+
+        return std::exp((dot_n_h_sq - 1) / (a_sq * dot_n_h_sq)) / (pi * a_sq * dot_n_h_sq * dot_n_h_sq);
+    }
+
+    inline float_t g_reduced_shlick(float_t roughness, float_t dot_n_in, float_t dot_n_out)
+    {
+        auto k = roughness * sqrt_two_over_pi;
+        auto one_minus_k = 1 - k;
+
+        auto denom_in = dot_n_in * one_minus_k + k;
+        auto denom_out = dot_n_out * one_minus_k + k;
+
+        return 1.0f / (denom_in * denom_out);
+    }
+
+    inline vec3_t f_schlick(const vec3_t& specular_color, float_t dot_h_in)
+    {
+        auto f_lambda = pow5(1 - dot_h_in);
+
+        return specular_color + (1.0f - specular_color) * f_lambda;
+    }
+
+    inline vec3_t sample_cosine_hemisphere(vec2_t u)
+    {
+        auto r = std::sqrt(u.x);
+        auto phi = 2.0f * pi * u.y;
+
+        return {r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u.x))};
+    }
+
+    inline float_t cosine_hemisphere_pdf(float_t cos_theta)
+    {
+        return std::max(0.0f, cos_theta) * (1 / pi);
+    }
+
+    // Giles 2010, single precision.
+    inline float_t erf_inv(float_t x)
+    {
+        x = std::clamp(x, -0.99999f, 0.99999f);
+        auto w = -std::log((1.0f - x) * (1.0f + x));
+        float_t p;
+
+        if(w < 5.0f)
+        {
+            w -= 2.5f;
+            p = 2.81022636e-08f;
+            p = 3.43273939e-07f + p * w;
+            p = -3.5233877e-06f + p * w;
+            p = -4.39150654e-06f + p * w;
+            p = 0.00021858087f + p * w;
+            p = -0.00125372503f + p * w;
+            p = -0.00417768164f + p * w;
+            p = 0.246640727f + p * w;
+            p = 1.50140941f + p * w;
+        }
+        else
+        {
+            w = std::sqrt(w) - 3.0f;
+            p = -0.000200214257f;
+            p = 0.000100950558f + p * w;
+            p = 0.00134934322f + p * w;
+            p = -0.00367342844f + p * w;
+            p = 0.00573950773f + p * w;
+            p = -0.0076224613f + p * w;
+            p = 0.00943887047f + p * w;
+            p = 1.00167406f + p * w;
+            p = 2.83297682f + p * w;
+        }
+
+        return p * x;
+    }
+
+    inline float_t g1_smith_beckmann(float_t roughness, float_t dot_n_v)
+    {
+        auto a = roughness * roughness;
+        auto tan_theta = std::sqrt(std::max(0.0f, 1.0f - dot_n_v * dot_n_v)) / dot_n_v;
+
+        if(tan_theta < epsilon)
+        {
+            return 1.0f;
+        }
+
+        auto b = 1.0f / (a * tan_theta);
+        auto lambda = 0.5f * (std::erf(b) - 1.0f) + std::exp(-b * b) / (2.0f * b * std::sqrt(pi));
+
+        return 1.0f / (1.0f + std::max(0.0f, lambda));
+    }
+
+    inline vec2_t sample_beckmann_visible_slope(float_t cos_theta, vec2_t u)
+    {
+        if(cos_theta > 0.9999f)
+        {
+            auto r = std::sqrt(-std::log(1.0f - u.x));
+            auto phi = 2.0f * pi * u.y;
+
+            return {r * std::cos(phi), r * std::sin(phi)};
+        }
+
+        auto sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+        auto tan_theta = sin_theta / cos_theta;
+        auto cot_theta = 1.0f / tan_theta;
+
+        auto lo = -1.0f;
+        auto hi = std::erf(cot_theta);
+        auto sample_x = std::max(u.x, 1e-6f);
+
+        auto theta = std::acos(cos_theta);
+        auto fit = 1.0f + theta * (-0.876f + theta * (0.4265f - 0.0594f * theta));
+        auto b = hi - (1.0f + hi) * std::pow(1.0f - sample_x, fit);
+
+        auto normalization = 1.0f / (1.0f + hi + tan_theta * std::exp(-cot_theta * cot_theta) / std::sqrt(pi));
+
+        for(uint32_t i = 0; i < 10; ++i)
+        {
+            if(!(b >= lo && b <= hi))
+            {
+                b = 0.5f * (lo + hi);
+            }
+
+            auto slope = erf_inv(b);
+            auto value = normalization * (1.0f + b + tan_theta * std::exp(-slope * slope) / std::sqrt(pi)) - sample_x;
+
+            if(std::abs(value) < 1e-5f)
+            {
+                break;
+            }
+
+            if(value > 0.0f)
+            {
+                hi = b;
+            }
+            else
+            {
+                lo = b;
+            }
+
+            auto derivative = normalization * (1.0f - slope * tan_theta);
+            b -= value / derivative;
+        }
+
+        return {erf_inv(b), erf_inv(2.0f * std::max(u.y, 1e-6f) - 1.0f)};
+    }
+
+    inline vec3_t sample_beckmann_visible_normal(float_t roughness, const vec3_t& out_dir, vec2_t u)
+    {
+        auto a = roughness * roughness;
+
+        auto stretched = normalize(vec3_t{a * out_dir.x, a * out_dir.y, std::max(out_dir.z, epsilon)});
+        auto slope = sample_beckmann_visible_slope(stretched.z, u);
+
+        auto r = std::sqrt(stretched.x * stretched.x + stretched.y * stretched.y);
+        auto phi = r > 0.0f ? vec2_t{stretched.x / r, stretched.y / r} : vec2_t{1.0f, 0.0f};
+        slope = {phi.x * slope.x - phi.y * slope.y, phi.y * slope.x + phi.x * slope.y};
+
+        return normalize(vec3_t{-a * slope.x, -a * slope.y, 1.0f});
+    }
+
+    inline float_t beckmann_reflection_pdf(float_t roughness, float_t dot_n_h, float_t dot_n_out, float_t dot_h_out)
+    {
+        if(dot_n_h <= 0.0f || dot_n_out <= 0.0f || dot_h_out <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        return g1_smith_beckmann(roughness, dot_n_out) * d_beckmann(roughness, dot_n_h) / (4.0f * dot_n_out);
+    }
+}
+
+#endif // CPU_BRDF_HPP
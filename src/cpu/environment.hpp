@@ -0,0 +1,130 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_ENVIRONMENT_HPP
+#define CPU_ENVIRONMENT_HPP
+
+#include <scene/scene.hpp>
+
+#include "lights.hpp"
+
+// Mirror of environment.glslh.
+namespace bpmap::cpu
+{
+    struct texel_t
+    {
+        uint32_t x;
+        uint32_t y;
+    };
+
+    inline bool_t has_environment(const scene_t& scene)
+    {
+        return scene.settings.environment_width != 0;
+    }
+
+    inline texel_t get_environment_texel(const scene_t& scene, const vec3_t& direction)
+    {
+        auto width = scene.settings.environment_width;
+        auto height = scene.settings.environment_height;
+
+        auto theta = std::acos(std::clamp(direction.y, -1.0f, 1.0f));
+        auto phi = std::atan2(direction.z, direction.x);
+
+        vec2_t uv = {phi / (2.0f * pi) + 0.5f, theta / pi};
+
+        return {std::min(uint32_t(uv.x * width), width - 1), std::min(uint32_t(uv.y * height), height - 1)};
+    }
+
+    inline vec3_t get_environment_radiance(const scene_t& scene, const vec3_t& direction)
+    {
+        auto texel = get_environment_texel(scene, direction);
+        vec3_t radiance = scene.environment[texel.y * scene.settings.environment_width + texel.x].components;
+
+        return radiance * scene.settings.environment_intensity;
+    }
+
+    inline float_t environment_texel_pdf(const scene_t& scene, float_t texel_pdf, float_t sin_theta)
+    {
+        if(sin_theta <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        auto texels_count = float_t(scene.settings.environment_width * scene.settings.environment_height);
+
+        return texel_pdf * texels_count / (2.0f * pi * pi * sin_theta);
+    }
+
+    inline float_t environment_pdf(const scene_t& scene, const vec3_t& direction)
+    {
+        auto width = scene.settings.environment_width;
+        auto height = scene.settings.environment_height;
+        auto texel = get_environment_texel(scene, direction);
+
+        auto texel_pdf = scene.environment_aliases[texel.y].pdf *
+                         scene.environment_aliases[height + texel.y * width + texel.x].pdf;
+
+        return environment_texel_pdf(scene, texel_pdf, std::sqrt(std::max(0.0f, 1.0f - direction.y * direction.y)));
+    }
+
+    inline uint32_t sample_environment_alias(const scene_t& scene, uint32_t first, uint32_t count, float_t& u, float_t& pdf)
+    {
+        auto scaled = u * count;
+        auto i = std::min(uint32_t(scaled), count - 1);
+        u = std::min(scaled - i, one_minus_epsilon);
+
+        auto& entry = scene.environment_aliases[first + i];
+
+        if(u < entry.probability)
+        {
+            u = u / entry.probability;
+        }
+        else
+        {
+            u = (u - entry.probability) / (1.0f - entry.probability);
+            i = entry.alias;
+        }
+
+        u = std::min(u, one_minus_epsilon);
+        pdf = scene.environment_aliases[first + i].pdf;
+
+        return i;
+    }
+
+    inline vec3_t sample_environment(const scene_t& scene, vec2_t u, float_t& pdf)
+    {
+        auto width = scene.settings.environment_width;
+        auto height = scene.settings.environment_height;
+
+        float_t row_pdf;
+        auto row = sample_environment_alias(scene, 0, height, u.y, row_pdf);
+
+        float_t column_pdf;
+        auto column = sample_environment_alias(scene, height + row * width, width, u.x, column_pdf);
+
+        auto theta = pi * (row + u.y) / height;
+        auto phi = 2.0f * pi * ((column + u.x) / width - 0.5f);
+
+        auto sin_theta = std::sin(theta);
+        pdf = environment_texel_pdf(scene, row_pdf * column_pdf, sin_theta);
+
+        return {sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi)};
+    }
+}
+
+#endif // CPU_ENVIRONMENT_HPP
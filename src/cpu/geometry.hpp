@@ -0,0 +1,156 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_GEOMETRY_HPP
+#define CPU_GEOMETRY_HPP
+
+#include <scene/scene.hpp>
+
+#include "glsl.hpp"
+
+// Mirror of geometry.glslh, the buffers are the arrays of the scene.
+namespace bpmap::cpu
+{
+    static constexpr float_t epsilon = 0.0001f;
+    static constexpr float_t bias = epsilon * 10;
+    static constexpr float_t infinity = INFINITY;
+    // Missing normals, texcoords and materials of a face.
+    static constexpr uint32_t missing_index = ~0u;
+
+    struct ray_t
+    {
+        vec3_t origin;
+        vec3_t direction;
+    };
+
+    struct intersection_t
+    {
+        vec3_t normal;
+        float_t t;
+        uint32_t material_id;
+    };
+
+    inline void make_basis(const vec3_t& n, vec3_t& tangent, vec3_t& bitangent)
+    {
+        auto s = n.z >= 0.0f ? 1.0f : -1.0f;
+        auto a = -1.0f / (s + n.z);
+        auto b = n.x * n.y * a;
+
+        tangent = {1.0f + s * n.x * n.x * a, s * b, -s * n.x};
+        bitangent = {b, s + n.y * n.y * a, -n.y};
+    }
+
+    inline vec3_t to_world(const vec3_t& local, const vec3_t& n)
+    {
+        vec3_t tangent;
+        vec3_t bitangent;
+        make_basis(n, tangent, bitangent);
+
+        return local.x * tangent + local.y * bitangent + local.z * n;
+    }
+
+    inline vec3_t to_local(const vec3_t& world, const vec3_t& n)
+    {
+        vec3_t tangent;
+        vec3_t bitangent;
+        make_basis(n, tangent, bitangent);
+
+        return {dot(world, tangent), dot(world, bitangent), dot(world, n)};
+    }
+
+    inline material_t get_material(const scene_t& scene, uint32_t material_id)
+    {
+        if(material_id == missing_index)
+        {
+            material_t material = {};
+            material.base_color = {0.8f, 0.8f, 0.8f};
+            material.roughness = 1.0f;
+
+            return material;
+        }
+
+        return scene.materials[material_id];
+    }
+
+    inline bool_t intersect_triangle(
+                                      const scene_t& scene,
+                                      const ray_t& ray,
+                                      const triangle_t& triangle,
+                                      intersection_t& intersection
+                                    )
+    {
+        vec3_t v0 = scene.vertices[triangle.vertices[0].vertex_index].components;
+        vec3_t v1 = scene.vertices[triangle.vertices[1].vertex_index].components;
+        vec3_t v2 = scene.vertices[triangle.vertices[2].vertex_index].components;
+
+        auto v0v2 = v2 - v0;
+        auto v1v2 = v2 - v1;
+        auto p = cross(v1v2, ray.direction);
+        auto det = dot(v0v2, p);
+
+        if(std::abs(det) < epsilon)
+        {
+            return false;
+        }
+
+        auto inv_det = 1.0f / det;
+
+        auto r = v2 - ray.origin;
+
+        auto alpha = dot(r, p) * inv_det;
+
+        if(alpha < 0 || alpha > 1)
+        {
+            return false;
+        }
+
+        auto beta = dot(cross(ray.direction, v0v2), r) * inv_det;
+
+        if(beta < 0 || alpha + beta > 1)
+        {
+            return false;
+        }
+
+        auto gamma = 1 - beta - alpha;
+
+        intersection.t = dot(cross(v0v2, v1v2), r) * inv_det;
+
+        if(
+            triangle.vertices[0].normal_index == missing_index ||
+            triangle.vertices[1].normal_index == missing_index ||
+            triangle.vertices[2].normal_index == missing_index
+          )
+        {
+            intersection.normal = normalize(cross(v1 - v0, v2 - v0));
+        }
+        else
+        {
+            vec3_t n0 = scene.normals[triangle.vertices[0].normal_index].components;
+            vec3_t n1 = scene.normals[triangle.vertices[1].normal_index].components;
+            vec3_t n2 = scene.normals[triangle.vertices[2].normal_index].components;
+
+            intersection.normal = normalize(alpha * n0 + beta * n1 + gamma * n2);
+        }
+
+        intersection.material_id = triangle.material_id;
+
+        return true;
+    }
+}
+
+#endif // CPU_GEOMETRY_HPP
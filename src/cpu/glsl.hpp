@@ -0,0 +1,127 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_GLSL_HPP
+#define CPU_GLSL_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include <common.hpp>
+#include <algebra.hpp>
+
+// The part of GLSL the CPU mirrors of the shaders use, so the mirrors read
+// like the shaders they follow.
+namespace bpmap::cpu
+{
+    struct vec2_t
+    {
+        float_t x;
+        float_t y;
+    };
+
+    struct vec3_t
+    {
+        float_t x;
+        float_t y;
+        float_t z;
+
+        vec3_t() : x(0.0f), y(0.0f), z(0.0f) {}
+        vec3_t(float_t s) : x(s), y(s), z(s) {}
+        vec3_t(float_t x, float_t y, float_t z) : x(x), y(y), z(z) {}
+
+        template <typename T, size_t size>
+        vec3_t(const T (&components)[size]) : x(components[0]), y(components[1]), z(components[2])
+        {
+            static_assert(size >= 3);
+        }
+
+        vec3_t operator-() const { return {-x, -y, -z}; }
+
+        vec3_t& operator+=(const vec3_t& v) { x += v.x; y += v.y; z += v.z; return *this; }
+        vec3_t& operator-=(const vec3_t& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+        vec3_t& operator*=(const vec3_t& v) { x *= v.x; y *= v.y; z *= v.z; return *this; }
+        vec3_t& operator/=(const vec3_t& v) { x /= v.x; y /= v.y; z /= v.z; return *this; }
+    };
+
+    inline vec3_t operator+(vec3_t a, const vec3_t& b) { return a += b; }
+    inline vec3_t operator-(vec3_t a, const vec3_t& b) { return a -= b; }
+    inline vec3_t operator*(vec3_t a, const vec3_t& b) { return a *= b; }
+    inline vec3_t operator/(vec3_t a, const vec3_t& b) { return a /= b; }
+
+    inline vec3_t operator+(vec3_t a, float_t s) { return a += vec3_t(s); }
+    inline vec3_t operator-(vec3_t a, float_t s) { return a -= vec3_t(s); }
+    inline vec3_t operator*(vec3_t a, float_t s) { return a *= vec3_t(s); }
+    inline vec3_t operator/(vec3_t a, float_t s) { return a /= vec3_t(s); }
+    inline vec3_t operator+(float_t s, const vec3_t& a) { return vec3_t(s) + a; }
+    inline vec3_t operator-(float_t s, const vec3_t& a) { return vec3_t(s) - a; }
+    inline vec3_t operator*(float_t s, const vec3_t& a) { return vec3_t(s) * a; }
+    inline vec3_t operator/(float_t s, const vec3_t& a) { return vec3_t(s) / a; }
+
+    inline float_t dot(const vec3_t& a, const vec3_t& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline vec3_t cross(const vec3_t& a, const vec3_t& b)
+    {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    inline float_t length(const vec3_t& v)
+    {
+        return std::sqrt(dot(v, v));
+    }
+
+    inline vec3_t normalize(const vec3_t& v)
+    {
+        return v / length(v);
+    }
+
+    inline vec3_t reflect(const vec3_t& i, const vec3_t& n)
+    {
+        return i - 2.0f * dot(n, i) * n;
+    }
+
+    inline float_t mix(float_t a, float_t b, float_t t)
+    {
+        return a + (b - a) * t;
+    }
+
+    inline vec3_t mix(const vec3_t& a, const vec3_t& b, float_t t)
+    {
+        return a + (b - a) * t;
+    }
+
+    inline vec3_t min(const vec3_t& a, const vec3_t& b)
+    {
+        return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+    }
+
+    inline vec3_t max(const vec3_t& a, const vec3_t& b)
+    {
+        return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+    }
+
+    inline float_t max_component(const vec3_t& v)
+    {
+        return std::max({v.x, v.y, v.z});
+    }
+}
+
+#endif // CPU_GLSL_HPP
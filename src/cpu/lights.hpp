@@ -0,0 +1,449 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_LIGHTS_HPP
+#define CPU_LIGHTS_HPP
+
+#include <scene/scene.hpp>
+
+#include "brdf.hpp"
+#include "geometry.hpp"
+
+// Mirror of lights.glslh.
+namespace bpmap::cpu
+{
+    static constexpr float_t min_solid_angle = 1e-5f;
+    static constexpr float_t one_minus_epsilon = 0.99999994f;
+
+    inline float_t power_heuristic(float_t count_f, float_t pdf_f, float_t count_g, float_t pdf_g)
+    {
+        auto f = count_f * pdf_f;
+        auto g = count_g * pdf_g;
+
+        return (f * f) / std::max(f * f + g * g, 1e-30f);
+    }
+
+
+    inline uint32_t sample_light_alias(const scene_t& scene, vec2_t u, float_t& pdf)
+    {
+        auto count = uint32_t(scene.light_aliases.size());
+        auto i = std::min(uint32_t(u.x * count), count - 1);
+
+        if(u.y >= scene.light_aliases[i].probability)
+        {
+            i = scene.light_aliases[i].alias;
+        }
+
+        pdf = scene.light_aliases[i].pdf;
+
+        return i;
+    }
+
+
+    inline float_t cos_sub_clamped(float_t sin_a, float_t cos_a, float_t sin_b, float_t cos_b)
+    {
+        return cos_a >= cos_b ? 1.0f : cos_a * cos_b + sin_a * sin_b;
+    }
+
+    inline float_t sin_sub_clamped(float_t sin_a, float_t cos_a, float_t sin_b, float_t cos_b)
+    {
+        return cos_a >= cos_b ? 0.0f : sin_a * cos_b - cos_a * sin_b;
+    }
+
+    inline float_t get_importance(const light_bvh_node_t& node, const vec3_t& point, const vec3_t& normal)
+    {
+        vec3_t bounds_min = node.bounds_min.components;
+        vec3_t bounds_max = node.bounds_max.components;
+
+        auto center = 0.5f * (bounds_min + bounds_max);
+        auto to_point = point - center;
+        auto distance_sq = dot(to_point, to_point);
+        auto radius_sq = dot(bounds_max - center, bounds_max - center);
+
+        auto direction = to_point / std::sqrt(std::max(distance_sq, 1e-30f));
+
+        auto cos_w = dot(vec3_t(node.axis.components), direction);
+        auto sin_w = std::sqrt(std::max(0.0f, 1.0f - cos_w * cos_w));
+
+        auto cos_b = distance_sq > radius_sq ? std::sqrt(1.0f - radius_sq / distance_sq) : -1.0f;
+        auto sin_b = std::sqrt(std::max(0.0f, 1.0f - cos_b * cos_b));
+
+        auto sin_o = std::sqrt(std::max(0.0f, 1.0f - node.cos_theta_o * node.cos_theta_o));
+
+        auto cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, node.cos_theta_o);
+        auto sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, node.cos_theta_o);
+        auto cos_emission = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+
+        if(cos_emission <= node.cos_theta_e)
+        {
+            return 0.0f;
+        }
+
+        auto cos_i = -dot(normal, direction);
+        auto sin_i = std::sqrt(std::max(0.0f, 1.0f - cos_i * cos_i));
+        auto cos_incidence = cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+
+        if(cos_incidence <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        return node.flux * cos_emission * cos_incidence / std::max(distance_sq, radius_sq);
+    }
+
+    inline uint32_t sample_light_bvh(const scene_t& scene, const vec3_t& point, const vec3_t& normal, float_t u, float_t& pdf)
+    {
+        uint32_t node = 0;
+        pdf = 1.0f;
+
+        while(!scene.light_bvh[node].is_leaf)
+        {
+            auto right = scene.light_bvh[node].child;
+
+            auto left_importance = get_importance(scene.light_bvh[node + 1], point, normal);
+            auto total = left_importance + get_importance(scene.light_bvh[right], point, normal);
+
+            if(total <= 0.0f)
+            {
+                pdf = 0.0f;
+                return 0;
+            }
+
+            auto p_left = left_importance / total;
+
+            if(u < p_left)
+            {
+                node = node + 1;
+                u = std::min(u / p_left, one_minus_epsilon);
+                pdf *= p_left;
+            }
+            else
+            {
+                node = right;
+                u = std::min((u - p_left) / (1.0f - p_left), one_minus_epsilon);
+                pdf *= 1.0f - p_left;
+            }
+        }
+
+        return scene.light_bvh[node].child;
+    }
+
+    inline float_t light_bvh_pdf(const scene_t& scene, const vec3_t& point, const vec3_t& normal, uint32_t light)
+    {
+        auto trail = scene.light_trails[light];
+        uint32_t node = 0;
+        float_t pdf = 1.0f;
+
+        while(!scene.light_bvh[node].is_leaf)
+        {
+            auto right = scene.light_bvh[node].child;
+
+            auto left_importance = get_importance(scene.light_bvh[node + 1], point, normal);
+            auto total = left_importance + get_importance(scene.light_bvh[right], point, normal);
+
+            if(total <= 0.0f)
+            {
+                return 0.0f;
+            }
+
+            auto p_left = left_importance / total;
+
+            if((trail & 1) == 0)
+            {
+                node = node + 1;
+                pdf *= p_left;
+            }
+            else
+            {
+                node = right;
+                pdf *= 1.0f - p_left;
+            }
+
+            trail >>= 1;
+        }
+
+        return pdf;
+    }
+
+
+    inline uint32_t select_light(const scene_t& scene, const vec3_t& point, const vec3_t& normal, vec2_t u, float_t& pdf)
+    {
+        auto selection = scene.settings.light_selection;
+
+        if(scene.lights.empty())
+        {
+            pdf = 0.0f;
+            return 0;
+        }
+
+        if(selection == light_selection_t::bvh)
+        {
+            return sample_light_bvh(scene, point, normal, u.x, pdf);
+        }
+
+        if(selection == light_selection_t::power)
+        {
+            return sample_light_alias(scene, u, pdf);
+        }
+
+        auto count = uint32_t(scene.lights.size());
+        pdf = 1.0f / count;
+
+        return std::min(uint32_t(u.x * count), count - 1);
+    }
+
+    inline float_t select_light_pdf(const scene_t& scene, const vec3_t& point, const vec3_t& normal, uint32_t light)
+    {
+        auto selection = scene.settings.light_selection;
+
+        if(selection == light_selection_t::bvh)
+        {
+            return light_bvh_pdf(scene, point, normal, light);
+        }
+
+        if(selection == light_selection_t::power)
+        {
+            return scene.light_aliases[light].pdf;
+        }
+
+        return 1.0f / scene.lights.size();
+    }
+
+
+    struct rect_t
+    {
+        vec3_t corner;
+        vec3_t edge0;
+        vec3_t edge1;
+        vec3_t normal;
+        float_t area;
+        bool_t rectangular;
+        bool_t triangle;
+    };
+
+    inline rect_t get_rect(const light_t& light)
+    {
+        rect_t rect;
+        rect.corner = light.point.components;
+        rect.edge0 = light.param0_max * vec3_t(light.basis_vec0.components);
+        rect.edge1 = light.param1_max * vec3_t(light.basis_vec1.components);
+        rect.triangle = light.shape == light_shape_t::triangle;
+
+        auto normal = cross(rect.edge0, rect.edge1);
+        auto normal_length = length(normal);
+        rect.area = rect.triangle ? 0.5f * normal_length : normal_length;
+        rect.normal = normal / normal_length;
+
+        if(dot(rect.normal, vec3_t(light.normal.components)) < 0.0f)
+        {
+            rect.normal = -rect.normal;
+        }
+
+        rect.rectangular = !rect.triangle &&
+                           std::abs(dot(rect.edge0, rect.edge1)) <= epsilon * length(rect.edge0) * length(rect.edge1);
+
+        return rect;
+    }
+
+    inline vec3_t get_radiance(const light_t& light, const rect_t& rect)
+    {
+        return vec3_t(light.color.components) * (light.power / rect.area);
+    }
+
+
+    struct spherical_rect_t
+    {
+        vec3_t origin;
+        vec3_t x;
+        vec3_t y;
+        vec3_t z;
+        float_t x0;
+        float_t x1;
+        float_t y0;
+        float_t y1;
+        float_t z0;
+        float_t b0;
+        float_t b1;
+        float_t k;
+        float_t solid_angle;
+    };
+
+    inline spherical_rect_t get_spherical_rect(const rect_t& rect, const vec3_t& origin)
+    {
+        spherical_rect_t s;
+
+        auto edge0_length = length(rect.edge0);
+        auto edge1_length = length(rect.edge1);
+
+        s.origin = origin;
+        s.x = rect.edge0 / edge0_length;
+        s.y = rect.edge1 / edge1_length;
+        s.z = cross(s.x, s.y);
+
+        auto to_corner = rect.corner - origin;
+        s.x0 = dot(to_corner, s.x);
+        s.y0 = dot(to_corner, s.y);
+        s.z0 = dot(to_corner, s.z);
+
+        if(s.z0 > 0.0f)
+        {
+            s.z0 = -s.z0;
+            s.z = -s.z;
+        }
+
+        s.x1 = s.x0 + edge0_length;
+        s.y1 = s.y0 + edge1_length;
+
+        auto n0 = normalize(vec3_t(0.0f, s.z0, -s.y0));
+        auto n1 = normalize(vec3_t(-s.z0, 0.0f, s.x1));
+        auto n2 = normalize(vec3_t(0.0f, -s.z0, s.y1));
+        auto n3 = normalize(vec3_t(s.z0, 0.0f, -s.x0));
+
+        auto g0 = std::acos(std::clamp(-dot(n0, n1), -1.0f, 1.0f));
+        auto g1 = std::acos(std::clamp(-dot(n1, n2), -1.0f, 1.0f));
+        auto g2 = std::acos(std::clamp(-dot(n2, n3), -1.0f, 1.0f));
+        auto g3 = std::acos(std::clamp(-dot(n3, n0), -1.0f, 1.0f));
+
+        s.b0 = n0.z;
+        s.b1 = n2.z;
+        s.k = 2.0f * pi - g2 - g3;
+        s.solid_angle = g0 + g1 - s.k;
+
+        return s;
+    }
+
+    inline vec3_t sample_spherical_rect(const spherical_rect_t& s, vec2_t u)
+    {
+        auto au = u.x * s.solid_angle + s.k;
+        auto fu = (std::cos(au) * s.b0 - s.b1) / std::sin(au);
+        auto cu = std::clamp((fu > 0.0f ? 1.0f : -1.0f) / std::sqrt(fu * fu + s.b0 * s.b0), -1.0f, 1.0f);
+        auto xu = std::clamp(-(cu * s.z0) / std::max(std::sqrt(1.0f - cu * cu), 1e-7f), s.x0, s.x1);
+
+        auto d = std::sqrt(xu * xu + s.z0 * s.z0);
+        auto h0 = s.y0 / std::sqrt(d * d + s.y0 * s.y0);
+        auto h1 = s.y1 / std::sqrt(d * d + s.y1 * s.y1);
+        auto hv = h0 + u.y * (h1 - h0);
+        auto hv_sq = hv * hv;
+        auto yv = hv_sq < 1.0f - epsilon ? (hv * d) / std::sqrt(1.0f - hv_sq) : s.y1;
+
+        return s.origin + xu * s.x + yv * s.y + s.z0 * s.z;
+    }
+
+
+    inline bool_t sampled_by_solid_angle(const rect_t& rect, const spherical_rect_t& s)
+    {
+        return rect.rectangular && s.solid_angle >= min_solid_angle;
+    }
+
+    inline float_t area_pdf(const rect_t& rect, const vec3_t& origin, const vec3_t& light_point)
+    {
+        auto to_light = light_point - origin;
+        auto distance_sq = dot(to_light, to_light);
+        auto cos_light = -dot(to_light, rect.normal) / std::sqrt(distance_sq);
+
+        return cos_light > 0.0f ? distance_sq / (rect.area * cos_light) : 0.0f;
+    }
+
+    inline float_t rect_pdf(const rect_t& rect, const spherical_rect_t& s, const vec3_t& light_point)
+    {
+        if(sampled_by_solid_angle(rect, s))
+        {
+            return 1.0f / s.solid_angle;
+        }
+
+        return area_pdf(rect, s.origin, light_point);
+    }
+
+    inline float_t sample_rect(const rect_t& rect, const spherical_rect_t& s, vec2_t u, vec3_t& light_point)
+    {
+        if(sampled_by_solid_angle(rect, s))
+        {
+            light_point = sample_spherical_rect(s, u);
+
+            return 1.0f / s.solid_angle;
+        }
+
+        if(rect.triangle)
+        {
+            auto r = std::sqrt(u.x);
+            u = {r * (1.0f - u.y), r * u.y};
+        }
+
+        light_point = rect.corner + rect.edge0 * u.x + rect.edge1 * u.y;
+
+        return area_pdf(rect, s.origin, light_point);
+    }
+
+    inline bool_t intersect_bounds(
+                                    const ray_t& ray,
+                                    const vec3_t& inv_direction,
+                                    const vec3_t& bounds_min,
+                                    const vec3_t& bounds_max,
+                                    float_t t_max
+                                  )
+    {
+        auto t0 = (bounds_min - ray.origin) * inv_direction;
+        auto t1 = (bounds_max - ray.origin) * inv_direction;
+        auto t_near = min(t0, t1);
+        auto t_far = max(t0, t1);
+
+        return std::max({t_near.x, t_near.y, t_near.z, 0.0f}) <= std::min({t_far.x, t_far.y, t_far.z, t_max});
+    }
+
+    inline bool_t intersect_rect(const rect_t& rect, const ray_t& ray, float_t& t)
+    {
+        auto dot_d_n = dot(ray.direction, rect.normal);
+
+        t = infinity;
+
+        if(std::abs(dot_d_n) < epsilon)
+        {
+            return false;
+        }
+
+        auto plane_t = dot(rect.corner - ray.origin, rect.normal) / dot_d_n;
+
+        if(plane_t <= bias)
+        {
+            return false;
+        }
+
+        auto q = ray.origin + plane_t * ray.direction - rect.corner;
+
+        auto d00 = dot(rect.edge0, rect.edge0);
+        auto d01 = dot(rect.edge0, rect.edge1);
+        auto d11 = dot(rect.edge1, rect.edge1);
+        auto q0 = dot(q, rect.edge0);
+        auto q1 = dot(q, rect.edge1);
+        auto inv_det = 1.0f / (d00 * d11 - d01 * d01);
+
+        auto a = (d11 * q0 - d01 * q1) * inv_det;
+        auto b = (d00 * q1 - d01 * q0) * inv_det;
+
+        if(a < 0.0f || b < 0.0f || (rect.triangle ? a + b > 1.0f : a > 1.0f || b > 1.0f))
+        {
+            return false;
+        }
+
+        t = plane_t;
+
+        return true;
+    }
+}
+
+#endif // CPU_LIGHTS_HPP
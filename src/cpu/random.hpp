@@ -0,0 +1,189 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_RANDOM_HPP
+#define CPU_RANDOM_HPP
+
+#include <scene/scene.hpp>
+
+#include "glsl.hpp"
+
+// Mirror of random.glslh.
+namespace bpmap::cpu
+{
+    inline uint32_t reverse_bits(uint32_t x)
+    {
+        x = ((x & 0xaaaaaaaa) >> 1) | ((x & 0x55555555) << 1);
+        x = ((x & 0xcccccccc) >> 2) | ((x & 0x33333333) << 2);
+        x = ((x & 0xf0f0f0f0) >> 4) | ((x & 0x0f0f0f0f) << 4);
+        x = ((x & 0xff00ff00) >> 8) | ((x & 0x00ff00ff) << 8);
+
+        return (x >> 16) | (x << 16);
+    }
+
+    inline float_t van_der_corput(uint32_t x)
+    {
+        return reverse_bits(x) * float_t(1.0 / 4294967296.0);
+    }
+
+    static constexpr uint32_t pcg_multiplier = 747796405u;
+    static constexpr uint32_t pcg_increment = 2891336453u;
+
+    inline uint32_t pcg_output(uint32_t state)
+    {
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+
+        return (word >> 22u) ^ word;
+    }
+
+    inline uint32_t pcg_hash(uint32_t x)
+    {
+        return pcg_output(x * pcg_multiplier + pcg_increment);
+    }
+
+    inline float_t random_float(uint32_t& state)
+    {
+        state = state * pcg_multiplier + pcg_increment;
+
+        return (pcg_output(state) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    inline vec2_t random_vec2(uint32_t& state)
+    {
+        auto x = random_float(state);
+        auto y = random_float(state);
+
+        return {x, y};
+    }
+
+
+    inline uint32_t hash_combine(uint32_t seed, uint32_t value)
+    {
+        return pcg_hash(seed + pcg_hash(value));
+    }
+
+
+    inline uint32_t sobol_second_dimension(uint32_t index)
+    {
+        uint32_t x = 0u;
+
+        for(uint32_t v = 1u << 31; index != 0u; index >>= 1, v ^= v >> 1)
+        {
+            if((index & 1u) != 0u)
+            {
+                x ^= v;
+            }
+        }
+
+        return x;
+    }
+
+    inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+
+        return x;
+    }
+
+    inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    inline void owen_sobol(uint32_t index, uint32_t seed, uint32_t& x, uint32_t& y)
+    {
+        index = nested_uniform_scramble(index, seed);
+
+        x = nested_uniform_scramble(reverse_bits(index), hash_combine(seed, 0u));
+        y = nested_uniform_scramble(sobol_second_dimension(index), hash_combine(seed, 1u));
+    }
+
+
+    static constexpr uint32_t dimension_pixel = 0u;
+    static constexpr uint32_t dimension_light_selection = 0u;
+    static constexpr uint32_t dimension_light = 1u;
+    static constexpr uint32_t dimension_brdf = 2u;
+    static constexpr uint32_t dimension_lobe_and_roulette = 3u;
+    static constexpr uint32_t dimension_environment = 4u;
+    static constexpr uint32_t dimension_resampling = 5u;
+    static constexpr uint32_t dimension_neighbor = 6u;
+    static constexpr uint32_t dimensions_per_bounce = 7u;
+
+    inline uint32_t bounce_dimension(uint32_t bounce, uint32_t offset)
+    {
+        return 1u + bounce * dimensions_per_bounce + offset;
+    }
+
+
+    static constexpr uint32_t blue_noise_seed = 0x2545f491u;
+
+    struct sampler_t
+    {
+        uint32_t seed;
+        uint32_t pixel_x;
+        uint32_t pixel_y;
+        bool_t dithered;
+    };
+
+    inline sampler_t make_sampler(uint32_t x, uint32_t y, sample_pattern_t pattern)
+    {
+        sampler_t sampler;
+        sampler.pixel_x = x;
+        sampler.pixel_y = y;
+        sampler.dithered = pattern == sample_pattern_t::blue_noise;
+        sampler.seed = sampler.dithered ? blue_noise_seed : pcg_hash(x + pcg_hash(y));
+
+        return sampler;
+    }
+
+    inline void dither_offset(uint32_t pixel_x, uint32_t pixel_y, uint32_t dimension, uint32_t& x, uint32_t& y)
+    {
+        auto r2 = pixel_x * 3242174889u + pixel_y * 2447445413u;
+        auto ign_inner = 0.06711056f * pixel_x + 0.00583715f * pixel_y;
+        auto ign_outer = 52.9829189f * (ign_inner - std::floor(ign_inner));
+        auto ign = ign_outer - std::floor(ign_outer);
+
+        x = r2 + dimension * 2654435769u;
+        y = (uint32_t(ign * 16777216.0f) << 8) + dimension * 2654435769u;
+    }
+
+    inline vec2_t sample_2d(const sampler_t& sampler, uint32_t dimension, uint32_t index)
+    {
+        uint32_t x;
+        uint32_t y;
+        owen_sobol(index, hash_combine(sampler.seed, dimension), x, y);
+
+        if(sampler.dithered)
+        {
+            uint32_t offset_x;
+            uint32_t offset_y;
+            dither_offset(sampler.pixel_x, sampler.pixel_y, dimension, offset_x, offset_y);
+
+            x += offset_x;
+            y += offset_y;
+        }
+
+        return {(x >> 8) * (1.0f / 16777216.0f), (y >> 8) * (1.0f / 16777216.0f)};
+    }
+}
+
+#endif // CPU_RANDOM_HPP
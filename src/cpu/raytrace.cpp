@@ -0,0 +1,1179 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstdio>
+
+#include <thread_pool.hpp>
+
+#include "brdf.hpp"
+#include "environment.hpp"
+#include "geometry.hpp"
+#include "lights.hpp"
+#include "random.hpp"
+#include "raytrace.hpp"
+
+// Mirror of raytrace.comp, kept in the same order.
+namespace bpmap::cpu
+{
+    static constexpr uint32_t recursion_limit = 16;
+    static constexpr uint32_t russian_roulette_bounce = 1;
+    static constexpr float_t max_survival_probability = 0.95f;
+    static constexpr float_t min_roughness = 0.05f;
+    static constexpr uint32_t tile_size = 8;
+    static constexpr uint32_t adaptive_min_samples = 16;
+
+    static const vec3_t luminance = {0.2126f, 0.7152f, 0.0722f};
+
+    struct surface_t
+    {
+        vec3_t diffuse_color;
+        vec3_t specular_color;
+        float_t roughness;
+    };
+
+    static surface_t get_surface(const scene_t& scene, uint32_t material_id)
+    {
+        auto material = get_material(scene, material_id);
+        vec3_t base_color = material.base_color.components;
+
+        surface_t surface;
+        surface.diffuse_color = base_color - base_color * material.metallic;
+        surface.specular_color = mix(vec3_t(0.025f), surface.diffuse_color, material.metallic);
+        surface.roughness = std::max(material.roughness, min_roughness);
+
+        return surface;
+    }
+
+
+    static vec3_t brdf(const scene_t& scene, const vec3_t& out_dir, const vec3_t& in_dir, const intersection_t& intersection)
+    {
+        auto surface = get_surface(scene, intersection.material_id);
+
+        auto half_vec = normalize(out_dir + in_dir);
+
+        auto dot_n_in = std::max(0.0f, dot(intersection.normal, in_dir));
+        auto dot_n_out = std::max(0.0f, dot(intersection.normal, out_dir));
+        auto dot_n_h = std::max(0.0f, dot(intersection.normal, half_vec));
+        auto dot_h_in = std::max(0.0f, dot(half_vec, in_dir));
+
+        auto diffuse = diffuse_lambert(surface.diffuse_color);
+        auto f = f_schlick(surface.specular_color, dot_h_in);
+        auto g_reduced = g_reduced_shlick(surface.roughness, dot_n_in, dot_n_out);
+        auto d = std::max(0.0f, d_beckmann(surface.roughness, dot_n_h));
+
+        return diffuse + (g_reduced * f * d);
+    }
+
+    static vec3_t shade(
+                         const scene_t& scene,
+                         const vec3_t& out_dir,
+                         const vec3_t& in_dir,
+                         const intersection_t& intersection,
+                         const vec3_t& radiance
+                       )
+    {
+        auto projection_term = std::max(0.0f, dot(in_dir, intersection.normal));
+
+        return radiance * brdf(scene, out_dir, in_dir, intersection) * projection_term;
+    }
+
+
+    static float_t specular_probability(const surface_t& surface)
+    {
+        auto diffuse = dot(surface.diffuse_color, luminance);
+        auto specular = dot(surface.specular_color, luminance);
+
+        return std::clamp(specular / std::max(diffuse + specular, epsilon), 0.1f, 0.9f);
+    }
+
+    static float_t brdf_pdf(const scene_t& scene, const vec3_t& out_dir, const vec3_t& in_dir, const intersection_t& intersection)
+    {
+        auto surface = get_surface(scene, intersection.material_id);
+        auto p_specular = specular_probability(surface);
+
+        auto half_vec = normalize(out_dir + in_dir);
+
+        auto diffuse_pdf = cosine_hemisphere_pdf(dot(intersection.normal, in_dir));
+        auto specular_pdf = beckmann_reflection_pdf(
+                                                     surface.roughness,
+                                                     dot(intersection.normal, half_vec),
+                                                     dot(intersection.normal, out_dir),
+                                                     dot(half_vec, out_dir)
+                                                   );
+
+        return mix(diffuse_pdf, specular_pdf, p_specular);
+    }
+
+    static float_t sample_brdf(
+                                const scene_t& scene,
+                                const vec3_t& out_dir,
+                                const intersection_t& intersection,
+                                float_t u_lobe,
+                                vec2_t u,
+                                vec3_t& in_dir
+                              )
+    {
+        auto surface = get_surface(scene, intersection.material_id);
+
+        if(u_lobe < specular_probability(surface))
+        {
+            auto local_out = to_local(out_dir, intersection.normal);
+            auto half_vec = to_world(sample_beckmann_visible_normal(surface.roughness, local_out, u), intersection.normal);
+            in_dir = reflect(-out_dir, half_vec);
+        }
+        else
+        {
+            in_dir = to_world(sample_cosine_hemisphere(u), intersection.normal);
+        }
+
+        if(dot(in_dir, intersection.normal) <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        return brdf_pdf(scene, out_dir, in_dir, intersection);
+    }
+
+
+    static intersection_t intersect_geometry(const scene_t& scene, const ray_t& ray)
+    {
+        intersection_t intersection;
+        intersection.t = infinity;
+
+        for(auto& triangle : scene.triangles)
+        {
+            intersection_t current_intersection;
+
+            if(intersect_triangle(scene, ray, triangle, current_intersection))
+            {
+                if(current_intersection.t > bias && current_intersection.t < intersection.t)
+                {
+                    intersection = current_intersection;
+                }
+            }
+        }
+
+        return intersection;
+    }
+
+    static vec3_t direct_lighting(
+                                   const scene_t& scene,
+                                   const vec3_t& intersection_point,
+                                   const vec3_t& out_dir,
+                                   const intersection_t& intersection,
+                                   uint32_t samples_count,
+                                   bool_t brdf_sampled,
+                                   const sampler_t& sampler,
+                                   uint32_t bounce,
+                                   uint32_t pixel_sample
+                                 )
+    {
+        vec3_t output_color;
+
+        for(uint32_t j = 0; j < samples_count; ++j)
+        {
+            auto index = pixel_sample * samples_count + j;
+
+            float_t selection_pdf;
+            auto i = select_light(
+                                   scene,
+                                   intersection_point,
+                                   intersection.normal,
+                                   sample_2d(sampler, bounce_dimension(bounce, dimension_light_selection), index),
+                                   selection_pdf
+                                 );
+
+            if(selection_pdf <= 0.0f)
+            {
+                continue;
+            }
+
+            auto& light = scene.lights[i];
+            auto rect = get_rect(light);
+
+            if(dot(intersection_point - rect.corner, rect.normal) <= 0)
+            {
+                continue;
+            }
+
+            auto spherical_rect = get_spherical_rect(rect, intersection_point);
+            auto u = sample_2d(sampler, bounce_dimension(bounce, dimension_light), index);
+
+            vec3_t light_sample;
+            auto light_pdf = selection_pdf * sample_rect(rect, spherical_rect, u, light_sample);
+
+            if(light_pdf <= 0.0f)
+            {
+                continue;
+            }
+
+            ray_t shadow_ray;
+            shadow_ray.origin = light_sample;
+            auto shadow_ray_vector = intersection_point - light_sample;
+            shadow_ray.direction = normalize(shadow_ray_vector);
+
+            auto shadow = intersect_geometry(scene, shadow_ray);
+
+            auto light_distance = length(shadow_ray_vector);
+
+            if(std::abs(shadow.t - light_distance) < bias)
+            {
+                auto in_dir = -shadow_ray.direction;
+
+                auto weight = brdf_sampled ?
+                              power_heuristic(samples_count, light_pdf, 1.0f, brdf_pdf(scene, out_dir, in_dir, intersection)) :
+                              1.0f;
+
+                output_color += shade(
+                                       scene,
+                                       out_dir,
+                                       in_dir,
+                                       intersection,
+                                       get_radiance(light, rect) * (weight / (samples_count * light_pdf))
+                                     );
+            }
+        }
+
+        return output_color;
+    }
+
+    static constexpr float_t temporal_confidence_cap = 5.0f;
+
+    static constexpr uint32_t spatial_neighbors = 5;
+    static constexpr float_t spatial_radius_scale = 0.025f;
+    static constexpr float_t reuse_min_normal_cos = 0.906f;
+    static constexpr float_t reuse_max_depth_difference = 0.1f;
+
+    struct reservoir_t
+    {
+        vec3_t light_point;
+        uint32_t light = 0;
+        vec3_t surface_point;
+        uint32_t material_id = 0;
+        vec3_t surface_normal;
+        float_t weight = 0.0f;
+        vec3_t out_dir;
+        float_t confidence = 0.0f;
+    };
+
+    static float_t light_sample_target(
+                                        const scene_t& scene,
+                                        const vec3_t& intersection_point,
+                                        const vec3_t& out_dir,
+                                        const intersection_t& intersection,
+                                        uint32_t light_index,
+                                        const vec3_t& light_point
+                                      )
+    {
+        auto& light = scene.lights[light_index];
+        auto rect = get_rect(light);
+
+        auto to_light = light_point - intersection_point;
+        auto distance_sq = dot(to_light, to_light);
+        auto in_dir = to_light / std::sqrt(distance_sq);
+        auto cos_light = -dot(in_dir, rect.normal);
+
+        if(cos_light <= 0.0f || dot(in_dir, intersection.normal) <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        auto color = shade(scene, out_dir, in_dir, intersection, get_radiance(light, rect));
+
+        return dot(color, luminance) * cos_light / distance_sq;
+    }
+
+    static reservoir_t sample_light_candidates(
+                                                const scene_t& scene,
+                                                const vec3_t& intersection_point,
+                                                const vec3_t& out_dir,
+                                                const intersection_t& intersection,
+                                                uint32_t samples_count,
+                                                const sampler_t& sampler,
+                                                uint32_t pixel_sample,
+                                                float_t& u
+                                              )
+    {
+        reservoir_t reservoir;
+        reservoir.surface_point = intersection_point;
+        reservoir.material_id = intersection.material_id;
+        reservoir.surface_normal = intersection.normal;
+        reservoir.out_dir = out_dir;
+        reservoir.confidence = float_t(std::max(samples_count, 1u));
+
+        auto weight_sum = 0.0f;
+        auto target = 0.0f;
+
+        for(uint32_t j = 0; j < samples_count; ++j)
+        {
+            auto index = pixel_sample * samples_count + j;
+
+            float_t selection_pdf;
+            auto i = select_light(
+                                   scene,
+                                   intersection_point,
+                                   intersection.normal,
+                                   sample_2d(sampler, bounce_dimension(0, dimension_light_selection), index),
+                                   selection_pdf
+                                 );
+
+            if(selection_pdf <= 0.0f)
+            {
+                continue;
+            }
+
+            auto& light = scene.lights[i];
+            auto rect = get_rect(light);
+
+            if(dot(intersection_point - rect.corner, rect.normal) <= 0)
+            {
+                continue;
+            }
+
+            auto spherical_rect = get_spherical_rect(rect, intersection_point);
+            auto u_light = sample_2d(sampler, bounce_dimension(0, dimension_light), index);
+
+            vec3_t light_sample;
+            auto light_pdf = selection_pdf * sample_rect(rect, spherical_rect, u_light, light_sample);
+
+            if(light_pdf <= 0.0f)
+            {
+                continue;
+            }
+
+            auto to_light = light_sample - intersection_point;
+            auto distance_sq = dot(to_light, to_light);
+            auto cos_light = -dot(to_light, rect.normal) / std::sqrt(distance_sq);
+            auto candidate_target = light_sample_target(scene, intersection_point, out_dir, intersection, i, light_sample);
+
+            if(candidate_target <= 0.0f)
+            {
+                continue;
+            }
+
+            auto weight = candidate_target * distance_sq / (light_pdf * cos_light);
+            weight_sum += weight;
+
+            auto p = weight / weight_sum;
+
+            if(u < p)
+            {
+                reservoir.light = i;
+                reservoir.light_point = light_sample;
+                target = candidate_target;
+                u = std::min(u / p, one_minus_epsilon);
+            }
+            else
+            {
+                u = std::min((u - p) / (1.0f - p), one_minus_epsilon);
+            }
+        }
+
+        reservoir.weight = target > 0.0f ? weight_sum / (samples_count * target) : 0.0f;
+
+        return reservoir;
+    }
+
+    static float_t reservoir_target(const scene_t& scene, const reservoir_t& surface, const reservoir_t& sample)
+    {
+        intersection_t intersection;
+        intersection.normal = surface.surface_normal;
+        intersection.t = 0.0f;
+        intersection.material_id = surface.material_id;
+
+        return light_sample_target(
+                                    scene,
+                                    surface.surface_point,
+                                    surface.out_dir,
+                                    intersection,
+                                    sample.light,
+                                    sample.light_point
+                                  );
+    }
+
+    static bool_t is_reusable(const reservoir_t& pixel, const reservoir_t& other, const vec3_t& camera_origin)
+    {
+        if(other.confidence <= 0.0f || dot(pixel.surface_normal, other.surface_normal) < reuse_min_normal_cos)
+        {
+            return false;
+        }
+
+        auto depth = length(pixel.surface_point - camera_origin);
+
+        return std::abs(length(other.surface_point - camera_origin) - depth) <= reuse_max_depth_difference * depth;
+    }
+
+    static constexpr uint32_t max_reused_reservoirs = spatial_neighbors + 1;
+
+    static reservoir_t combine_reservoirs(
+                                           const scene_t& scene,
+                                           const array_t<reservoir_t, max_reused_reservoirs>& reservoirs,
+                                           uint32_t count,
+                                           float_t u
+                                         )
+    {
+        auto combined = reservoirs[0];
+        auto weight_sum = 0.0f;
+        auto target = 0.0f;
+        auto confidence = 0.0f;
+
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            confidence += reservoirs[i].confidence;
+
+            if(reservoirs[i].weight <= 0.0f)
+            {
+                continue;
+            }
+
+            auto candidate_target = reservoir_target(scene, reservoirs[0], reservoirs[i]);
+
+            if(candidate_target <= 0.0f)
+            {
+                continue;
+            }
+
+            auto weight = candidate_target * reservoirs[i].weight * reservoirs[i].confidence;
+            weight_sum += weight;
+
+            auto p = weight / weight_sum;
+
+            if(u < p)
+            {
+                combined.light = reservoirs[i].light;
+                combined.light_point = reservoirs[i].light_point;
+                target = candidate_target;
+                u = std::min(u / p, one_minus_epsilon);
+            }
+            else
+            {
+                u = std::min((u - p) / (1.0f - p), one_minus_epsilon);
+            }
+        }
+
+        auto normalization = reservoirs[0].confidence;
+
+        for(uint32_t i = 1; i < count && target > 0.0f; ++i)
+        {
+            if(reservoir_target(scene, reservoirs[i], combined) > 0.0f)
+            {
+                normalization += reservoirs[i].confidence;
+            }
+        }
+
+        combined.weight = target > 0.0f ? weight_sum / (normalization * target) : 0.0f;
+        combined.confidence = confidence;
+
+        return combined;
+    }
+
+    static reservoir_t sample_temporal_reservoir(
+                                                  const scene_t& scene,
+                                                  const ray_t& ray,
+                                                  const sampler_t& sampler,
+                                                  const darray_t<reservoir_t>& kept,
+                                                  size_t pixel,
+                                                  uint32_t pixel_sample
+                                                )
+    {
+        auto intersection = intersect_geometry(scene, ray);
+
+        if(intersection.t == infinity)
+        {
+            return reservoir_t();
+        }
+
+        auto u = sample_2d(sampler, bounce_dimension(0, dimension_resampling), pixel_sample).x;
+
+        array_t<reservoir_t, max_reused_reservoirs> reservoirs;
+        reservoirs[0] = sample_light_candidates(
+                                                 scene,
+                                                 ray.origin + intersection.t * ray.direction,
+                                                 -ray.direction,
+                                                 intersection,
+                                                 scene.settings.light_samples,
+                                                 sampler,
+                                                 pixel_sample,
+                                                 u
+                                               );
+
+        if(pixel_sample == 0)
+        {
+            return reservoirs[0];
+        }
+
+        reservoirs[1] = kept[kept.size() / 2 + pixel];
+
+        if(!is_reusable(reservoirs[0], reservoirs[1], scene.settings.camera.origin.components))
+        {
+            return reservoirs[0];
+        }
+
+        reservoirs[1].confidence = std::min(reservoirs[1].confidence, temporal_confidence_cap * reservoirs[0].confidence);
+
+        return combine_reservoirs(scene, reservoirs, 2, u);
+    }
+
+    static reservoir_t reuse_spatial_reservoirs(
+                                                 const scene_t& scene,
+                                                 const sampler_t& sampler,
+                                                 const darray_t<reservoir_t>& kept,
+                                                 int32_t x,
+                                                 int32_t y,
+                                                 int32_t width,
+                                                 int32_t height,
+                                                 uint32_t pixel_sample
+                                               )
+    {
+        array_t<reservoir_t, max_reused_reservoirs> reservoirs;
+        reservoirs[0] = kept[size_t(y) * width + x];
+
+        if(reservoirs[0].confidence <= 0.0f)
+        {
+            return reservoirs[0];
+        }
+
+        vec3_t camera_origin = scene.settings.camera.origin.components;
+
+        array_t<pair_t<int32_t, int32_t>, max_reused_reservoirs> reused;
+        reused[0] = {x, y};
+        uint32_t count = 1;
+
+        for(uint32_t j = 0; j < spatial_neighbors; ++j)
+        {
+            auto u = sample_2d(sampler, bounce_dimension(0, dimension_neighbor), pixel_sample * spatial_neighbors + j);
+            auto radius = spatial_radius_scale * width * std::sqrt(u.x);
+            auto angle = 2.0f * pi * u.y;
+
+            pair_t<int32_t, int32_t> neighbor =
+            {
+                x + int32_t(std::round(radius * std::cos(angle))),
+                y + int32_t(std::round(radius * std::sin(angle)))
+            };
+
+            if(neighbor.first < 0 || neighbor.second < 0 || neighbor.first >= width || neighbor.second >= height)
+            {
+                continue;
+            }
+
+            auto is_taken = std::find(reused.begin(), reused.begin() + count, neighbor) != reused.begin() + count;
+            auto& other = kept[size_t(neighbor.second) * width + neighbor.first];
+
+            if(!is_taken && is_reusable(reservoirs[0], other, camera_origin))
+            {
+                reused[count] = neighbor;
+                reservoirs[count++] = other;
+            }
+        }
+
+        auto u = sample_2d(sampler, bounce_dimension(0, dimension_resampling), pixel_sample).y;
+
+        return combine_reservoirs(scene, reservoirs, count, u);
+    }
+
+    static vec3_t resampled_lighting(
+                                      const scene_t& scene,
+                                      const vec3_t& intersection_point,
+                                      const vec3_t& out_dir,
+                                      const intersection_t& intersection,
+                                      const reservoir_t& reservoir
+                                    )
+    {
+        if(reservoir.weight <= 0.0f)
+        {
+            return vec3_t();
+        }
+
+        auto& light = scene.lights[reservoir.light];
+        auto rect = get_rect(light);
+
+        ray_t shadow_ray;
+        shadow_ray.origin = reservoir.light_point;
+        auto shadow_ray_vector = intersection_point - reservoir.light_point;
+        shadow_ray.direction = normalize(shadow_ray_vector);
+
+        auto shadow = intersect_geometry(scene, shadow_ray);
+
+        auto light_distance = length(shadow_ray_vector);
+
+        if(std::abs(shadow.t - light_distance) >= bias)
+        {
+            return vec3_t();
+        }
+
+        auto in_dir = -shadow_ray.direction;
+        auto cos_light = dot(shadow_ray.direction, rect.normal);
+
+        return shade(
+                      scene,
+                      out_dir,
+                      in_dir,
+                      intersection,
+                      get_radiance(light, rect) * (cos_light * reservoir.weight / (light_distance * light_distance))
+                    );
+    }
+
+    static vec3_t environment_lighting(
+                                        const scene_t& scene,
+                                        const vec3_t& intersection_point,
+                                        const vec3_t& out_dir,
+                                        const intersection_t& intersection,
+                                        uint32_t samples_count,
+                                        bool_t brdf_sampled,
+                                        const sampler_t& sampler,
+                                        uint32_t bounce,
+                                        uint32_t pixel_sample
+                                      )
+    {
+        vec3_t output_color;
+
+        for(uint32_t j = 0; j < samples_count; ++j)
+        {
+            auto index = pixel_sample * samples_count + j;
+
+            float_t environment_sample_pdf;
+            auto in_dir = sample_environment(
+                                              scene,
+                                              sample_2d(sampler, bounce_dimension(bounce, dimension_environment), index),
+                                              environment_sample_pdf
+                                            );
+
+            if(environment_sample_pdf <= 0.0f || dot(in_dir, intersection.normal) <= 0.0f)
+            {
+                continue;
+            }
+
+            ray_t shadow_ray;
+            shadow_ray.origin = intersection_point;
+            shadow_ray.direction = in_dir;
+
+            if(intersect_geometry(scene, shadow_ray).t != infinity)
+            {
+                continue;
+            }
+
+            auto weight = brdf_sampled ?
+                          power_heuristic(samples_count, environment_sample_pdf, 1.0f, brdf_pdf(scene, out_dir, in_dir, intersection)) :
+                          1.0f;
+
+            output_color += shade(
+                                   scene,
+                                   out_dir,
+                                   in_dir,
+                                   intersection,
+                                   get_environment_radiance(scene, in_dir) * (weight / (samples_count * environment_sample_pdf))
+                                 );
+        }
+
+        return output_color;
+    }
+
+    static vec3_t light_hits(
+                              const scene_t& scene,
+                              const ray_t& ray,
+                              float_t t_max,
+                              const vec3_t& normal,
+                              uint32_t samples_count,
+                              float_t brdf_sample_pdf
+                            )
+    {
+        vec3_t output_color;
+        auto inv_direction = 1.0f / ray.direction;
+
+        if(scene.lights.empty())
+        {
+            return output_color;
+        }
+
+        uint32_t stack[32];
+        uint32_t stack_size = 0;
+        uint32_t node_index = 0;
+
+        while(true)
+        {
+            auto& node = scene.light_bvh[node_index];
+
+            if(intersect_bounds(ray, inv_direction, node.bounds_min.components, node.bounds_max.components, t_max))
+            {
+                if(!node.is_leaf)
+                {
+                    stack[stack_size++] = node.child;
+                    node_index = node_index + 1;
+                    continue;
+                }
+
+                auto& light = scene.lights[node.child];
+                auto rect = get_rect(light);
+
+                float_t t;
+                auto t_end = rect.triangle ? t_max + bias : t_max;
+
+                if(dot(ray.direction, rect.normal) < 0.0f && intersect_rect(rect, ray, t) && t < t_end)
+                {
+                    auto spherical_rect = get_spherical_rect(rect, ray.origin);
+                    auto light_pdf = select_light_pdf(scene, ray.origin, normal, node.child) *
+                                     rect_pdf(rect, spherical_rect, ray.origin + t * ray.direction);
+
+                    output_color += get_radiance(light, rect) *
+                                    power_heuristic(1.0f, brdf_sample_pdf, samples_count, light_pdf);
+                }
+            }
+
+            if(stack_size == 0)
+            {
+                break;
+            }
+
+            node_index = stack[--stack_size];
+        }
+
+        return output_color;
+    }
+
+    static vec3_t raytrace(
+                            const scene_t& scene,
+                            ray_t ray,
+                            intersection_t intersection,
+                            reservoir_t reservoir,
+                            const sampler_t& sampler,
+                            uint32_t pixel_sample
+                          )
+    {
+        auto light_samples = scene.settings.light_samples;
+        auto max_bounces = std::min(scene.settings.max_reflection_bounces, recursion_limit);
+        auto light_resampling = scene.settings.light_resampling;
+        auto resampled = light_resampling != light_resampling_t::none;
+
+        vec3_t output_color;
+        vec3_t throughput = 1.0f;
+
+        for(uint32_t bounce = 0; bounce <= max_bounces; ++bounce)
+        {
+            if(intersection.t == infinity)
+            {
+                if(bounce == 0 && has_environment(scene))
+                {
+                    output_color += get_environment_radiance(scene, ray.direction);
+                }
+
+                break;
+            }
+
+            auto intersection_point = ray.origin + intersection.t * ray.direction;
+            auto out_dir = -ray.direction;
+
+            auto primary = bounce == 0;
+            auto samples_count = primary ? light_samples : 1;
+            auto brdf_sampled = bounce < max_bounces && dot(out_dir, intersection.normal) > 0.0f;
+
+            if(primary && dot(out_dir, intersection.normal) > 0.0f)
+            {
+                output_color += vec3_t(get_material(scene, intersection.material_id).emission.components);
+            }
+
+            if(primary && resampled)
+            {
+                if(light_resampling == light_resampling_t::ris)
+                {
+                    auto u = sample_2d(sampler, bounce_dimension(0, dimension_resampling), pixel_sample).x;
+
+                    reservoir = sample_light_candidates(
+                                                         scene,
+                                                         intersection_point,
+                                                         out_dir,
+                                                         intersection,
+                                                         light_samples,
+                                                         sampler,
+                                                         pixel_sample,
+                                                         u
+                                                       );
+                }
+
+                output_color += throughput * resampled_lighting(scene, intersection_point, out_dir, intersection, reservoir);
+            }
+            else
+            {
+                output_color += throughput * direct_lighting(
+                                                              scene,
+                                                              intersection_point,
+                                                              out_dir,
+                                                              intersection,
+                                                              samples_count,
+                                                              brdf_sampled,
+                                                              sampler,
+                                                              bounce,
+                                                              pixel_sample
+                                                            );
+            }
+
+            if(has_environment(scene))
+            {
+                output_color += throughput * environment_lighting(
+                                                                   scene,
+                                                                   intersection_point,
+                                                                   out_dir,
+                                                                   intersection,
+                                                                   samples_count,
+                                                                   brdf_sampled,
+                                                                   sampler,
+                                                                   bounce,
+                                                                   pixel_sample
+                                                                 );
+            }
+
+            if(!brdf_sampled)
+            {
+                break;
+            }
+
+            auto u_lobe_and_roulette = sample_2d(sampler, bounce_dimension(bounce, dimension_lobe_and_roulette), pixel_sample);
+            auto u = sample_2d(sampler, bounce_dimension(bounce, dimension_brdf), pixel_sample);
+
+            vec3_t in_dir;
+            auto pdf = sample_brdf(scene, out_dir, intersection, u_lobe_and_roulette.x, u, in_dir);
+
+            if(pdf <= 0.0f)
+            {
+                break;
+            }
+
+            throughput *= brdf(scene, out_dir, in_dir, intersection) * dot(in_dir, intersection.normal) / pdf;
+
+            ray.origin = intersection_point;
+            ray.direction = in_dir;
+
+            auto normal = intersection.normal;
+            intersection = intersect_geometry(scene, ray);
+
+            if(!primary || !resampled)
+            {
+                output_color += throughput * light_hits(scene, ray, intersection.t, normal, samples_count, pdf);
+            }
+
+            if(intersection.t == infinity && has_environment(scene))
+            {
+                output_color += throughput * get_environment_radiance(scene, ray.direction) *
+                                power_heuristic(1.0f, pdf, samples_count, environment_pdf(scene, ray.direction));
+            }
+
+            if(bounce >= russian_roulette_bounce)
+            {
+                auto survival = std::min(max_component(throughput), max_survival_probability);
+
+                if(u_lobe_and_roulette.y >= survival)
+                {
+                    break;
+                }
+
+                throughput /= survival;
+            }
+        }
+
+        return output_color;
+    }
+
+
+    // Running mean of the samples of a pixel and the sum of the squared
+    // differences of their luminance from it, Welford 1962.
+    struct pixel_estimate_t
+    {
+        vec3_t mean;
+        float_t m2 = 0.0f;
+        uint32_t samples_count = 0;
+    };
+
+    static ray_t get_primary_ray(
+                                  const scene_t& scene,
+                                  const image_t& image,
+                                  uint32_t x,
+                                  uint32_t y,
+                                  const sampler_t& sampler,
+                                  uint32_t pixel_sample
+                                )
+    {
+        auto& camera = scene.settings.camera;
+
+        vec3_t front = camera.front.components;
+        vec3_t left = camera.left.components;
+        vec3_t up = camera.up.components;
+        vec3_t origin = camera.origin.components;
+
+        auto fov_scale = 1.0f / std::tan(camera.field_of_view * (pi / 180.0f) / 2.0f);
+
+        vec2_t image_scale = {1.0f / image.width, 1.0f / image.height};
+        vec2_t camera_scale = {fov_scale * camera.aspect_ratio, fov_scale};
+
+        vec2_t raster_coords = {x * image_scale.x, y * image_scale.y};
+
+        auto bias = sample_2d(sampler, dimension_pixel, pixel_sample);
+        vec2_t biased_raster_coords =
+        {
+            raster_coords.x + bias.x * image_scale.x,
+            raster_coords.y + bias.y * image_scale.y
+        };
+        vec2_t screen_coords =
+        {
+            (2.0f * biased_raster_coords.x - 1.0f) * camera_scale.x,
+            (2.0f * biased_raster_coords.y - 1.0f) * -camera_scale.y
+        };
+
+        ray_t ray;
+
+        ray.direction = normalize(
+                                   front +
+                                   left * screen_coords.x +
+                                   up * screen_coords.y
+                                 );
+
+        ray.origin = origin + camera.near * ray.direction;
+
+        return ray;
+    }
+
+    static void add_sample(pixel_estimate_t& estimate, const vec3_t& color)
+    {
+        estimate.samples_count++;
+        auto delta = color - estimate.mean;
+        estimate.mean += delta / float_t(estimate.samples_count);
+        estimate.m2 += dot(delta, luminance) * dot(color - estimate.mean, luminance);
+    }
+
+    static void render_samples(
+                                const scene_t& scene,
+                                const image_t& image,
+                                uint32_t x,
+                                uint32_t y,
+                                uint32_t end,
+                                pixel_estimate_t& estimate
+                              )
+    {
+        auto sampler = make_sampler(x, y, scene.settings.sample_pattern);
+
+        for(auto pixel_sample = estimate.samples_count; pixel_sample < end; ++pixel_sample)
+        {
+            auto ray = get_primary_ray(scene, image, x, y, sampler, pixel_sample);
+
+            add_sample(estimate, raytrace(scene, ray, intersect_geometry(scene, ray), reservoir_t(), sampler, pixel_sample));
+        }
+    }
+
+    // The two passes of a sample of spatiotemporal resampling, each over all
+    // the pixels before the next. The reservoirs hold the candidates of the
+    // pixels first, the reservoirs kept after the reuse follow.
+    static void keep_candidates(
+                                 const scene_t& scene,
+                                 const image_t& image,
+                                 uint32_t x,
+                                 uint32_t y,
+                                 uint32_t pixel_sample,
+                                 darray_t<reservoir_t>& reservoirs
+                               )
+    {
+        auto sampler = make_sampler(x, y, scene.settings.sample_pattern);
+        auto ray = get_primary_ray(scene, image, x, y, sampler, pixel_sample);
+        auto pixel = size_t(y) * image.width + x;
+
+        reservoirs[pixel] = sample_temporal_reservoir(scene, ray, sampler, reservoirs, pixel, pixel_sample);
+    }
+
+    static void render_resampled_sample(
+                                         const scene_t& scene,
+                                         const image_t& image,
+                                         uint32_t x,
+                                         uint32_t y,
+                                         darray_t<reservoir_t>& reservoirs,
+                                         pixel_estimate_t& estimate
+                                       )
+    {
+        auto pixel_sample = estimate.samples_count;
+        auto sampler = make_sampler(x, y, scene.settings.sample_pattern);
+        auto ray = get_primary_ray(scene, image, x, y, sampler, pixel_sample);
+
+        auto reservoir = reuse_spatial_reservoirs(scene, sampler, reservoirs, x, y, image.width, image.height, pixel_sample);
+        reservoirs[image.pixels.size() + size_t(y) * image.width + x] = reservoir;
+
+        intersection_t intersection;
+        intersection.normal = reservoir.surface_normal;
+        intersection.material_id = reservoir.material_id;
+        intersection.t = reservoir.confidence > 0.0f ?
+                         dot(reservoir.surface_point - ray.origin, ray.direction) :
+                         infinity;
+
+        add_sample(estimate, raytrace(scene, ray, intersection, reservoir, sampler, pixel_sample));
+    }
+
+    // Standard error of the mean relative to it. Pixels with too few samples
+    // to tell count as not converged.
+    static float_t get_relative_error(const pixel_estimate_t& estimate)
+    {
+        if(estimate.samples_count < adaptive_min_samples)
+        {
+            return infinity;
+        }
+
+        if(estimate.m2 <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        auto n = float_t(estimate.samples_count);
+        auto standard_error = std::sqrt(estimate.m2 / (n * (n - 1.0f)));
+        auto mean = dot(estimate.mean, luminance);
+
+        return mean > 0.0f ? standard_error / mean : infinity;
+    }
+
+
+    void render(const scene_t& scene, image_t& image, const render_desc_t& desc)
+    {
+        auto& settings = scene.settings;
+
+        image.width = desc.width ? desc.width : settings.resolution_x;
+        image.height = desc.height ? desc.height : settings.resolution_y;
+        image.pixels.assign(size_t(image.width) * image.height, vec3_t());
+
+        auto samples_per_pixel = desc.samples_per_pixel ? desc.samples_per_pixel : settings.samples_per_pixel;
+        auto samples_per_batch = settings.samples_per_batch ? settings.samples_per_batch : samples_per_pixel;
+
+        auto tiles_x = (image.width + tile_size - 1) / tile_size;
+        auto tiles_y = (image.height + tile_size - 1) / tile_size;
+
+        darray_t<pixel_estimate_t> estimates(image.pixels.size());
+        darray_t<uint32_t> active_tiles(tiles_x * tiles_y);
+
+        for(uint32_t i = 0; i < active_tiles.size(); ++i)
+        {
+            active_tiles[i] = i;
+        }
+
+        auto spatiotemporal = settings.light_resampling == light_resampling_t::spatiotemporal;
+        darray_t<reservoir_t> reservoirs(spatiotemporal ? 2 * image.pixels.size() : 0);
+
+        auto for_each_tile_pixel = [&](uint32_t tile, auto&& visit)
+        {
+            auto tile_x = tile % tiles_x;
+            auto tile_y = tile / tiles_x;
+
+            for(auto y = tile_y * tile_size; y < std::min((tile_y + 1) * tile_size, image.height); ++y)
+            {
+                for(auto x = tile_x * tile_size; x < std::min((tile_x + 1) * tile_size, image.width); ++x)
+                {
+                    visit(x, y, estimates[size_t(y) * image.width + x]);
+                }
+            }
+        };
+
+        // The pixels of the active tiles, the tiles in parallel.
+        auto for_each_pixel = [&](auto&& visit)
+        {
+            thread_pool_t::get_global().parallel_for(active_tiles.size(), [&](size_t i)
+            {
+                for_each_tile_pixel(active_tiles[i], visit);
+            });
+        };
+
+        // Tiles take a batch at a time and stop once all their pixels
+        // converged, so the samples go where the noise is.
+        for(uint32_t first = 0; first < samples_per_pixel && !active_tiles.empty(); first += samples_per_batch)
+        {
+            auto end = std::min(first + samples_per_batch, samples_per_pixel);
+
+            if(spatiotemporal)
+            {
+                for(auto pixel_sample = first; pixel_sample < end; ++pixel_sample)
+                {
+                    for_each_pixel([&](uint32_t x, uint32_t y, pixel_estimate_t&)
+                    {
+                        keep_candidates(scene, image, x, y, pixel_sample, reservoirs);
+                    });
+
+                    for_each_pixel([&](uint32_t x, uint32_t y, pixel_estimate_t& estimate)
+                    {
+                        render_resampled_sample(scene, image, x, y, reservoirs, estimate);
+                    });
+                }
+            }
+            else
+            {
+                for_each_pixel([&](uint32_t x, uint32_t y, pixel_estimate_t& estimate)
+                {
+                    render_samples(scene, image, x, y, end, estimate);
+                });
+            }
+
+            darray_t<uint8_t> converged(active_tiles.size());
+
+            for(size_t i = 0; i < active_tiles.size(); ++i)
+            {
+                auto tile_error = 0.0f;
+
+                for_each_tile_pixel(active_tiles[i], [&](uint32_t, uint32_t, const pixel_estimate_t& estimate)
+                {
+                    tile_error = std::max(tile_error, get_relative_error(estimate));
+                });
+
+                converged[i] = tile_error <= settings.adaptive_threshold;
+            }
+
+            size_t kept = 0;
+
+            for(size_t i = 0; i < active_tiles.size(); ++i)
+            {
+                if(!converged[i])
+                {
+                    active_tiles[kept++] = active_tiles[i];
+                }
+            }
+
+            active_tiles.resize(kept);
+        }
+
+        image.samples_count = 0;
+
+        for(size_t i = 0; i < estimates.size(); ++i)
+        {
+            image.pixels[i] = estimates[i].mean;
+            image.samples_count += estimates[i].samples_count;
+        }
+    }
+
+
+    error_t save_pfm(const string_t& path, const image_t& image)
+    {
+        auto file = fopen(path.c_str(), "wb");
+
+        if(file == nullptr)
+        {
+            return error_t::image_export_fail;
+        }
+
+        // A negative scale marks little endian data, the rows go from the
+        // bottom.
+        auto success = fprintf(file, "PF\n%u %u\n-1.0\n", image.width, image.height) > 0;
+
+        for(auto y = image.height; success && y-- > 0;)
+        {
+            auto row = &image.pixels[size_t(y) * image.width];
+            success = fwrite(row, sizeof(vec3_t), image.width, file) == image.width;
+        }
+
+        success = (fclose(file) == 0) && success;
+
+        return success ? error_t::success : error_t::image_export_fail;
+    }
+}
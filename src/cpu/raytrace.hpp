@@ -0,0 +1,56 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CPU_RAYTRACE_HPP
+#define CPU_RAYTRACE_HPP
+
+#include <error.hpp>
+#include <scene/scene.hpp>
+
+#include "glsl.hpp"
+
+namespace bpmap::cpu
+{
+    struct render_desc_t
+    {
+        // Zero takes the value from the scene settings.
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t samples_per_pixel = 0;
+    };
+
+    struct image_t
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // Rows from the top, like the render output.
+        darray_t<vec3_t> pixels;
+        // Taken over all the pixels, fewer than the pixels times the samples
+        // per pixel when tiles converged early.
+        uint64_t samples_count = 0;
+    };
+
+    // Renders the scene the way raytrace.comp does, pixel for pixel, the tiles
+    // in parallel. A reference for the shader which runs without a GPU.
+    void render(const scene_t& scene, image_t& image, const render_desc_t& desc = render_desc_t());
+
+    // Writes a little endian PFM.
+    error_t save_pfm(const string_t& path, const image_t& image);
+}
+
+#endif // CPU_RAYTRACE_HPP
@@ -158,9 +158,21 @@ namespace bpmap
             case error_t::lights_load_fail:
                 return "Failed to load lights in the scene!";
 
+            case error_t::environment_load_fail:
+                return "Failed to load the environment of the scene!";
+
+            case error_t::scene_export_fail:
+                return "Failed to export the scene!";
+
+            case error_t::binary_scene_load_fail:
+                return "Failed to load binary scene!";
+
             case error_t::render_output_setup_fail:
                 return "Failed to setup render output!";
 
+            case error_t::image_export_fail:
+                return "Failed to export image!";
+
             default:
                 return "Unknown error occured";
         }
@@ -54,7 +54,11 @@ namespace bpmap
         global_settings_load_fail,
         objects_load_fail,
         lights_load_fail,
+        environment_load_fail,
+        scene_export_fail,
+        binary_scene_load_fail,
         render_output_setup_fail,
+        image_export_fail,
     };
 
     string_t get_error_message(error_t e);
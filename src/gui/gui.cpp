@@ -23,6 +23,7 @@
 #define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
 #define NK_INCLUDE_FONT_BAKING
 #define NK_INCLUDE_DEFAULT_FONT
+#define NK_ZERO_COMMAND_MEMORY
 #define NK_IMPLEMENTATION
 
 #include "gui.hpp"
@@ -118,7 +119,23 @@ namespace bpmap
     }
 
 
-    void gui_t::emit_buffers(void* ibuffer, uint32_t ibuffer_size, void* vbuffer, uint32_t vbuffer_size)
+    static void* allocate_from_arena(nk_handle arena, void*, nk_size size)
+    {
+        return ((monotonic_arena_t*) arena.ptr)->allocate(size);
+    }
+
+    static void free_to_arena(nk_handle, void*)
+    {
+    }
+
+
+    void gui_t::emit_buffers(
+                              monotonic_arena_t& arena,
+                              void* ibuffer,
+                              uint32_t ibuffer_size,
+                              void* vbuffer,
+                              uint32_t vbuffer_size
+                            )
     {
         nk_convert_config config = {};
 
@@ -145,8 +162,15 @@ namespace bpmap
         nk_buffer indices;
         nk_buffer vertices;
 
+        nk_allocator allocator;
+        allocator.userdata = nk_handle_ptr(&arena);
+        allocator.alloc = allocate_from_arena;
+        allocator.free = free_to_arena;
+
+        // Frees the default buffer of the constructor, later buffers are in
+        // the arena of an earlier frame and the free does nothing.
         nk_buffer_free(&commands);
-        nk_buffer_init_default(&commands);
+        nk_buffer_init(&commands, &allocator, NK_BUFFER_DEFAULT_INITIAL_SIZE);
 
         nk_buffer_init_fixed(&vertices,vbuffer, vbuffer_size);
         nk_buffer_init_fixed(&indices,ibuffer, ibuffer_size);
@@ -193,10 +217,10 @@ namespace bpmap
         return data;
     }
 
-    darray_t<draw_call_t> gui_t::emit_draw_calls()
+    arena_array_t<draw_call_t> gui_t::emit_draw_calls(monotonic_arena_t& arena)
     {
         static constexpr uint32_t init_calls_size = 1 << 12;
-        darray_t<draw_call_t> calls;
+        arena_array_t<draw_call_t> calls(arena);
         calls.reserve(init_calls_size);
 
         auto offset = 0;
@@ -221,6 +245,36 @@ namespace bpmap
 
 
 
+    void gui_t::hash_commands()
+    {
+        // FNV-1a, the command memory is zeroed by nuklear before each command
+        // is written so padding doesn't change the hash.
+        static constexpr uint64_t fnv_offset = 0xcbf29ce484222325;
+        static constexpr uint64_t fnv_prime = 0x100000001b3;
+
+        uint64_t hash = fnv_offset;
+
+        auto hash_bytes = [&hash](const void* data, size_t size)
+        {
+            auto bytes = (const uint8_t*) data;
+
+            for(size_t i = 0; i < size; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= fnv_prime;
+            }
+        };
+
+        // The projection depends on the window size.
+        uint64_t extent[] = {window->get_width(), window->get_height()};
+        hash_bytes(extent, sizeof(extent));
+
+        hash_bytes(context.memory.memory.ptr, context.memory.allocated);
+
+        commands_hash = hash;
+    }
+
+
     void gui_t::run()
     {
         nk_clear(&context);
@@ -243,5 +297,7 @@ namespace bpmap
         }
 
         nk_end(&context);
+
+        hash_commands();
     }
 }
@@ -26,12 +26,14 @@
 #define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
 #define NK_INCLUDE_FONT_BAKING
 #define NK_INCLUDE_DEFAULT_FONT
+#define NK_ZERO_COMMAND_MEMORY
 
 #include <nuklear.h>
 #include <common.hpp>
 
 #include "window/window.hpp"
 #include "core/algebra.hpp"
+#include "core/arena.hpp"
 
 namespace bpmap
 {
@@ -76,6 +78,12 @@ namespace bpmap
 
         bool_t data_changed = false;
 
+        // Hash of the nuklear commands produced by the last run, used to
+        // detect frames that look exactly like the previous ones.
+        uint64_t commands_hash = 0;
+
+        void hash_commands();
+
     public:
         gui_t(window_t& window);
 
@@ -83,7 +91,10 @@ namespace bpmap
         int32_t get_font_width() const {return font_width;}
         const void* get_raw_font() const {return font_image;}
 
+        // The nuklear commands are allocated from the arena and stay valid as
+        // long as its memory, emit_draw_calls reads them.
         void emit_buffers(
+                           monotonic_arena_t& arena,
                            void* ibuffer,
                            uint32_t ibuffer_size,
                            void* vbuffer,
@@ -94,12 +105,13 @@ namespace bpmap
 
         gui_data_t get_gui_data();
 
-        darray_t<draw_call_t> emit_draw_calls();
+        arena_array_t<draw_call_t> emit_draw_calls(monotonic_arena_t& arena);
 
         size_t get_width() const {return window->get_width();}
         size_t get_height() const {return window->get_height();}
 
         bool_t gui_data_changed() {return data_changed;}
+        uint64_t get_commands_hash() const {return commands_hash;}
 
         void get_input();
         void run();
@@ -16,15 +16,114 @@
 // along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
 
 
+#include <cstdlib>
+
 #include "application.hpp"
+#include "core/slot_allocator_benchmark.hpp"
+#include "cpu/raytrace.hpp"
+#include "scene/asset_cache.hpp"
+#include "scene/scene_benchmark.hpp"
+#include "scene/scene_loader.hpp"
+
+// Renders the scene with the CPU mirror of the shaders, no window or GPU.
+static int cpu_render(const bpmap::string_t& scene_path, const bpmap::string_t& image_path)
+{
+    bpmap::scene_t scene;
+
+    auto status = bpmap::load_scene(scene_path, scene);
+
+    if(status == bpmap::error_t::success)
+    {
+        bpmap::cpu::image_t image;
+        bpmap::cpu::render(scene, image);
+
+        status = bpmap::cpu::save_pfm(image_path, image);
+    }
+
+    if(status != bpmap::error_t::success)
+    {
+        bpmap::log_error(bpmap::get_error_message(status));
+        return 1;
+    }
+
+    return 0;
+}
 
-int main()
+int main(int argc, char** argv)
 {
     constexpr const char* app_name = "bpmap";
     constexpr const uint32_t res_x = 1280;
     constexpr const uint32_t res_y = 720;
 
-    bpmap::application_t app(res_x, res_y, app_name);
+    auto loop_mode = bpmap::loop_mode_t::interactive;
+    bpmap::string_t scene_path = "scene.bpmap";
+    bpmap::string_t export_path;
+    bpmap::string_t cpu_render_path;
+    auto stream = false;
+
+    for(auto i = 1; i < argc; ++i)
+    {
+        bpmap::string_view_t arg = argv[i];
+
+        if(arg == "--idle")
+        {
+            loop_mode = bpmap::loop_mode_t::idle;
+        }
+        else if(arg == "--interactive")
+        {
+            loop_mode = bpmap::loop_mode_t::interactive;
+        }
+        else if(arg == "--max-throughput")
+        {
+            loop_mode = bpmap::loop_mode_t::max_throughput;
+        }
+        else if(arg == "--scene" && i + 1 < argc)
+        {
+            scene_path = argv[++i];
+        }
+        else if(arg == "--export-scene" && i + 1 < argc)
+        {
+            export_path = argv[++i];
+        }
+        else if(arg == "--stream-scene")
+        {
+            stream = true;
+        }
+        else if(arg == "--asset-cache" && i + 1 < argc)
+        {
+            bpmap::asset_cache_t::get_global().set_directory(argv[++i]);
+        }
+        else if(arg == "--no-asset-cache")
+        {
+            bpmap::asset_cache_t::get_global().set_directory("");
+        }
+        else if(arg == "--cpu-render" && i + 1 < argc)
+        {
+            cpu_render_path = argv[++i];
+        }
+        else if(arg == "--benchmark-scene-description" && i + 2 < argc)
+        {
+            auto objects = strtoull(argv[i + 1], nullptr, 10);
+            auto lights = strtoull(argv[i + 2], nullptr, 10);
+            auto status = bpmap::benchmark_scene_description(objects, lights);
+
+            return (status == bpmap::error_t::success) ? 0 : 1;
+        }
+        else if(arg == "--benchmark-slot-allocator" && i + 2 < argc)
+        {
+            auto threads = strtoull(argv[i + 1], nullptr, 10);
+            auto rounds = strtoull(argv[i + 2], nullptr, 10);
+
+            return bpmap::benchmark_slot_allocator(threads, rounds) ? 0 : 1;
+        }
+    }
+
+    if(!cpu_render_path.empty())
+    {
+        return cpu_render(scene_path, cpu_render_path);
+    }
+
+    bpmap::application_t app(res_x, res_y, app_name, scene_path, loop_mode, export_path, stream);
     app.loop();
 
     return 0;
@@ -0,0 +1,307 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstdlib>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define BPMAP_HAS_FLOCK
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <unistd.h>
+#endif
+
+#include <hash.hpp>
+#include <io.hpp>
+
+#include "asset_cache.hpp"
+
+namespace bpmap
+{
+    // Part of every key, bump it when load_obj gives different results.
+    static constexpr uint64_t asset_cache_version = 2;
+
+    static constexpr const char_t* asset_cache_variable = "BPMAP_ASSET_CACHE";
+
+
+    // Holds an exclusive lock on a file while alive.
+    class file_lock_t
+    {
+        int_t fd = -1;
+
+    public:
+        explicit file_lock_t(const string_t& path)
+        {
+#if defined(BPMAP_HAS_FLOCK)
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+
+            if(fd >= 0 && flock(fd, LOCK_EX) != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+#endif
+        }
+
+        file_lock_t(const file_lock_t&) = delete;
+        file_lock_t& operator=(const file_lock_t&) = delete;
+
+        bool_t is_locked() const { return fd >= 0; }
+
+        ~file_lock_t()
+        {
+#if defined(BPMAP_HAS_FLOCK)
+            // Closing releases the lock.
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+#endif
+        }
+    };
+
+
+    asset_cache_t::asset_cache_t()
+    {
+        if(auto path = getenv(asset_cache_variable))
+        {
+            directory = path;
+        }
+        else if(auto path = getenv("XDG_CACHE_HOME"); path && *path)
+        {
+            directory = string_t(path) + "/bpmap/assets";
+        }
+        else if(auto path = getenv("HOME"); path && *path)
+        {
+            directory = string_t(path) + "/.cache/bpmap/assets";
+        }
+    }
+
+
+    asset_cache_t& asset_cache_t::get_global()
+    {
+        static asset_cache_t cache;
+        return cache;
+    }
+
+
+    bool_t asset_cache_t::is_enabled() const
+    {
+#if defined(BPMAP_HAS_FLOCK)
+        return !directory.empty();
+#else
+        return false;
+#endif
+    }
+
+
+    string_t asset_cache_t::get_entry_path(uint64_t key) const
+    {
+        char_t name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+
+        return directory + "/" + name + binary_scene_extension;
+    }
+
+
+    // Material libraries are part of the key since the same OBJ text names
+    // different materials next to different MTL files. Every library named
+    // by an mtllib line counts, the ones which can't be read by name.
+    static uint64_t hash_material_libraries(string_view_t text, uint64_t hash)
+    {
+        static constexpr string_view_t command = "mtllib";
+
+        for(auto at = text.find(command); at != string_view_t::npos; at = text.find(command, at + 1))
+        {
+            auto is_command = (at == 0 || text[at - 1] == '\n' || text[at - 1] == ' ' || text[at - 1] == '\t') &&
+                              at + command.size() < text.size() &&
+                              (text[at + command.size()] == ' ' || text[at + command.size()] == '\t');
+
+            if(!is_command)
+            {
+                continue;
+            }
+
+            auto line = text.substr(at + command.size() + 1);
+            line = line.substr(0, line.find_first_of("\r\n"));
+
+            while(!line.empty())
+            {
+                auto separator = line.find(' ');
+                auto library = line.substr(0, separator);
+
+                mapped_file_t file;
+
+                if(!library.empty() && file.open(string_t(library)))
+                {
+                    hash = hash_combine(hash, hash_bytes(file.get_data(), file.get_size()));
+                }
+                else
+                {
+                    hash = hash_combine(hash, hash_bytes(library.data(), library.size(), ~0ull));
+                }
+
+                line.remove_prefix(separator == string_view_t::npos ? line.size() : separator + 1);
+            }
+        }
+
+        return hash;
+    }
+
+
+    bool_t asset_cache_t::get_key(const string_t& path, uint64_t& key) const
+    {
+        mapped_file_t file;
+
+        if(!file.open(path))
+        {
+            return false;
+        }
+
+        auto data = file.get_data();
+        auto size = file.get_size();
+
+        key = hash_bytes(data, size, asset_cache_version);
+        key = hash_material_libraries(string_view_t((const char_t*) data, size), key);
+
+        return true;
+    }
+
+
+    bool_t asset_cache_t::find(uint64_t key, cached_obj_t& obj) const
+    {
+        auto path = get_entry_path(key);
+
+        // Most lookups miss on a cold cache, which isn't worth a log.
+        if(!std::filesystem::exists(path) || map_binary_scene(path, obj.entry) != error_t::success)
+        {
+            return false;
+        }
+
+        auto& entry = obj.entry;
+        auto& sizes = obj.sizes;
+
+        obj.vertices = entry.get<point3d_t>(binary_scene_section_t::vertices, sizes.vertices);
+        obj.normals = entry.get<codirection3d_t>(binary_scene_section_t::normals, sizes.normals);
+        obj.texcoords = entry.get<point2d_t>(binary_scene_section_t::texcoords, sizes.texcoords);
+        obj.triangles = entry.get<triangle_t>(binary_scene_section_t::triangles, sizes.triangles);
+        obj.materials = entry.get<material_t>(binary_scene_section_t::materials, obj.materials_count);
+
+        // Entries of builds with other layouts are parsed and written again.
+        return obj.vertices && obj.normals && obj.texcoords && obj.triangles && obj.materials;
+    }
+
+
+    error_t asset_cache_t::store(uint64_t key, const obj_t& obj) const
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        darray_t<binary_scene_array_t> arrays =
+        {
+            {binary_scene_section_t::vertices, obj.vertices.data(), sizeof(point3d_t), obj.vertices.size()},
+            {binary_scene_section_t::normals, obj.normals.data(), sizeof(codirection3d_t), obj.normals.size()},
+            {binary_scene_section_t::texcoords, obj.texcoords.data(), sizeof(point2d_t), obj.texcoords.size()},
+            {binary_scene_section_t::triangles, obj.triangles.data(), sizeof(triangle_t), obj.triangles.size()},
+            {binary_scene_section_t::materials, obj.materials.data(), sizeof(material_t), obj.materials.size()}
+        };
+
+        auto path = get_entry_path(key);
+#if defined(BPMAP_HAS_FLOCK)
+        // Other keys of this process and this key in other processes don't
+        // collide, this key in this process is behind the lock.
+        auto temporary = path + "." + std::to_string(getpid()) + ".tmp";
+#else
+        auto temporary = path + ".tmp";
+#endif
+
+        auto status = write_binary_scene(temporary, arrays);
+
+        if(status == error_t::success)
+        {
+            std::filesystem::rename(temporary, path, error);
+            status = error ? error_t::scene_export_fail : error_t::success;
+        }
+
+        if(status != error_t::success)
+        {
+            std::filesystem::remove(temporary, error);
+        }
+
+        return status;
+    }
+
+
+    static void copy_cached_obj(const cached_obj_t& cached, obj_t& obj)
+    {
+        auto& sizes = cached.sizes;
+
+        obj.vertices.assign(cached.vertices, cached.vertices + sizes.vertices);
+        obj.normals.assign(cached.normals, cached.normals + sizes.normals);
+        obj.texcoords.assign(cached.texcoords, cached.texcoords + sizes.texcoords);
+        obj.triangles.assign(cached.triangles, cached.triangles + sizes.triangles);
+        obj.materials.assign(cached.materials, cached.materials + cached.materials_count);
+    }
+
+
+    error_t asset_cache_t::load_obj(const string_t& path, obj_t& obj) const
+    {
+        uint64_t key;
+
+        if(!is_enabled() || !get_key(path, key))
+        {
+            return bpmap::load_obj(path, obj);
+        }
+
+        cached_obj_t cached;
+
+        if(find(key, cached))
+        {
+            copy_cached_obj(cached, obj);
+            return error_t::success;
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        // Whoever gets the lock first parses, the rest find its entry after
+        // waiting for it.
+        file_lock_t lock(get_entry_path(key) + ".lock");
+
+        if(lock.is_locked() && find(key, cached))
+        {
+            copy_cached_obj(cached, obj);
+            return error_t::success;
+        }
+
+        auto status = bpmap::load_obj(path, obj);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        // The cache only saves time, failing to write it isn't an error.
+        if(store(key, obj) != error_t::success)
+        {
+            log_error("Failed to add ", path, " to the asset cache in ", directory);
+        }
+
+        return error_t::success;
+    }
+}
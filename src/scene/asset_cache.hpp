@@ -0,0 +1,88 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ASSET_CACHE_HPP
+#define ASSET_CACHE_HPP
+
+#include <common.hpp>
+#include <error.hpp>
+
+#include "binary_scene.hpp"
+#include "obj_parser.hpp"
+
+namespace bpmap
+{
+    // An OBJ read from the cache, the arrays point into the mapped entry.
+    // Indices are the same as load_obj gives.
+    struct cached_obj_t
+    {
+        mapped_binary_scene_t entry;
+
+        geometry_sizes_t sizes;
+        const point3d_t* vertices = nullptr;
+        const codirection3d_t* normals = nullptr;
+        const point2d_t* texcoords = nullptr;
+        const triangle_t* triangles = nullptr;
+
+        const material_t* materials = nullptr;
+        size_t materials_count = 0;
+    };
+
+    // Parsed OBJ files on disk, shared by all processes on the host. An
+    // entry is keyed by the contents of the OBJ and of its material
+    // libraries, so every scene which uses the same asset finds it no matter
+    // the path. Entries are binary scene files which are written by one
+    // process under a file lock and renamed into place, so readers never
+    // see partial ones.
+    class asset_cache_t
+    {
+        string_t directory;
+
+        string_t get_entry_path(uint64_t key) const;
+        error_t store(uint64_t key, const obj_t& obj) const;
+
+    public:
+        // Uses BPMAP_ASSET_CACHE, otherwise bpmap/assets in XDG_CACHE_HOME
+        // or ~/.cache.
+        asset_cache_t();
+
+        // Shared cache used by the loaders.
+        static asset_cache_t& get_global();
+
+        // An empty directory disables the cache. Not thread safe, meant to
+        // be called before any loading.
+        void set_directory(const string_t& path) { directory = path; }
+        const string_t& get_directory() const { return directory; }
+
+        // Also false where file locks aren't available.
+        bool_t is_enabled() const;
+
+        // False when the OBJ can't be read.
+        bool_t get_key(const string_t& path, uint64_t& key) const;
+
+        // Maps the entry of key, false when there is none.
+        bool_t find(uint64_t key, cached_obj_t& obj) const;
+
+        // Same as bpmap::load_obj, but reads the cache and adds the OBJ to
+        // it on a miss. Processes which miss on the same asset at once
+        // parse it only once.
+        error_t load_obj(const string_t& path, obj_t& obj) const;
+    };
+}
+
+#endif // ASSET_CACHE_HPP
@@ -0,0 +1,298 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstdio>
+#include <cstring>
+
+#include <io.hpp>
+
+#include "binary_scene.hpp"
+
+namespace bpmap
+{
+    template <typename S, typename F>
+    static void for_each_section(S& scene, F&& f)
+    {
+        f(binary_scene_section_t::vertices, scene.vertices);
+        f(binary_scene_section_t::normals, scene.normals);
+        f(binary_scene_section_t::texcoords, scene.texcoords);
+        f(binary_scene_section_t::triangles, scene.triangles);
+        f(binary_scene_section_t::materials, scene.materials);
+        f(binary_scene_section_t::lights, scene.lights);
+        f(binary_scene_section_t::light_aliases, scene.light_aliases);
+        f(binary_scene_section_t::light_bvh, scene.light_bvh);
+        f(binary_scene_section_t::light_trails, scene.light_trails);
+        f(binary_scene_section_t::environment, scene.environment);
+        f(binary_scene_section_t::environment_aliases, scene.environment_aliases);
+        f(binary_scene_section_t::objects, scene.objects);
+    }
+
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + binary_scene_alignment - 1) & ~(binary_scene_alignment - 1);
+    }
+
+
+    // Writes size bytes at offset, padding with zeroes from the current
+    // position.
+    static bool_t write_at(FILE* file, uint64_t& position, uint64_t offset, const void* data, size_t size)
+    {
+        static constexpr uint8_t zeroes[binary_scene_alignment] = {};
+
+        while(position < offset)
+        {
+            auto padding = std::min<uint64_t>(offset - position, sizeof(zeroes));
+
+            if(fwrite(zeroes, padding, 1, file) != 1)
+            {
+                return false;
+            }
+
+            position += padding;
+        }
+
+        if(size != 0 && fwrite(data, size, 1, file) != 1)
+        {
+            return false;
+        }
+
+        position += size;
+
+        return true;
+    }
+
+
+    error_t write_binary_scene(const string_t& path, const darray_t<binary_scene_array_t>& arrays)
+    {
+        darray_t<binary_scene_section_desc_t> sections;
+
+        auto offset = align(sizeof(binary_scene_header_t) + arrays.size() * sizeof(binary_scene_section_desc_t));
+
+        for(auto& array : arrays)
+        {
+            sections.push_back({array.type, array.element_size, offset, array.count});
+
+            offset = align(offset + array.element_size * array.count);
+        }
+
+        binary_scene_header_t header;
+        memcpy(header.magic, binary_scene_magic, sizeof(header.magic));
+        header.version = binary_scene_version;
+        header.sections_count = uint32_t(sections.size());
+        header.size = offset;
+
+        auto file = fopen(path.c_str(), "wb");
+
+        if(file == nullptr)
+        {
+            return error_t::scene_export_fail;
+        }
+
+        uint64_t position = 0;
+
+        auto success = write_at(file, position, 0, &header, sizeof(header)) &&
+                       write_at(file, position, position, sections.data(), sections.size() * sizeof(sections[0]));
+
+        for(size_t i = 0; success && i < sections.size(); ++i)
+        {
+            auto& section = sections[i];
+            success = write_at(file, position, section.offset, arrays[i].data, section.element_size * section.count);
+        }
+
+        success = success && write_at(file, position, header.size, nullptr, 0);
+        success = (fclose(file) == 0) && success;
+
+        return success ? error_t::success : error_t::scene_export_fail;
+    }
+
+
+    error_t export_binary_scene(const string_t& path, const scene_t& scene)
+    {
+        darray_t<binary_scene_array_t> arrays;
+
+        for_each_section(scene, [&](binary_scene_section_t type, const auto& array)
+        {
+            arrays.push_back({type, array.data(), sizeof(array[0]), array.size()});
+        });
+
+        arrays.push_back({binary_scene_section_t::settings, &scene.settings, sizeof(scene.settings), 1});
+
+        return write_binary_scene(path, arrays);
+    }
+
+
+    error_t map_binary_scene(const string_t& path, mapped_binary_scene_t& scene)
+    {
+        auto& file = scene.file;
+
+        if(!file.open(path))
+        {
+            return error_t::binary_scene_load_fail;
+        }
+
+        auto data = file.get_data();
+        auto size = file.get_size();
+
+        binary_scene_header_t header;
+
+        if(size < sizeof(header))
+        {
+            return error_t::binary_scene_load_fail;
+        }
+
+        memcpy(&header, data, sizeof(header));
+
+        if(memcmp(header.magic, binary_scene_magic, sizeof(header.magic)) != 0 || header.size != size)
+        {
+            log_error(path, " is not a valid binary scene");
+            return error_t::binary_scene_load_fail;
+        }
+
+        if(header.version != binary_scene_version)
+        {
+            log_error(path, " has version ", header.version, ", expected ", binary_scene_version);
+            return error_t::binary_scene_load_fail;
+        }
+
+        if(header.sections_count > (size - sizeof(header)) / sizeof(binary_scene_section_desc_t))
+        {
+            return error_t::binary_scene_load_fail;
+        }
+
+        auto& sections = scene.sections;
+        auto descs = (const binary_scene_section_desc_t*) (data + sizeof(header));
+
+        sections = {};
+
+        for(auto i = 0u; i < header.sections_count; ++i)
+        {
+            auto& section = descs[i];
+            auto type = size_t(section.type);
+
+            auto is_valid = type < sections.size() &&
+                            section.offset % binary_scene_alignment == 0 &&
+                            section.offset <= size &&
+                            section.count <= (size - section.offset) / std::max(section.element_size, 1u);
+
+            if(!is_valid)
+            {
+                return error_t::binary_scene_load_fail;
+            }
+
+            sections[type] = &section;
+        }
+
+        return error_t::success;
+    }
+
+
+    static bool_t is_geometry_section(binary_scene_section_t type)
+    {
+        return type == binary_scene_section_t::vertices ||
+               type == binary_scene_section_t::normals ||
+               type == binary_scene_section_t::texcoords ||
+               type == binary_scene_section_t::triangles;
+    }
+
+
+    error_t load_binary_scene(const string_t& path, scene_t& scene)
+    {
+        mapped_binary_scene_t mapped;
+
+        auto status = map_binary_scene(path, mapped);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        return read_binary_scene(path, mapped, scene, true);
+    }
+
+
+    error_t read_binary_scene(
+                               const string_t& path,
+                               const mapped_binary_scene_t& mapped,
+                               scene_t& scene,
+                               bool_t with_geometry
+                             )
+    {
+        auto success = true;
+
+        for_each_section(scene, [&](binary_scene_section_t type, auto& array)
+        {
+            using element_t = typename std::decay_t<decltype(array)>::value_type;
+
+            size_t count;
+            auto first = success ? mapped.get<element_t>(type, count) : nullptr;
+
+            if(first == nullptr)
+            {
+                success = false;
+                return;
+            }
+
+            if(with_geometry || !is_geometry_section(type))
+            {
+                array.assign(first, first + count);
+            }
+        });
+
+        size_t count = 0;
+        auto settings = success ? mapped.get<scene_settings_t>(binary_scene_section_t::settings, count) : nullptr;
+
+        if(settings == nullptr || count != 1)
+        {
+            log_error(path, " was written by an incompatible build, export it again");
+            return error_t::binary_scene_load_fail;
+        }
+
+        memcpy(&scene.settings, settings, sizeof(scene.settings));
+
+        return error_t::success;
+    }
+
+
+    error_t stream_binary_geometry(const mapped_binary_scene_t& mapped, const geometry_stream_t& stream)
+    {
+        geometry_sizes_t sizes;
+
+        auto vertices = mapped.get<point3d_t>(binary_scene_section_t::vertices, sizes.vertices);
+        auto normals = mapped.get<codirection3d_t>(binary_scene_section_t::normals, sizes.normals);
+        auto texcoords = mapped.get<point2d_t>(binary_scene_section_t::texcoords, sizes.texcoords);
+        auto triangles = mapped.get<triangle_t>(binary_scene_section_t::triangles, sizes.triangles);
+
+        auto status = stream.reserve(sizes);
+
+        auto write = [&stream, &status](geometry_array_t array, const void* data, size_t count)
+        {
+            if(status == error_t::success && count != 0)
+            {
+                status = stream.write(array, 0, data, count);
+            }
+        };
+
+        write(geometry_array_t::vertices, vertices, sizes.vertices);
+        write(geometry_array_t::normals, normals, sizes.normals);
+        write(geometry_array_t::texcoords, texcoords, sizes.texcoords);
+        write(geometry_array_t::triangles, triangles, sizes.triangles);
+
+        return status;
+    }
+}
@@ -0,0 +1,141 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef BINARY_SCENE_HPP
+#define BINARY_SCENE_HPP
+
+#include <common.hpp>
+#include <error.hpp>
+#include <io.hpp>
+
+#include "geometry_stream.hpp"
+#include "scene.hpp"
+
+namespace bpmap
+{
+    // A .bpscene file is a header, a table of sections and the sections
+    // themselves. Each section is a raw copy of the matching scene_t array
+    // in host byte order, so loading it is a single copy out of the mapping.
+    static constexpr const char_t* binary_scene_extension = ".bpscene";
+    static constexpr char_t binary_scene_magic[8] = {'B', 'P', 'S', 'C', 'E', 'N', 'E', '\0'};
+    static constexpr uint32_t binary_scene_version = 7;
+
+    // Sections start at offsets usable as storage buffer offsets on any
+    // device, so a buffer holding the whole file can bind them directly.
+    static constexpr uint64_t binary_scene_alignment = 256;
+
+    enum class binary_scene_section_t : uint32_t
+    {
+        vertices,
+        normals,
+        texcoords,
+        triangles,
+        materials,
+        lights,
+        objects,
+        settings,
+        light_aliases,
+        light_bvh,
+        light_trails,
+        environment,
+        environment_aliases,
+        count
+    };
+
+    struct binary_scene_header_t
+    {
+        char_t magic[8];
+        uint32_t version;
+        uint32_t sections_count;
+        uint64_t size;
+    };
+
+    struct binary_scene_section_desc_t
+    {
+        binary_scene_section_t type;
+        // Checked on load, a file written with different struct layouts is
+        // rejected instead of misread.
+        uint32_t element_size;
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    // One array of a binary scene file.
+    struct binary_scene_array_t
+    {
+        binary_scene_section_t type;
+        const void* data;
+        uint32_t element_size;
+        uint64_t count;
+    };
+
+    // A binary scene file mapped read only, missing sections stay null.
+    struct mapped_binary_scene_t
+    {
+        mapped_file_t file;
+        array_t<const binary_scene_section_desc_t*, size_t(binary_scene_section_t::count)> sections = {};
+
+        // Start of the section of type with elements of T, null when it is
+        // missing or was written with another layout of T.
+        template <typename T>
+        const T* get(binary_scene_section_t type, size_t& count) const;
+    };
+
+    // Writes the arrays in a binary scene file, a scene needs all sections
+    // but other users of the format may write only some.
+    error_t write_binary_scene(const string_t& path, const darray_t<binary_scene_array_t>& arrays);
+
+    // Validates the header and the section table, nothing is copied.
+    error_t map_binary_scene(const string_t& path, mapped_binary_scene_t& scene);
+
+    error_t export_binary_scene(const string_t& path, const scene_t& scene);
+    error_t load_binary_scene(const string_t& path, scene_t& scene);
+
+    // Copies the sections of a mapped scene file into scene, all but the
+    // geometry when with_geometry is false. The geometry sections are still
+    // validated.
+    error_t read_binary_scene(
+                               const string_t& path,
+                               const mapped_binary_scene_t& mapped,
+                               scene_t& scene,
+                               bool_t with_geometry
+                             );
+
+    // Writes the geometry sections of a mapped scene file into the stream
+    // straight from the mapping, after read_binary_scene accepted it.
+    error_t stream_binary_geometry(const mapped_binary_scene_t& mapped, const geometry_stream_t& stream);
+
+
+    template <typename T>
+    const T* mapped_binary_scene_t::get(binary_scene_section_t type, size_t& count) const
+    {
+        auto section = sections[size_t(type)];
+
+        if(section == nullptr || section->element_size != sizeof(T))
+        {
+            count = 0;
+            return nullptr;
+        }
+
+        count = section->count;
+
+        return (const T*) (file.get_data() + section->offset);
+    }
+}
+
+#endif // BINARY_SCENE_HPP
@@ -0,0 +1,122 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+#include <cstdlib>
+
+#include <io.hpp>
+#include <thread_pool.hpp>
+
+#define TINYEXR_IMPLEMENTATION
+#include <tinyexr.h>
+
+#include "environment.hpp"
+
+namespace bpmap
+{
+    static constexpr double pi = 3.14159265358979323846;
+
+    error_t load_environment(const string_t& path, scene_t& scene)
+    {
+        mapped_file_t file;
+
+        if(!file.open(path))
+        {
+            log_error("Can't open environment ", path);
+            return error_t::environment_load_fail;
+        }
+
+        float_t* rgba = nullptr;
+        int_t width = 0;
+        int_t height = 0;
+        const char_t* message = nullptr;
+
+        if(LoadEXRFromMemory(&rgba, &width, &height, file.get_data(), file.get_size(), &message) != TINYEXR_SUCCESS)
+        {
+            log_error("Can't read environment ", path, ": ", message ? message : "unknown error");
+            return error_t::environment_load_fail;
+        }
+
+        auto& environment = scene.environment;
+        environment.resize(size_t(width) * height);
+
+        thread_pool_t::get_global().parallel_for(height, [&](size_t y)
+        {
+            for(size_t x = 0; x < size_t(width); ++x)
+            {
+                auto i = y * width + x;
+                auto& texel = environment[i].components;
+
+                // Negative values are left by some filters, they would make
+                // negative light.
+                for(size_t c = 0; c < 3; ++c)
+                {
+                    texel[c] = std::isfinite(rgba[4 * i + c]) ? std::max(rgba[4 * i + c], 0.0f) : 0.0f;
+                }
+            }
+        });
+
+        free(rgba);
+
+        scene.settings.environment_width = width;
+        scene.settings.environment_height = height;
+
+        build_environment_aliases(scene);
+
+        return error_t::success;
+    }
+
+
+    void build_environment_aliases(scene_t& scene)
+    {
+        auto width = scene.settings.environment_width;
+        auto height = scene.settings.environment_height;
+
+        auto& aliases = scene.environment_aliases;
+        aliases.resize(height + size_t(width) * height);
+
+        if(width == 0 || height == 0)
+        {
+            return;
+        }
+
+        darray_t<float_t> row_weights(height);
+
+        thread_pool_t::get_global().parallel_for(height, [&](size_t y)
+        {
+            // Rows near the poles cover less of the sphere.
+            auto sin_theta = float_t(std::sin(pi * (y + 0.5) / height));
+
+            darray_t<float_t> weights(width);
+            double row_weight = 0.0;
+
+            for(uint32_t x = 0; x < width; ++x)
+            {
+                auto& texel = scene.environment[y * width + x].components;
+
+                weights[x] = (0.2126f * texel[0] + 0.7152f * texel[1] + 0.0722f * texel[2]) * sin_theta;
+                row_weight += weights[x];
+            }
+
+            row_weights[y] = float_t(row_weight);
+            build_aliases(weights.data(), width, aliases.data() + height + y * width);
+        });
+
+        build_aliases(row_weights.data(), height, aliases.data());
+    }
+}
@@ -0,0 +1,39 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include <common.hpp>
+#include <error.hpp>
+
+#include "scene.hpp"
+
+namespace bpmap
+{
+    // Reads the RGB of the EXR at path into the environment of the scene,
+    // sets its size in the settings and builds its sampling tables.
+    error_t load_environment(const string_t& path, scene_t& scene);
+
+    // Alias tables for picking texels by luminance times the sine of their
+    // polar angle, so directions come out in proportion to the light they
+    // bring. The rows are built in parallel.
+    void build_environment_aliases(scene_t& scene);
+}
+
+#endif // ENVIRONMENT_HPP
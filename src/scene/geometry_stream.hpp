@@ -0,0 +1,75 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef GEOMETRY_STREAM_HPP
+#define GEOMETRY_STREAM_HPP
+
+#include <functional>
+
+#include <common.hpp>
+#include <error.hpp>
+
+namespace bpmap
+{
+    enum class geometry_array_t
+    {
+        vertices,
+        normals,
+        texcoords,
+        triangles
+    };
+
+    struct geometry_sizes_t
+    {
+        size_t vertices = 0;
+        size_t normals = 0;
+        size_t texcoords = 0;
+        size_t triangles = 0;
+    };
+
+    // Where the geometry, the materials and the lights of the emissive
+    // triangles of one object are in the scene.
+    struct geometry_range_t
+    {
+        geometry_sizes_t first;
+        geometry_sizes_t sizes;
+        size_t first_material = 0;
+        size_t materials_count = 0;
+        size_t first_light = 0;
+        size_t lights_count = 0;
+    };
+
+    // Receives the geometry of a scene while it is parsed instead of the
+    // scene arrays, so it never has to be on the host all at once.
+    struct geometry_stream_t
+    {
+        // Called once with the final sizes before the first write.
+        std::function<error_t(const geometry_sizes_t& sizes)> reserve;
+
+        // Writes count elements starting at element first. Called from the
+        // threads of the global pool, in no particular order.
+        std::function<error_t(
+                               geometry_array_t array,
+                               size_t first,
+                               const void* data,
+                               size_t count
+                             )> write;
+    };
+}
+
+#endif // GEOMETRY_STREAM_HPP
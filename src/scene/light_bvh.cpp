@@ -0,0 +1,444 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "light_bvh.hpp"
+
+namespace bpmap
+{
+    using float3_t = array_t<float_t, 3>;
+
+    static constexpr float_t pi = 3.1415927410125732421875f;
+    static constexpr uint32_t bins_count = 12;
+    // Flat lights still get bounds with a volume, so rays can hit them.
+    static constexpr float_t bounds_padding = 0.0001f;
+
+
+    static float3_t add(const float3_t& a, const float3_t& b)
+    {
+        return {a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+    }
+
+    static float3_t subtract(const float3_t& a, const float3_t& b)
+    {
+        return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    }
+
+    static float3_t scale(const float3_t& a, float_t s)
+    {
+        return {a[0] * s, a[1] * s, a[2] * s};
+    }
+
+    static float_t dot(const float3_t& a, const float3_t& b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    static float3_t cross(const float3_t& a, const float3_t& b)
+    {
+        return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    static float3_t normalize(const float3_t& a)
+    {
+        return scale(a, 1.0f / std::sqrt(dot(a, a)));
+    }
+
+    static float3_t to_float3(const float_t (&components)[3])
+    {
+        return {components[0], components[1], components[2]};
+    }
+
+
+    struct bounds_t
+    {
+        float3_t min = {INFINITY, INFINITY, INFINITY};
+        float3_t max = {-INFINITY, -INFINITY, -INFINITY};
+
+        void grow(const float3_t& point)
+        {
+            for(size_t i = 0; i < 3; ++i)
+            {
+                min[i] = std::min(min[i], point[i]);
+                max[i] = std::max(max[i], point[i]);
+            }
+        }
+
+        void grow(const bounds_t& bounds)
+        {
+            grow(bounds.min);
+            grow(bounds.max);
+        }
+
+        float3_t get_extent() const
+        {
+            return subtract(max, min);
+        }
+
+        float_t get_area() const
+        {
+            auto extent = get_extent();
+
+            return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+        }
+    };
+
+    struct cone_t
+    {
+        float3_t axis;
+        float_t theta_o;
+        float_t theta_e;
+        bool_t empty = true;
+    };
+
+    static cone_t merge(cone_t a, cone_t b)
+    {
+        if(a.empty)
+        {
+            return b;
+        }
+
+        if(b.empty)
+        {
+            return a;
+        }
+
+        if(b.theta_o > a.theta_o)
+        {
+            std::swap(a, b);
+        }
+
+        auto theta_d = std::acos(std::clamp(dot(a.axis, b.axis), -1.0f, 1.0f));
+        auto theta_e = std::max(a.theta_e, b.theta_e);
+
+        if(std::min(theta_d + b.theta_o, pi) <= a.theta_o)
+        {
+            return {a.axis, a.theta_o, theta_e, false};
+        }
+
+        auto theta_o = (a.theta_o + theta_d + b.theta_o) / 2.0f;
+
+        if(theta_o >= pi)
+        {
+            return {a.axis, pi, theta_e, false};
+        }
+
+        // Turns the axis of a towards b, any way when they are opposite.
+        auto ortho = subtract(b.axis, scale(a.axis, dot(a.axis, b.axis)));
+
+        if(dot(ortho, ortho) < 1e-12f)
+        {
+            ortho = std::abs(a.axis[0]) < 0.9f ? cross(a.axis, {1.0f, 0.0f, 0.0f}) : cross(a.axis, {0.0f, 1.0f, 0.0f});
+        }
+
+        auto theta_r = theta_o - a.theta_o;
+        auto axis = add(scale(a.axis, std::cos(theta_r)), scale(normalize(ortho), std::sin(theta_r)));
+
+        return {normalize(axis), theta_o, theta_e, false};
+    }
+
+    // The solid angle the cone may emit to, weighted by cosine.
+    static float_t get_orientation_measure(const cone_t& cone)
+    {
+        auto theta_w = std::min(cone.theta_o + cone.theta_e, pi);
+        auto sin_o = std::sin(cone.theta_o);
+        auto cos_o = std::cos(cone.theta_o);
+
+        return 2.0f * pi * (1.0f - cos_o) +
+               pi / 2.0f * (2.0f * theta_w * sin_o - std::cos(cone.theta_o - 2.0f * theta_w) - 2.0f * cone.theta_o * sin_o + cos_o);
+    }
+
+
+    struct build_light_t
+    {
+        bounds_t bounds;
+        float3_t centroid;
+        cone_t cone;
+        float_t flux;
+        uint32_t index;
+    };
+
+    // What a node or a bin holds.
+    struct cluster_t
+    {
+        bounds_t bounds;
+        cone_t cone;
+        float_t flux = 0.0f;
+        uint32_t count = 0;
+
+        void add(const cluster_t& cluster)
+        {
+            bounds.grow(cluster.bounds);
+            cone = merge(cone, cluster.cone);
+            flux += cluster.flux;
+            count += cluster.count;
+        }
+
+        void add(const build_light_t& light)
+        {
+            bounds.grow(light.bounds);
+            cone = merge(cone, light.cone);
+            flux += light.flux;
+            ++count;
+        }
+
+        float_t get_cost() const
+        {
+            return count ? flux * bounds.get_area() * get_orientation_measure(cone) : 0.0f;
+        }
+    };
+
+
+    static build_light_t make_build_light(const light_t& light, uint32_t index)
+    {
+        auto corner = to_float3(light.point.components);
+        auto edge0 = scale(to_float3(light.basis_vec0.components), light.param0_max);
+        auto edge1 = scale(to_float3(light.basis_vec1.components), light.param1_max);
+
+        build_light_t build_light;
+
+        build_light.bounds.grow(corner);
+        build_light.bounds.grow(add(corner, edge0));
+        build_light.bounds.grow(add(corner, edge1));
+
+        if(light.shape == light_shape_t::rect)
+        {
+            build_light.bounds.grow(add(add(corner, edge0), edge1));
+        }
+
+        build_light.centroid = scale(add(build_light.bounds.min, build_light.bounds.max), 0.5f);
+
+        // Lit on the side of light.normal only, like the renderers take it.
+        auto normal = normalize(cross(edge0, edge1));
+
+        if(dot(normal, to_float3(light.normal.components)) < 0.0f)
+        {
+            normal = scale(normal, -1.0f);
+        }
+
+        build_light.cone = {normal, 0.0f, pi / 2.0f, false};
+        build_light.flux = std::max(get_flux(light), 0.0f);
+        build_light.index = index;
+
+        return build_light;
+    }
+
+
+    class light_bvh_builder_t
+    {
+        darray_t<build_light_t> lights;
+        darray_t<light_bvh_node_t>& nodes;
+        darray_t<light_trail_t>& trails;
+
+        uint32_t get_bin(const build_light_t& light, uint32_t axis, const bounds_t& centroids) const
+        {
+            auto offset = (light.centroid[axis] - centroids.min[axis]) / (centroids.max[axis] - centroids.min[axis]);
+
+            return std::min(uint32_t(offset * bins_count), bins_count - 1);
+        }
+
+        // Returns where the right half starts.
+        size_t split(size_t begin, size_t end, const cluster_t& cluster, uint32_t depth)
+        {
+            auto count = end - begin;
+
+            bounds_t centroids;
+
+            for(auto i = begin; i < end; ++i)
+            {
+                centroids.grow(lights[i].centroid);
+            }
+
+            auto extent = cluster.bounds.get_extent();
+            auto max_extent = std::max({extent[0], extent[1], extent[2]});
+
+            // Deep down only halving keeps the depth in the trails.
+            auto balanced = depth + std::bit_width(count - 1) >= 31;
+
+            auto best_cost = INFINITY;
+            uint32_t best_axis = 0;
+            uint32_t best_bin = 0;
+
+            for(uint32_t axis = 0; axis < 3 && !balanced; ++axis)
+            {
+                if(centroids.max[axis] <= centroids.min[axis])
+                {
+                    continue;
+                }
+
+                array_t<cluster_t, bins_count> bins;
+
+                for(auto i = begin; i < end; ++i)
+                {
+                    bins[get_bin(lights[i], axis, centroids)].add(lights[i]);
+                }
+
+                array_t<cluster_t, bins_count> right;
+                right[bins_count - 1] = bins[bins_count - 1];
+
+                for(auto i = bins_count - 1; i-- > 0;)
+                {
+                    right[i] = right[i + 1];
+                    right[i].add(bins[i]);
+                }
+
+                // Thin boxes are split across rather than along.
+                auto regularization = max_extent / extent[axis];
+
+                cluster_t left;
+
+                for(uint32_t i = 0; i + 1 < bins_count; ++i)
+                {
+                    left.add(bins[i]);
+
+                    auto cost = regularization * (left.get_cost() + right[i + 1].get_cost());
+
+                    if(cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = i;
+                    }
+                }
+            }
+
+            if(best_cost < INFINITY)
+            {
+                auto middle = std::partition(
+                                              lights.begin() + begin,
+                                              lights.begin() + end,
+                                              [&](const build_light_t& light)
+                                              {
+                                                  return get_bin(light, best_axis, centroids) <= best_bin;
+                                              }
+                                            );
+
+                auto split = size_t(middle - lights.begin());
+
+                if(split != begin && split != end)
+                {
+                    return split;
+                }
+            }
+
+            auto centroids_extent = centroids.get_extent();
+            auto axis = std::max_element(centroids_extent.begin(), centroids_extent.end()) - centroids_extent.begin();
+            auto middle = begin + count / 2;
+
+            std::nth_element(
+                              lights.begin() + begin,
+                              lights.begin() + middle,
+                              lights.begin() + end,
+                              [&](const build_light_t& a, const build_light_t& b)
+                              {
+                                  return a.centroid[axis] < b.centroid[axis];
+                              }
+                            );
+
+            return middle;
+        }
+
+        uint32_t build(size_t begin, size_t end, uint32_t depth, light_trail_t trail)
+        {
+            cluster_t cluster;
+
+            for(auto i = begin; i < end; ++i)
+            {
+                cluster.add(lights[i]);
+            }
+
+            auto index = uint32_t(nodes.size());
+
+            light_bvh_node_t node = {};
+
+            for(size_t i = 0; i < 3; ++i)
+            {
+                node.bounds_min[i] = cluster.bounds.min[i] - bounds_padding;
+                node.bounds_max[i] = cluster.bounds.max[i] + bounds_padding;
+                node.axis[i] = cluster.cone.axis[i];
+            }
+
+            node.flux = cluster.flux;
+            node.cos_theta_o = std::cos(cluster.cone.theta_o);
+            node.cos_theta_e = std::cos(cluster.cone.theta_e);
+
+            nodes.push_back(node);
+
+            if(end - begin == 1)
+            {
+                nodes[index].child = lights[begin].index;
+                nodes[index].is_leaf = 1;
+                trails[lights[begin].index] = trail;
+
+                return index;
+            }
+
+            auto middle = split(begin, end, cluster, depth);
+
+            build(begin, middle, depth + 1, trail);
+            auto right = build(middle, end, depth + 1, trail | (1u << depth));
+
+            nodes[index].child = right;
+
+            return index;
+        }
+
+    public:
+        light_bvh_builder_t(darray_t<light_bvh_node_t>& nodes, darray_t<light_trail_t>& trails) :
+            nodes(nodes),
+            trails(trails)
+        {
+        }
+
+        void build(const darray_t<light_t>& scene_lights)
+        {
+            nodes.clear();
+            trails.assign(scene_lights.size(), 0);
+
+            if(scene_lights.empty())
+            {
+                return;
+            }
+
+            lights.reserve(scene_lights.size());
+
+            for(uint32_t i = 0; i < scene_lights.size(); ++i)
+            {
+                lights.push_back(make_build_light(scene_lights[i], i));
+            }
+
+            nodes.reserve(2 * lights.size() - 1);
+
+            build(0, lights.size(), 0, 0);
+        }
+    };
+
+
+    void build_light_bvh(
+                          const darray_t<light_t>& lights,
+                          darray_t<light_bvh_node_t>& nodes,
+                          darray_t<light_trail_t>& trails
+                        )
+    {
+        light_bvh_builder_t builder(nodes, trails);
+        builder.build(lights);
+    }
+}
@@ -0,0 +1,64 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef LIGHT_BVH_HPP
+#define LIGHT_BVH_HPP
+
+#include "common.hpp"
+#include "algebra.hpp"
+#include "lights.hpp"
+
+namespace bpmap
+{
+    // Node of the light hierarchy the renderers pick lights with, Conty and
+    // Kulla 2018. The nodes are in depth first order, so the left child
+    // follows its parent and child is the right one. Leaves hold a single
+    // light, child is its index.
+    struct light_bvh_node_t
+    {
+        point3d_t bounds_min;
+        float_t flux;
+
+        point3d_t bounds_max;
+        uint32_t child;
+
+        // The normals of the lights below are within theta_o of axis and
+        // they emit up to theta_e away from their normal.
+        direction3d_t axis;
+        float_t cos_theta_o;
+
+        float_t cos_theta_e;
+        uint32_t is_leaf;
+        uint32_t pad[2];
+    };
+
+    // The way from the root to the leaf of each light, bit i is set when it
+    // goes right at depth i, so a light's probability can be found without
+    // a search.
+    using light_trail_t = uint32_t;
+
+    // Splits by the surface area orientation heuristic over binned
+    // centroids. The depth stays below 32 so the trails fit.
+    void build_light_bvh(
+                          const darray_t<light_t>& lights,
+                          darray_t<light_bvh_node_t>& nodes,
+                          darray_t<light_trail_t>& trails
+                        );
+}
+
+#endif // LIGHT_BVH_HPP
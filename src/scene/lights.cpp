@@ -0,0 +1,139 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+
+#include "lights.hpp"
+
+namespace bpmap
+{
+    float_t get_flux(const light_t& light)
+    {
+        auto& color = light.color.components;
+
+        return light.power * (0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2]);
+    }
+
+
+    // Vose's method, every slot ends up holding at most two entries.
+    void build_aliases(const float_t* weights, uint32_t count, light_alias_t* aliases)
+    {
+        if(count == 0)
+        {
+            return;
+        }
+
+        darray_t<float_t> scaled(count);
+
+        double total = 0.0;
+
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            total += std::max(weights[i], 0.0f);
+        }
+
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            auto pdf = total > 0.0 ? float_t(std::max(weights[i], 0.0f) / total) : 1.0f / count;
+
+            aliases[i] = {1.0f, i, pdf};
+            scaled[i] = pdf * count;
+        }
+
+        darray_t<uint32_t> small;
+        darray_t<uint32_t> large;
+
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            (scaled[i] < 1.0f ? small : large).push_back(i);
+        }
+
+        while(!small.empty() && !large.empty())
+        {
+            auto less = small.back();
+            small.pop_back();
+            auto more = large.back();
+            large.pop_back();
+
+            aliases[less].probability = scaled[less];
+            aliases[less].alias = more;
+
+            scaled[more] = (scaled[more] + scaled[less]) - 1.0f;
+
+            (scaled[more] < 1.0f ? small : large).push_back(more);
+        }
+
+        // What is left is one up to rounding.
+    }
+
+
+    void build_light_aliases(const darray_t<light_t>& lights, darray_t<light_alias_t>& aliases)
+    {
+        darray_t<float_t> fluxes(lights.size());
+
+        for(size_t i = 0; i < lights.size(); ++i)
+        {
+            fluxes[i] = get_flux(lights[i]);
+        }
+
+        aliases.resize(lights.size());
+        build_aliases(fluxes.data(), uint32_t(lights.size()), aliases.data());
+    }
+
+
+    light_t make_triangle_light(const point3d_t vertices[3], const color3df_t& radiance)
+    {
+        light_t light = {};
+        light.shape = light_shape_t::triangle;
+        light.point = vertices[0];
+
+        // Degenerate edges stay zero, such a triangle has no power.
+        auto set_edge = [&vertices](const point3d_t& end, direction3d_t& basis_vec, float_t& length)
+        {
+            auto& p = vertices[0].components;
+            auto& q = end.components;
+            float_t edge[3] = {q[0] - p[0], q[1] - p[1], q[2] - p[2]};
+
+            length = std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+
+            for(size_t i = 0; i < 3; ++i)
+            {
+                basis_vec.components[i] = length > 0.0f ? edge[i] / length : 0.0f;
+            }
+        };
+
+        set_edge(vertices[1], light.basis_vec0, light.param0_max);
+        set_edge(vertices[2], light.basis_vec1, light.param1_max);
+
+        auto& a = light.basis_vec0.components;
+        auto& b = light.basis_vec1.components;
+        auto& n = light.normal.components;
+
+        n[0] = a[1] * b[2] - a[2] * b[1];
+        n[1] = a[2] * b[0] - a[0] * b[2];
+        n[2] = a[0] * b[1] - a[1] * b[0];
+
+        auto sin_angle = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        // The renderers take radiance as color * power / area.
+        light.color = radiance;
+        light.power = 0.5f * light.param0_max * light.param1_max * sin_angle;
+
+        return light;
+    }
+}
@@ -24,10 +24,18 @@
 
 namespace bpmap
 {
-    struct rect_light_t
+    enum class light_shape_t : uint32_t
+    {
+        // The parallelogram spanned by the two edges from point.
+        rect,
+        // Half of it, the emissive triangles of the objects.
+        triangle
+    };
+
+    struct light_t
     {
         point3d_t point;
-        float pad0;
+        light_shape_t shape;
 
         codirection3d_t normal;
         float pad1;
@@ -42,7 +50,29 @@ namespace bpmap
         float_t power;
     };
 
-    using light_t = rect_light_t;
+    // Entry of the alias table the renderers pick lights with. A uniform
+    // slot keeps its own light with probability and takes alias otherwise.
+    struct light_alias_t
+    {
+        float_t probability;
+        uint32_t alias;
+        // Of picking the light of the slot.
+        float_t pdf;
+    };
+
+    // Power times the luminance of the color.
+    float_t get_flux(const light_t& light);
+
+    // Builds the table of count entries over weights, which needn't sum to
+    // one. Without any weight all the entries are as likely.
+    void build_aliases(const float_t* weights, uint32_t count, light_alias_t* aliases);
+
+    // Builds the table over the flux of the lights.
+    void build_light_aliases(const darray_t<light_t>& lights, darray_t<light_alias_t>& aliases);
+
+    // Light of a triangle emitting radiance on the side its counterclockwise
+    // winding faces, power is set so the renderers get that radiance back.
+    light_t make_triangle_light(const point3d_t vertices[3], const color3df_t& radiance);
 }
 
 #endif // LIGHTS_HPP
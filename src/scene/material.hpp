@@ -28,9 +28,19 @@ namespace bpmap
     {
         color3df_t base_color;
         float_t roughness;
+
+        // Radiance of the front faces, the Ke of MTL. The triangles of
+        // emissive materials are lights too.
+        color3df_t emission;
         float_t metallic;
-        uint32_t pad[3];
     };
+
+    inline bool_t is_emissive(const material_t& material)
+    {
+        auto& emission = material.emission.components;
+
+        return emission[0] > 0.0f || emission[1] > 0.0f || emission[2] > 0.0f;
+    }
 }
 
 #endif // MATERIAL_HPP
@@ -0,0 +1,1647 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#include <batch_transform.hpp>
+#include <io.hpp>
+#include <thread_pool.hpp>
+
+#include "asset_cache.hpp"
+#include "obj_parser.hpp"
+
+namespace bpmap
+{
+    // Large enough for the per chunk bookkeeping to be negligible and small
+    // enough to balance the threads on files with uneven lines.
+    static constexpr size_t min_chunk_size = 4 * 1024 * 1024;
+    static constexpr size_t chunks_per_thread = 4;
+
+    // Streamed files are parsed in smaller chunks so little of the geometry
+    // is on the host at any time.
+    static constexpr size_t stream_chunk_size = 8 * 1024 * 1024;
+
+    static constexpr int32_t missing_index = -1;
+    static constexpr int32_t no_material = -1;
+
+    enum class obj_attribute_t
+    {
+        vertex,
+        texcoord,
+        normal
+    };
+
+    struct obj_corner_t
+    {
+        int32_t vertex = missing_index;
+        int32_t texcoord = missing_index;
+        int32_t normal = missing_index;
+    };
+
+    // Negative indices count back from the attributes parsed so far. A chunk
+    // knows only its own part, so they are resolved once all chunks are
+    // counted.
+    struct obj_relative_index_t
+    {
+        size_t corner;
+        obj_attribute_t attribute;
+        int64_t index;
+    };
+
+    // Commands which depend on the state of the whole file, handled in order
+    // after the parallel part.
+    struct obj_event_t
+    {
+        enum class type_t
+        {
+            use_material,
+            material_library
+        };
+
+        type_t type;
+        size_t face;
+        string_view_t value;
+    };
+
+    // A polygon which references positions of other chunks, triangulated
+    // into its slots once all chunks of the file are parsed.
+    struct obj_deferred_face_t
+    {
+        size_t corner;
+        size_t triangle;
+        uint32_t size;
+        int32_t material;
+    };
+
+    struct obj_chunk_t
+    {
+        const char_t* begin;
+        const char_t* end;
+
+        darray_t<point3d_t> vertices;
+        darray_t<codirection3d_t> normals;
+        darray_t<point2d_t> texcoords;
+
+        darray_t<obj_corner_t> corners;
+        darray_t<uint32_t> face_sizes;
+        darray_t<obj_relative_index_t> relative_indices;
+        darray_t<obj_event_t> events;
+
+        // First face and material of each material run in the chunk.
+        darray_t<pair_t<size_t, int32_t>> materials;
+
+        darray_t<triangle_t> triangles;
+
+        size_t vertices_offset;
+        size_t normals_offset;
+        size_t texcoords_offset;
+        size_t triangles_offset;
+
+        // What the chunk holds according to the scan of a streamed file,
+        // the triangles are counted as slots of the triangulated faces.
+        geometry_sizes_t counts;
+        size_t faces_count = 0;
+        size_t polygons_count = 0;
+
+        darray_t<obj_deferred_face_t> deferred;
+
+        bool_t failed = false;
+    };
+
+
+    static bool_t is_space(char_t c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+
+    static const char_t* skip_spaces(const char_t* p, const char_t* end)
+    {
+        while(p != end && is_space(*p))
+        {
+            ++p;
+        }
+
+        return p;
+    }
+
+
+    // Assigning {} to a darray_t keeps its capacity, swapping frees it.
+    template <typename T>
+    static void release(darray_t<T>& array)
+    {
+        darray_t<T>().swap(array);
+    }
+
+
+    // Calls f(begin, end) for every line, both '\n' and '\r' end lines.
+    template <typename F>
+    static bool_t for_each_line(const char_t* p, const char_t* end, F&& f)
+    {
+        while(p != end)
+        {
+            auto newline = (const char_t*) memchr(p, '\n', end - p);
+            auto line_end = newline ? newline : end;
+            auto carriage_return = (const char_t*) memchr(p, '\r', line_end - p);
+
+            if(carriage_return)
+            {
+                line_end = carriage_return;
+            }
+
+            if(!f(p, line_end))
+            {
+                return false;
+            }
+
+            p = (line_end == end) ? end : line_end + 1;
+        }
+
+        return true;
+    }
+
+
+    // Like tinyobj a token ends at a space and a malformed number reads as
+    // zero. The value is rounded to double first to match its results.
+    static const char_t* parse_real(const char_t* p, const char_t* end, float_t& value)
+    {
+        p = skip_spaces(p, end);
+
+        auto token_end = p;
+
+        while(token_end != end && !is_space(*token_end))
+        {
+            ++token_end;
+        }
+
+        auto is_signed = p != token_end && (*p == '+' || *p == '-');
+        auto first = (is_signed && *p == '+') ? p + 1 : p;
+        auto digit = is_signed ? p + 1 : p;
+        auto result = 0.0;
+
+        // A digit has to follow the sign, which also rules out inf and nan.
+        if(digit != token_end && *digit >= '0' && *digit <= '9')
+        {
+            std::from_chars(first, token_end, result);
+        }
+
+        value = float_t(result);
+
+        return token_end;
+    }
+
+
+    template <size_t size, typename T>
+    static void parse_reals(const char_t* p, const char_t* end, T& values)
+    {
+        for(auto i = 0u; i < size; ++i)
+        {
+            p = parse_real(p, end, values[i]);
+        }
+    }
+
+
+    // Reads a number like atoi and moves past it to the next separator.
+    static const char_t* parse_index(const char_t* p, const char_t* end, int32_t& value)
+    {
+        auto first = (p != end && *p == '+') ? p + 1 : p;
+
+        value = 0;
+        std::from_chars(first, end, value);
+
+        while(p != end && *p != '/' && !is_space(*p))
+        {
+            ++p;
+        }
+
+        return p;
+    }
+
+
+    static const char_t* parse_corner_index(
+                                             const char_t* p,
+                                             const char_t* end,
+                                             obj_chunk_t& chunk,
+                                             obj_attribute_t attribute,
+                                             int32_t& index
+                                           )
+    {
+        int32_t value;
+        p = parse_index(p, end, value);
+
+        // Zero isn't a valid index.
+        if(value == 0)
+        {
+            return nullptr;
+        }
+
+        if(value > 0)
+        {
+            index = value - 1;
+            return p;
+        }
+
+        auto count = (attribute == obj_attribute_t::vertex)? chunk.vertices.size() :
+                     (attribute == obj_attribute_t::normal)? chunk.normals.size() :
+                                                             chunk.texcoords.size();
+
+        chunk.relative_indices.push_back({chunk.corners.size(), attribute, int64_t(count) + value});
+
+        return p;
+    }
+
+
+    // Faces are stored as they are, the triangulation needs the positions
+    // of all chunks.
+    static bool_t parse_face(const char_t* p, const char_t* end, obj_chunk_t& chunk)
+    {
+        p = skip_spaces(p, end);
+
+        uint32_t size = 0;
+
+        while(p != end)
+        {
+            obj_corner_t corner;
+
+            p = parse_corner_index(p, end, chunk, obj_attribute_t::vertex, corner.vertex);
+
+            if(p && p != end && *p == '/')
+            {
+                ++p;
+
+                if(p != end && *p == '/')
+                {
+                    p = parse_corner_index(p + 1, end, chunk, obj_attribute_t::normal, corner.normal);
+                }
+                else
+                {
+                    p = parse_corner_index(p, end, chunk, obj_attribute_t::texcoord, corner.texcoord);
+
+                    if(p && p != end && *p == '/')
+                    {
+                        p = parse_corner_index(p + 1, end, chunk, obj_attribute_t::normal, corner.normal);
+                    }
+                }
+            }
+
+            if(!p)
+            {
+                return false;
+            }
+
+            chunk.corners.push_back(corner);
+            size++;
+
+            p = skip_spaces(p, end);
+        }
+
+        chunk.face_sizes.push_back(size);
+
+        return true;
+    }
+
+
+    static void parse_event(
+                             const char_t* p,
+                             const char_t* end,
+                             size_t face,
+                             darray_t<obj_event_t>& events
+                           )
+    {
+        auto length = end - p;
+
+        if(length <= 6 || !is_space(p[6]))
+        {
+            return;
+        }
+
+        if(memcmp(p, "usemtl", 6) == 0)
+        {
+            events.push_back({obj_event_t::type_t::use_material, face, string_view_t(p + 7, end - p - 7)});
+        }
+        else if(memcmp(p, "mtllib", 6) == 0)
+        {
+            events.push_back({obj_event_t::type_t::material_library, face, string_view_t(p + 7, end - p - 7)});
+        }
+    }
+
+
+    static bool_t parse_line(const char_t* p, const char_t* end, obj_chunk_t& chunk)
+    {
+        p = skip_spaces(p, end);
+
+        auto length = end - p;
+
+        if(length < 2 || p[0] == '#')
+        {
+            return true;
+        }
+
+        if(p[0] == 'v' && is_space(p[1]))
+        {
+            parse_reals<3>(p + 2, end, chunk.vertices.emplace_back());
+        }
+        else if(p[0] == 'v' && p[1] == 'n' && length > 2 && is_space(p[2]))
+        {
+            parse_reals<3>(p + 3, end, chunk.normals.emplace_back());
+        }
+        else if(p[0] == 'v' && p[1] == 't' && length > 2 && is_space(p[2]))
+        {
+            parse_reals<2>(p + 3, end, chunk.texcoords.emplace_back());
+        }
+        else if(p[0] == 'f' && is_space(p[1]))
+        {
+            return parse_face(p + 2, end, chunk);
+        }
+        else
+        {
+            parse_event(p, end, chunk.face_sizes.size(), chunk.events);
+        }
+
+        return true;
+    }
+
+
+    static uint32_t count_corners(const char_t* p, const char_t* end)
+    {
+        uint32_t count = 0;
+
+        for(p = skip_spaces(p, end); p != end; p = skip_spaces(p, end))
+        {
+            while(p != end && !is_space(*p))
+            {
+                ++p;
+            }
+
+            count++;
+        }
+
+        return count;
+    }
+
+
+    // Counts what parse_line adds to the chunk without parsing any numbers,
+    // the events are collected the same way.
+    static bool_t scan_line(const char_t* p, const char_t* end, obj_chunk_t& chunk)
+    {
+        p = skip_spaces(p, end);
+
+        auto length = end - p;
+
+        if(length < 2 || p[0] == '#')
+        {
+            return true;
+        }
+
+        if(p[0] == 'v' && is_space(p[1]))
+        {
+            chunk.counts.vertices++;
+        }
+        else if(p[0] == 'v' && p[1] == 'n' && length > 2 && is_space(p[2]))
+        {
+            chunk.counts.normals++;
+        }
+        else if(p[0] == 'v' && p[1] == 't' && length > 2 && is_space(p[2]))
+        {
+            chunk.counts.texcoords++;
+        }
+        else if(p[0] == 'f' && is_space(p[1]))
+        {
+            auto size = count_corners(p + 2, end);
+
+            chunk.counts.triangles += (size >= 3) ? size - 2 : 0;
+            chunk.polygons_count += (size > 3) ? 1 : 0;
+            chunk.faces_count++;
+        }
+        else
+        {
+            parse_event(p, end, chunk.faces_count, chunk.events);
+        }
+
+        return true;
+    }
+
+
+    // Same results as tinyobj's MTL reader for the properties we use,
+    // including its handling of unnamed and duplicate materials.
+    static bool_t load_material_library(
+                                         const string_t& path,
+                                         darray_t<material_t>& materials,
+                                         hash_table_t<string_t, int32_t>& names
+                                       )
+    {
+        mapped_file_t file;
+
+        if(!file.open(path))
+        {
+            return false;
+        }
+
+        auto data = (const char_t*) file.get_data();
+
+        material_t material = {};
+        string_t name;
+
+        for_each_line(data, data + file.get_size(), [&](const char_t* p, const char_t* end)
+        {
+            while(end != p && is_space(end[-1]))
+            {
+                --end;
+            }
+
+            p = skip_spaces(p, end);
+
+            auto length = end - p;
+
+            if(length < 3 || p[0] == '#')
+            {
+                return true;
+            }
+
+            if(length > 6 && memcmp(p, "newmtl", 6) == 0 && is_space(p[6]))
+            {
+                if(!name.empty())
+                {
+                    names.insert({name, materials.size()});
+                    materials.push_back(material);
+                }
+
+                material = {};
+                name = string_t(p + 7, end);
+            }
+            else if(p[0] == 'K' && p[1] == 'd' && is_space(p[2]))
+            {
+                parse_reals<3>(p + 2, end, material.base_color);
+            }
+            else if(p[0] == 'K' && p[1] == 'e' && is_space(p[2]))
+            {
+                parse_reals<3>(p + 2, end, material.emission);
+            }
+            else if(p[0] == 'P' && p[1] == 'r' && is_space(p[2]))
+            {
+                parse_real(p + 2, end, material.roughness);
+            }
+            else if(p[0] == 'P' && p[1] == 'm' && is_space(p[2]))
+            {
+                parse_real(p + 2, end, material.metallic);
+            }
+
+            return true;
+        });
+
+        names.insert({name, materials.size()});
+        materials.push_back(material);
+
+        return true;
+    }
+
+
+    // Applies the material commands in file order and splits the faces of
+    // every chunk into runs with the same material.
+    static void resolve_materials(darray_t<obj_chunk_t>& chunks, darray_t<material_t>& materials)
+    {
+        hash_table_t<string_t, int32_t> names;
+        auto material = no_material;
+
+        for(auto& chunk : chunks)
+        {
+            chunk.materials.push_back({0, material});
+
+            for(auto& event : chunk.events)
+            {
+                if(event.type == obj_event_t::type_t::use_material)
+                {
+                    auto it = names.find(string_t(event.value));
+                    material = (it != names.end()) ? it->second : no_material;
+
+                    chunk.materials.push_back({event.face, material});
+                    continue;
+                }
+
+                // The first library which can be opened wins.
+                auto libraries = event.value;
+
+                while(true)
+                {
+                    auto separator = libraries.find(' ');
+                    auto library = libraries.substr(0, separator);
+
+                    if(load_material_library(string_t(library), materials, names))
+                    {
+                        break;
+                    }
+
+                    if(separator == string_view_t::npos)
+                    {
+                        log_error("Failed to load material library ", event.value);
+                        break;
+                    }
+
+                    libraries.remove_prefix(separator + 1);
+                }
+            }
+
+            chunk.events.clear();
+        }
+    }
+
+
+    static bool_t resolve_relative_indices(obj_chunk_t& chunk, const geometry_sizes_t& sizes)
+    {
+        for(auto& relative : chunk.relative_indices)
+        {
+            auto& corner = chunk.corners[relative.corner];
+
+            int64_t offset;
+            int64_t count;
+            int32_t* index;
+
+            switch(relative.attribute)
+            {
+                case obj_attribute_t::vertex:
+                    offset = chunk.vertices_offset;
+                    count = sizes.vertices;
+                    index = &corner.vertex;
+                    break;
+
+                case obj_attribute_t::normal:
+                    offset = chunk.normals_offset;
+                    count = sizes.normals;
+                    index = &corner.normal;
+                    break;
+
+                case obj_attribute_t::texcoord:
+                default:
+                    offset = chunk.texcoords_offset;
+                    count = sizes.texcoords;
+                    index = &corner.texcoord;
+                    break;
+            }
+
+            auto value = offset + relative.index;
+
+            if(value < 0 || value >= count)
+            {
+                return false;
+            }
+
+            *index = int32_t(value);
+        }
+
+        release(chunk.relative_indices);
+
+        return true;
+    }
+
+
+    static bool_t is_valid(const obj_corner_t& corner, const geometry_sizes_t& sizes)
+    {
+        auto is_in_range = [](int32_t index, size_t count)
+        {
+            return index == missing_index || (index >= 0 && size_t(index) < count);
+        };
+
+        return corner.vertex >= 0 &&
+               size_t(corner.vertex) < sizes.vertices &&
+               is_in_range(corner.normal, sizes.normals) &&
+               is_in_range(corner.texcoord, sizes.texcoords);
+    }
+
+
+    // code from https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html
+    static bool_t is_inside(const float_t* x, const float_t* y, float_t test_x, float_t test_y)
+    {
+        auto inside = false;
+
+        for(auto i = 0, j = 2; i < 3; j = i++)
+        {
+            if(
+                ((y[i] > test_y) != (y[j] > test_y)) &&
+                (test_x < (x[j] - x[i]) * (test_y - y[i]) / (y[j] - y[i]) + x[i])
+              )
+            {
+                inside = !inside;
+            }
+        }
+
+        return inside;
+    }
+
+
+    static void emit_triangle(
+                               darray_t<triangle_t>& triangles,
+                               const obj_corner_t& c0,
+                               const obj_corner_t& c1,
+                               const obj_corner_t& c2,
+                               int32_t material
+                             )
+    {
+        auto& t = triangles.emplace_back();
+
+        const obj_corner_t* corners[] = {&c0, &c1, &c2};
+
+        for(auto i = 0; i < 3; ++i)
+        {
+            t.vertices[i].vertex_index = corners[i]->vertex;
+            t.vertices[i].normal_index = corners[i]->normal;
+            t.vertices[i].texcoord_index = corners[i]->texcoord;
+        }
+
+        t.material_id = material;
+    }
+
+
+    // Ear clipping done exactly like tinyobj does it so polygons are split
+    // into the same triangles, convex ones end up as fans. get_position maps
+    // a vertex index to its coordinates.
+    template <typename P>
+    static void triangulate(
+                             const obj_corner_t* face,
+                             uint32_t size,
+                             int32_t material,
+                             P&& get_position,
+                             darray_t<obj_corner_t>& remaining,
+                             darray_t<triangle_t>& triangles
+                           )
+    {
+        if(size == 3)
+        {
+            emit_triangle(triangles, face[0], face[1], face[2], material);
+            return;
+        }
+
+        // Find the two axes to work in.
+        size_t axes[2] = {1, 2};
+
+        for(size_t k = 0; k < size; ++k)
+        {
+            auto v0 = get_position(face[k].vertex);
+            auto v1 = get_position(face[(k + 1) % size].vertex);
+            auto v2 = get_position(face[(k + 2) % size].vertex);
+
+            float_t e0x = v1[0] - v0[0];
+            float_t e0y = v1[1] - v0[1];
+            float_t e0z = v1[2] - v0[2];
+            float_t e1x = v2[0] - v1[0];
+            float_t e1y = v2[1] - v1[1];
+            float_t e1z = v2[2] - v1[2];
+
+            float_t cx = std::fabs(e0y * e1z - e0z * e1y);
+            float_t cy = std::fabs(e0z * e1x - e0x * e1z);
+            float_t cz = std::fabs(e0x * e1y - e0y * e1x);
+
+            static constexpr float_t epsilon = 0.0001f;
+
+            if(cx > epsilon || cy > epsilon || cz > epsilon)
+            {
+                if(!(cx > cy && cx > cz))
+                {
+                    axes[0] = 0;
+
+                    if(cz > cx && cz > cy)
+                    {
+                        axes[1] = 1;
+                    }
+                }
+
+                break;
+            }
+        }
+
+        float_t area = 0;
+
+        for(size_t k = 0; k < size; ++k)
+        {
+            auto v0 = get_position(face[k].vertex);
+            auto v1 = get_position(face[(k + 1) % size].vertex);
+
+            area += (v0[axes[0]] * v1[axes[1]] - v0[axes[1]] * v1[axes[0]]) * 0.5f;
+        }
+
+        remaining.assign(face, face + size);
+
+        // Protects against degenerate polygons which have no ears.
+        auto rounds = 10;
+        size_t guess = 0;
+
+        while(remaining.size() > 3 && rounds > 0)
+        {
+            auto count = remaining.size();
+
+            if(guess >= count)
+            {
+                rounds--;
+                guess -= count;
+            }
+
+            const obj_corner_t* corners[3];
+            float_t x[3];
+            float_t y[3];
+
+            for(size_t k = 0; k < 3; ++k)
+            {
+                corners[k] = &remaining[(guess + k) % count];
+
+                auto v = get_position(corners[k]->vertex);
+                x[k] = v[axes[0]];
+                y[k] = v[axes[1]];
+            }
+
+            float_t e0x = x[1] - x[0];
+            float_t e0y = y[1] - y[0];
+            float_t e1x = x[2] - x[1];
+            float_t e1y = y[2] - y[1];
+            float_t cross = e0x * e1y - e0y * e1x;
+
+            // An internal angle.
+            if(cross * area < 0.0f)
+            {
+                guess++;
+                continue;
+            }
+
+            auto overlap = false;
+
+            for(size_t other = 3; other < count; ++other)
+            {
+                auto v = get_position(remaining[(guess + other) % count].vertex);
+
+                if(is_inside(x, y, v[axes[0]], v[axes[1]]))
+                {
+                    overlap = true;
+                    break;
+                }
+            }
+
+            if(overlap)
+            {
+                guess++;
+                continue;
+            }
+
+            emit_triangle(triangles, *corners[0], *corners[1], *corners[2], material);
+
+            remaining.erase(remaining.begin() + (guess + 1) % count);
+        }
+
+        if(remaining.size() == 3)
+        {
+            emit_triangle(triangles, remaining[0], remaining[1], remaining[2], material);
+        }
+    }
+
+
+    static bool_t triangulate_chunk(obj_chunk_t& chunk, const obj_t& obj, const geometry_sizes_t& sizes)
+    {
+        darray_t<obj_corner_t> remaining;
+
+        chunk.triangles.reserve(chunk.corners.size() / 3);
+
+        auto face = chunk.corners.data();
+        auto run = chunk.materials.begin();
+
+        for(size_t i = 0; i < chunk.face_sizes.size(); ++i)
+        {
+            auto size = chunk.face_sizes[i];
+
+            while(run + 1 != chunk.materials.end() && (run + 1)->first <= i)
+            {
+                ++run;
+            }
+
+            // Faces with less than 3 corners are skipped.
+            if(size >= 3)
+            {
+                for(auto j = 0u; j < size; ++j)
+                {
+                    if(!is_valid(face[j], sizes))
+                    {
+                        return false;
+                    }
+                }
+
+                auto get_position = [&obj](int32_t index) -> const float_t*
+                {
+                    return obj.vertices[index].components;
+                };
+
+                triangulate(face, size, run->second, get_position, remaining, chunk.triangles);
+            }
+
+            face += size;
+        }
+
+        release(chunk.corners);
+        release(chunk.face_sizes);
+
+        return true;
+    }
+
+
+    // Chunks start right after a new line.
+    static void split_chunks(
+                              const char_t* data,
+                              size_t size,
+                              size_t chunks_count,
+                              darray_t<obj_chunk_t>& chunks
+                            )
+    {
+        chunks.resize(chunks_count);
+
+        auto begin = data;
+
+        for(size_t i = 0; i < chunks_count; ++i)
+        {
+            auto end = data + size;
+
+            if(i + 1 != chunks_count)
+            {
+                auto split = std::max(begin, data + size * (i + 1) / chunks_count);
+                auto newline = (const char_t*) memchr(split, '\n', data + size - split);
+
+                end = newline ? newline + 1 : end;
+            }
+
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+
+            begin = end;
+        }
+    }
+
+
+    template <typename T>
+    static void move_to(darray_t<T>& source, darray_t<T>& destination, size_t offset)
+    {
+        std::copy(source.begin(), source.end(), destination.begin() + offset);
+        release(source);
+    }
+
+
+    error_t load_obj(const string_t& path, obj_t& obj)
+    {
+        mapped_file_t file;
+
+        if(!file.open(path))
+        {
+            return error_t::objects_load_fail;
+        }
+
+        auto& pool = thread_pool_t::get_global();
+
+        auto data = (const char_t*) file.get_data();
+        auto size = file.get_size();
+
+        auto chunks_count = std::clamp<size_t>(
+                                                size / min_chunk_size,
+                                                1,
+                                                pool.get_size() * chunks_per_thread
+                                              );
+
+        darray_t<obj_chunk_t> chunks;
+        split_chunks(data, size, chunks_count, chunks);
+
+        pool.parallel_for(chunks_count, [&chunks](size_t i)
+        {
+            auto& chunk = chunks[i];
+
+            chunk.failed = !for_each_line(chunk.begin, chunk.end, [&chunk](const char_t* p, const char_t* end)
+            {
+                return parse_line(p, end, chunk);
+            });
+        });
+
+        size_t vertices_count = 0;
+        size_t normals_count = 0;
+        size_t texcoords_count = 0;
+
+        for(auto& chunk : chunks)
+        {
+            if(chunk.failed)
+            {
+                log_error("Failed to parse a face in ", path);
+                return error_t::objects_load_fail;
+            }
+
+            chunk.vertices_offset = vertices_count;
+            chunk.normals_offset = normals_count;
+            chunk.texcoords_offset = texcoords_count;
+
+            vertices_count += chunk.vertices.size();
+            normals_count += chunk.normals.size();
+            texcoords_count += chunk.texcoords.size();
+        }
+
+        resolve_materials(chunks, obj.materials);
+
+        obj.vertices.resize(vertices_count);
+        obj.normals.resize(normals_count);
+        obj.texcoords.resize(texcoords_count);
+
+        geometry_sizes_t sizes = {vertices_count, normals_count, texcoords_count};
+
+        pool.parallel_for(chunks_count, [&chunks, &obj, &sizes](size_t i)
+        {
+            auto& chunk = chunks[i];
+
+            move_to(chunk.vertices, obj.vertices, chunk.vertices_offset);
+            move_to(chunk.normals, obj.normals, chunk.normals_offset);
+            move_to(chunk.texcoords, obj.texcoords, chunk.texcoords_offset);
+
+            chunk.failed = !resolve_relative_indices(chunk, sizes);
+        });
+
+        // The triangulation reads positions from any chunk, so it starts
+        // after all of them are in place.
+        pool.parallel_for(chunks_count, [&chunks, &obj, &sizes](size_t i)
+        {
+            auto& chunk = chunks[i];
+            chunk.failed = chunk.failed || !triangulate_chunk(chunk, obj, sizes);
+        });
+
+        size_t triangles_count = 0;
+
+        for(auto& chunk : chunks)
+        {
+            if(chunk.failed)
+            {
+                log_error("Face index out of range in ", path);
+                return error_t::objects_load_fail;
+            }
+
+            chunk.triangles_offset = triangles_count;
+            triangles_count += chunk.triangles.size();
+        }
+
+        obj.triangles.resize(triangles_count);
+
+        pool.parallel_for(chunks_count, [&chunks, &obj](size_t i)
+        {
+            move_to(chunks[i].triangles, obj.triangles, chunks[i].triangles_offset);
+        });
+
+        return error_t::success;
+    }
+
+
+    struct obj_stream_t
+    {
+        const scene_object_t* source;
+
+        mapped_file_t file;
+        darray_t<obj_chunk_t> chunks;
+
+        // Sizes of the file and where its elements start in the stream.
+        geometry_sizes_t sizes;
+        geometry_sizes_t bases;
+
+        // Untransformed positions for the deferred polygons, only kept for
+        // files which have polygons.
+        darray_t<point3d_t> positions;
+        bool_t has_polygons = false;
+
+        // Objects found in the asset cache aren't parsed, they have no
+        // chunks.
+        cached_obj_t cached;
+        bool_t is_cached = false;
+    };
+
+
+    // Ear clipping gives less triangles than the slots of the face only for
+    // degenerate polygons, the rest is filled with triangles which are
+    // never hit.
+    template <typename P>
+    static void triangulate_to(
+                                const obj_corner_t* face,
+                                uint32_t size,
+                                int32_t material,
+                                P&& get_position,
+                                darray_t<obj_corner_t>& remaining,
+                                darray_t<triangle_t>& scratch,
+                                triangle_t* slots
+                              )
+    {
+        scratch.clear();
+
+        triangulate(face, size, material, get_position, remaining, scratch);
+
+        while(scratch.size() < size - 2)
+        {
+            emit_triangle(scratch, face[0], face[0], face[0], material);
+        }
+
+        std::copy(scratch.begin(), scratch.end(), slots);
+    }
+
+
+    static void rebase_triangles(triangle_t* triangles, size_t count, const geometry_sizes_t& bases)
+    {
+        // Missing normals and texcoords stay ~0, the materials are global
+        // already.
+        auto rebase = [](uint32_t index, size_t base)
+        {
+            return (index == ~0u) ? index : uint32_t(index + base);
+        };
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            for(auto& v : triangles[i].vertices)
+            {
+                v.vertex_index += bases.vertices;
+                v.normal_index = rebase(v.normal_index, bases.normals);
+                v.texcoord_index = rebase(v.texcoord_index, bases.texcoords);
+            }
+        }
+    }
+
+
+    // Fills the triangle slots counted by the scan. Polygons with corners
+    // in other chunks are deferred until all positions of the file are
+    // known.
+    static bool_t triangulate_slots(obj_chunk_t& chunk, const geometry_sizes_t& sizes)
+    {
+        darray_t<obj_corner_t> remaining;
+        darray_t<triangle_t> scratch;
+
+        chunk.triangles.resize(chunk.counts.triangles);
+
+        auto first = chunk.vertices_offset;
+        auto last = first + chunk.vertices.size();
+
+        auto get_position = [&chunk, first](int32_t index) -> const float_t*
+        {
+            return chunk.vertices[index - first].components;
+        };
+
+        size_t corner = 0;
+        size_t slot = 0;
+        auto run = chunk.materials.begin();
+
+        for(size_t i = 0; i < chunk.face_sizes.size(); ++i)
+        {
+            auto size = chunk.face_sizes[i];
+            auto face = chunk.corners.data() + corner;
+
+            while(run + 1 != chunk.materials.end() && (run + 1)->first <= i)
+            {
+                ++run;
+            }
+
+            if(size >= 3)
+            {
+                auto is_local = true;
+
+                for(auto j = 0u; j < size; ++j)
+                {
+                    if(!is_valid(face[j], sizes))
+                    {
+                        return false;
+                    }
+
+                    is_local = is_local && size_t(face[j].vertex) >= first && size_t(face[j].vertex) < last;
+                }
+
+                if(slot + size - 2 > chunk.triangles.size())
+                {
+                    return false;
+                }
+
+                if(size == 3 || is_local)
+                {
+                    triangulate_to(
+                                    face,
+                                    size,
+                                    run->second,
+                                    get_position,
+                                    remaining,
+                                    scratch,
+                                    chunk.triangles.data() + slot
+                                  );
+                }
+                else
+                {
+                    chunk.deferred.push_back({corner, slot, size, run->second});
+                }
+
+                slot += size - 2;
+            }
+
+            corner += size;
+        }
+
+        // Only the corners of the deferred polygons are kept.
+        darray_t<obj_corner_t> corners;
+
+        for(auto& deferred : chunk.deferred)
+        {
+            auto first = chunk.corners.begin() + deferred.corner;
+
+            deferred.corner = corners.size();
+            corners.insert(corners.end(), first, first + deferred.size);
+        }
+
+        chunk.corners.swap(corners);
+
+        release(chunk.face_sizes);
+
+        return slot == chunk.triangles.size();
+    }
+
+
+    // Writes count triangles starting at slot first of the chunk.
+    static error_t write_triangles(
+                                    const obj_stream_t& object,
+                                    const obj_chunk_t& chunk,
+                                    size_t first,
+                                    const triangle_t* triangles,
+                                    size_t count,
+                                    const geometry_stream_t& stream
+                                  )
+    {
+        if(count == 0)
+        {
+            return error_t::success;
+        }
+
+        return stream.write(
+                             geometry_array_t::triangles,
+                             object.bases.triangles + chunk.triangles_offset + first,
+                             triangles,
+                             count
+                           );
+    }
+
+
+    // Parses the chunk and writes out everything except the deferred
+    // polygons, the chunk keeps only what they need.
+    static error_t stream_chunk(obj_stream_t& object, obj_chunk_t& chunk, const geometry_stream_t& stream)
+    {
+        auto& source = *object.source;
+
+        auto parsed = for_each_line(chunk.begin, chunk.end, [&chunk](const char_t* p, const char_t* end)
+        {
+            return parse_line(p, end, chunk);
+        });
+
+        // The events were handled after the scan.
+        release(chunk.events);
+
+        if(
+            !parsed ||
+            chunk.vertices.size() != chunk.counts.vertices ||
+            chunk.normals.size() != chunk.counts.normals ||
+            chunk.texcoords.size() != chunk.counts.texcoords
+          )
+        {
+            log_error("Failed to parse a face in ", source.path);
+            return error_t::objects_load_fail;
+        }
+
+        if(object.has_polygons)
+        {
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), object.positions.begin() + chunk.vertices_offset);
+        }
+
+        if(!resolve_relative_indices(chunk, object.sizes) || !triangulate_slots(chunk, object.sizes))
+        {
+            log_error("Face index out of range in ", source.path);
+            return error_t::objects_load_fail;
+        }
+
+        if(source.has_transform)
+        {
+            transform_points(source.transform, chunk.vertices.data(), chunk.vertices.size());
+            transform_normals(source.transform, chunk.normals.data(), chunk.normals.size());
+        }
+
+        auto& bases = object.bases;
+
+        auto status = stream.write(
+                                    geometry_array_t::vertices,
+                                    bases.vertices + chunk.vertices_offset,
+                                    chunk.vertices.data(),
+                                    chunk.vertices.size()
+                                  );
+
+        if(status == error_t::success)
+        {
+            status = stream.write(
+                                   geometry_array_t::normals,
+                                   bases.normals + chunk.normals_offset,
+                                   chunk.normals.data(),
+                                   chunk.normals.size()
+                                 );
+        }
+
+        if(status == error_t::success)
+        {
+            status = stream.write(
+                                   geometry_array_t::texcoords,
+                                   bases.texcoords + chunk.texcoords_offset,
+                                   chunk.texcoords.data(),
+                                   chunk.texcoords.size()
+                                 );
+        }
+
+        release(chunk.vertices);
+        release(chunk.normals);
+        release(chunk.texcoords);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        rebase_triangles(chunk.triangles.data(), chunk.triangles.size(), bases);
+
+        // Everything between the deferred polygons is written now.
+        size_t first = 0;
+
+        for(auto& deferred : chunk.deferred)
+        {
+            if(status == error_t::success)
+            {
+                status = write_triangles(
+                                          object,
+                                          chunk,
+                                          first,
+                                          chunk.triangles.data() + first,
+                                          deferred.triangle - first,
+                                          stream
+                                        );
+            }
+
+            first = deferred.triangle + deferred.size - 2;
+        }
+
+        if(status == error_t::success)
+        {
+            status = write_triangles(
+                                      object,
+                                      chunk,
+                                      first,
+                                      chunk.triangles.data() + first,
+                                      chunk.triangles.size() - first,
+                                      stream
+                                    );
+        }
+
+        release(chunk.triangles);
+
+        return status;
+    }
+
+
+    static error_t stream_deferred(obj_stream_t& object, obj_chunk_t& chunk, const geometry_stream_t& stream)
+    {
+        darray_t<obj_corner_t> remaining;
+        darray_t<triangle_t> scratch;
+
+        auto get_position = [&object](int32_t index) -> const float_t*
+        {
+            return object.positions[index].components;
+        };
+
+        // Consecutive polygons are written together.
+        darray_t<triangle_t> triangles;
+        size_t first = 0;
+        auto status = error_t::success;
+
+        for(auto& deferred : chunk.deferred)
+        {
+            if(deferred.triangle != first + triangles.size())
+            {
+                status = write_triangles(object, chunk, first, triangles.data(), triangles.size(), stream);
+
+                if(status != error_t::success)
+                {
+                    return status;
+                }
+
+                first = deferred.triangle;
+                triangles.clear();
+            }
+
+            auto count = triangles.size();
+            triangles.resize(count + deferred.size - 2);
+
+            triangulate_to(
+                            chunk.corners.data() + deferred.corner,
+                            deferred.size,
+                            deferred.material,
+                            get_position,
+                            remaining,
+                            scratch,
+                            triangles.data() + count
+                          );
+
+            rebase_triangles(triangles.data() + count, deferred.size - 2, object.bases);
+        }
+
+        release(chunk.corners);
+        release(chunk.deferred);
+
+        return write_triangles(object, chunk, first, triangles.data(), triangles.size(), stream);
+    }
+
+
+    // Writes the array in slices which process can change, so little of it
+    // is copied at any time.
+    template <typename T, typename F>
+    static error_t write_slices(
+                                 geometry_array_t array,
+                                 size_t base,
+                                 const T* data,
+                                 size_t count,
+                                 F&& process,
+                                 const geometry_stream_t& stream
+                               )
+    {
+        auto slice_size = std::max<size_t>(stream_chunk_size / sizeof(T), 1);
+        darray_t<T> slice;
+
+        for(size_t first = 0; first < count; first += slice_size)
+        {
+            auto size = std::min(slice_size, count - first);
+
+            slice.assign(data + first, data + first + size);
+            process(slice);
+
+            auto status = stream.write(array, base + first, slice.data(), size);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        return error_t::success;
+    }
+
+
+    static error_t stream_cached(const obj_stream_t& object, const geometry_stream_t& stream)
+    {
+        auto& source = *object.source;
+        auto& cached = object.cached;
+        auto& sizes = cached.sizes;
+        auto& bases = object.bases;
+
+        auto status = write_slices(
+                                    geometry_array_t::vertices,
+                                    bases.vertices,
+                                    cached.vertices,
+                                    sizes.vertices,
+                                    [&source](darray_t<point3d_t>& vertices)
+                                    {
+                                        if(source.has_transform)
+                                        {
+                                            transform_points(source.transform, vertices.data(), vertices.size());
+                                        }
+                                    },
+                                    stream
+                                  );
+
+        if(status == error_t::success)
+        {
+            status = write_slices(
+                                   geometry_array_t::normals,
+                                   bases.normals,
+                                   cached.normals,
+                                   sizes.normals,
+                                   [&source](darray_t<codirection3d_t>& normals)
+                                   {
+                                       if(source.has_transform)
+                                       {
+                                           transform_normals(source.transform, normals.data(), normals.size());
+                                       }
+                                   },
+                                   stream
+                                 );
+        }
+
+        if(status == error_t::success)
+        {
+            status = write_slices(
+                                   geometry_array_t::texcoords,
+                                   bases.texcoords,
+                                   cached.texcoords,
+                                   sizes.texcoords,
+                                   [](darray_t<point2d_t>&) {},
+                                   stream
+                                 );
+        }
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        // Cached material ids index the materials of the object alone.
+        auto first_material = uint32_t(source.range.first_material);
+
+        return write_slices(
+                             geometry_array_t::triangles,
+                             bases.triangles,
+                             cached.triangles,
+                             sizes.triangles,
+                             [&bases, first_material](darray_t<triangle_t>& triangles)
+                             {
+                                 rebase_triangles(triangles.data(), triangles.size(), bases);
+
+                                 for(auto& triangle : triangles)
+                                 {
+                                     if(triangle.material_id != ~0u)
+                                     {
+                                         triangle.material_id += first_material;
+                                     }
+                                 }
+                             },
+                             stream
+                           );
+    }
+
+
+    error_t stream_objs(
+                         darray_t<scene_object_t>& objects,
+                         darray_t<material_t>& materials,
+                         const geometry_stream_t& stream
+                       )
+    {
+        auto& pool = thread_pool_t::get_global();
+        auto& cache = asset_cache_t::get_global();
+
+        deque_t<obj_stream_t> streams(objects.size());
+
+        // Cached objects are a single task without a chunk.
+        darray_t<pair_t<obj_stream_t*, obj_chunk_t*>> tasks;
+
+        for(size_t i = 0; i < objects.size(); ++i)
+        {
+            auto& object = streams[i];
+            object.source = &objects[i];
+
+            uint64_t key;
+
+            // Only found entries are used, the stream never holds a whole
+            // object to add.
+            object.is_cached = cache.is_enabled() &&
+                               cache.get_key(objects[i].path, key) &&
+                               cache.find(key, object.cached);
+
+            if(object.is_cached)
+            {
+                tasks.push_back({&object, nullptr});
+                continue;
+            }
+
+            if(!object.file.open(objects[i].path))
+            {
+                return error_t::objects_load_fail;
+            }
+
+            auto data = (const char_t*) object.file.get_data();
+            auto size = object.file.get_size();
+
+            split_chunks(data, size, std::max<size_t>(size / stream_chunk_size, 1), object.chunks);
+
+            for(auto& chunk : object.chunks)
+            {
+                tasks.push_back({&object, &chunk});
+            }
+        }
+
+        // Counting all files first lets the destination be sized once.
+        pool.parallel_for(tasks.size(), [&tasks](size_t i)
+        {
+            if(tasks[i].second == nullptr)
+            {
+                return;
+            }
+
+            auto& chunk = *tasks[i].second;
+
+            for_each_line(chunk.begin, chunk.end, [&chunk](const char_t* p, const char_t* end)
+            {
+                return scan_line(p, end, chunk);
+            });
+        });
+
+        geometry_sizes_t total;
+
+        for(size_t i = 0; i < objects.size(); ++i)
+        {
+            auto& object = streams[i];
+            auto first_material = materials.size();
+            auto& sizes = object.sizes;
+
+            if(object.is_cached)
+            {
+                auto& cached = object.cached;
+
+                sizes = cached.sizes;
+                materials.insert(materials.end(), cached.materials, cached.materials + cached.materials_count);
+            }
+
+            // Material ids index materials directly, so they need no rebase.
+            resolve_materials(object.chunks, materials);
+
+            for(auto& chunk : object.chunks)
+            {
+                chunk.vertices_offset = sizes.vertices;
+                chunk.normals_offset = sizes.normals;
+                chunk.texcoords_offset = sizes.texcoords;
+                chunk.triangles_offset = sizes.triangles;
+
+                sizes.vertices += chunk.counts.vertices;
+                sizes.normals += chunk.counts.normals;
+                sizes.texcoords += chunk.counts.texcoords;
+                sizes.triangles += chunk.counts.triangles;
+
+                object.has_polygons = object.has_polygons || chunk.polygons_count > 0;
+            }
+
+            if(object.has_polygons)
+            {
+                object.positions.resize(sizes.vertices);
+            }
+
+            object.bases = total;
+            objects[i].range = {total, sizes, first_material, materials.size() - first_material};
+
+            total.vertices += sizes.vertices;
+            total.normals += sizes.normals;
+            total.texcoords += sizes.texcoords;
+            total.triangles += sizes.triangles;
+        }
+
+        auto status = stream.reserve(total);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        darray_t<error_t> statuses(tasks.size());
+
+        // Every chunk is written out as soon as it is parsed.
+        pool.parallel_for(tasks.size(), [&tasks, &statuses, &stream](size_t i)
+        {
+            auto& [object, chunk] = tasks[i];
+
+            if(chunk)
+            {
+                statuses[i] = stream_chunk(*object, *chunk, stream);
+            }
+            else
+            {
+                statuses[i] = stream_cached(*object, stream);
+            }
+        });
+
+        for(auto status : statuses)
+        {
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        pool.parallel_for(tasks.size(), [&tasks, &statuses, &stream](size_t i)
+        {
+            auto chunk = tasks[i].second;
+
+            if(chunk && !chunk->deferred.empty())
+            {
+                statuses[i] = stream_deferred(*tasks[i].first, *chunk, stream);
+            }
+        });
+
+        for(auto status : statuses)
+        {
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        return error_t::success;
+    }
+}
@@ -0,0 +1,60 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef OBJ_PARSER_HPP
+#define OBJ_PARSER_HPP
+
+#include <common.hpp>
+#include <error.hpp>
+
+#include "geometry_stream.hpp"
+#include "scene.hpp"
+
+namespace bpmap
+{
+    // Contents of a Wavefront OBJ file with all faces triangulated. Indices
+    // are zero based into the arrays of the file, missing normal or texcoord
+    // indices and faces without a material are ~0.
+    struct obj_t
+    {
+        darray_t<point3d_t> vertices;
+        darray_t<codirection3d_t> normals;
+        darray_t<point2d_t> texcoords;
+        darray_t<triangle_t> triangles;
+        darray_t<material_t> materials;
+    };
+
+    // Maps the file and parses it on the global thread pool. The result is
+    // the same as what tinyobj produces with triangulation on, material
+    // libraries are looked up relative to the working directory.
+    error_t load_obj(const string_t& path, obj_t& obj);
+
+    // Parses the objects one after another into the stream, with the same
+    // result as loading each with load_obj, transforming it and appending it
+    // to the scene. The materials are appended to materials and the ranges
+    // of the objects are filled in. Polygons which ear clipping can't fully
+    // split are padded with degenerate triangles since the triangle count is
+    // fixed before the parsing.
+    error_t stream_objs(
+                         darray_t<scene_object_t>& objects,
+                         darray_t<material_t>& materials,
+                         const geometry_stream_t& stream
+                       );
+}
+
+#endif // OBJ_PARSER_HPP
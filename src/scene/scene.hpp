@@ -23,6 +23,8 @@
 #include <common.hpp>
 
 #include "geometry.hpp"
+#include "geometry_stream.hpp"
+#include "light_bvh.hpp"
 #include "lights.hpp"
 #include "material.hpp"
 
@@ -41,6 +43,41 @@ namespace bpmap
         float_t far;
     };
 
+    // How the samples of a pixel are placed, raytrace.comp matches the
+    // values.
+    enum class sample_pattern_t : uint32_t
+    {
+        // Owen scrambled Sobol, decorrelated per pixel.
+        sobol,
+        // One Sobol sequence for all pixels, shifted per pixel by blue noise
+        // so the error at low sample counts is blue noise too.
+        blue_noise
+    };
+
+    // How a shading point picks the light of a light sample.
+    enum class light_selection_t : uint32_t
+    {
+        // By the contribution the light hierarchy estimates at the point.
+        bvh,
+        // By flux, from the alias table.
+        power,
+        uniform
+    };
+
+    // How the light samples of the primary hits are resampled,
+    // raytrace.comp matches the values.
+    enum class light_resampling_t : uint32_t
+    {
+        // Every light sample takes a shadow ray.
+        none,
+        // The samples are candidates, one of them kept in a reservoir takes
+        // the shadow ray.
+        ris,
+        // Like ris, then the reservoir is resampled with the one the pixel
+        // kept for its last sample and with the ones of its neighbours.
+        spatiotemporal
+    };
+
     struct scene_settings_t
     {
         camera_t camera;
@@ -50,9 +87,34 @@ namespace bpmap
         uint32_t max_reflection_bounces;
         uint32_t resolution_x;
         uint32_t resolution_y;
+        sample_pattern_t sample_pattern;
+        light_selection_t light_selection;
+
+        // Size of the environment map, zero without one.
+        uint32_t environment_width;
+        uint32_t environment_height;
+        float_t environment_intensity;
+
+        // Samples are taken in batches of this many, zero means all at once.
+        // After each batch the tiles whose relative error is below
+        // adaptive_threshold stop, zero keeps all until samples_per_pixel.
+        uint32_t samples_per_batch;
+        float_t adaptive_threshold;
+
+        light_resampling_t light_resampling;
         uint32_t pad[3];
     };
 
+    // An object of a scene description.
+    struct scene_object_t
+    {
+        string_t path;
+        bool_t has_transform = false;
+        transform3d_embedded_t transform;
+
+        geometry_range_t range;
+    };
+
     struct scene_t
     {
         // Holds all the visible objects in the scene each of which references
@@ -69,8 +131,23 @@ namespace bpmap
         darray_t<material_t> materials;
 
         darray_t<light_t> lights;
+        darray_t<light_alias_t> light_aliases;
+        darray_t<light_bvh_node_t> light_bvh;
+        darray_t<light_trail_t> light_trails;
+
+        // Equirectangular map of the light arriving from far away, rows from
+        // the top. Row zero looks along +y and the middle column along +x.
+        darray_t<color3df_t> environment;
+        // The table over the rows, then the table of each row.
+        darray_t<light_alias_t> environment_aliases;
 
         scene_settings_t settings;
+
+        // The objects of the scene description in load order, used to reload
+        // them in place. Binary scenes have none.
+        darray_t<scene_object_t> sources;
+        // The EXR the environment was read from, binary scenes have none.
+        string_t environment_path;
     };
 }
 
@@ -0,0 +1,126 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <io.hpp>
+
+#include "scene_benchmark.hpp"
+#include "scene_loader.hpp"
+
+namespace bpmap
+{
+    static void append(darray_t<uint8_t>& text, string_view_t part)
+    {
+        text.insert(text.end(), part.begin(), part.end());
+    }
+
+    static darray_t<uint8_t> generate_scene_description(size_t objects, size_t lights)
+    {
+        darray_t<uint8_t> text;
+
+        append(text, "[objects]\n");
+
+        for(size_t i = 0; i < objects; ++i)
+        {
+            auto n = std::to_string(i);
+
+            append(text, "objp" + n + " = objects/object" + n + ".obj\n");
+
+            if(i % 2)
+            {
+                append(text, "objt" + n + " = 1 0 0 " + std::to_string(i % 100) + ".5  0 1 0 -2.25  0 0 1 0.125\n");
+            }
+        }
+
+        append(text, "\n[camera]\n");
+        append(text, "up = 0.0 1.0 0.0\n");
+        append(text, "left = 0.0 0.0 -1.0\n");
+        append(text, "lookat = -1.0 0.0 0.0\n");
+        append(text, "origin = 5.0 0.0 1.0\n");
+        append(text, "aspect_ratio = 1.77\n");
+        append(text, "near = -10.0\n");
+        append(text, "far = 100.0\n");
+        append(text, "fov = 120.0\n");
+
+        append(text, "\n[lights]\n");
+
+        for(size_t i = 0; i < lights; ++i)
+        {
+            auto n = std::to_string(i);
+
+            append(text, "point" + n + " = " + std::to_string(i % 50) + ".0 5.0 0.0\n");
+            append(text, "normal" + n + " = -1.0 -1.0 -1.0\n");
+            append(text, "basis_vec0" + n + " = 1.0 0.0 0.0\n");
+            append(text, "basis_vec1" + n + " = 0.0 1.0 0.0\n");
+            append(text, "color" + n + " = 1.0 0.5 0.25\n");
+            append(text, "param0_max" + n + " = 10.0\n");
+            append(text, "param1_max" + n + " = 10.0\n");
+            append(text, "power" + n + " = 400.0\n");
+        }
+
+        append(text, "\n[settings]\n");
+        append(text, "resolution_x = 1280\n");
+        append(text, "resolution_y = 720\n");
+        append(text, "samples_per_pixel = 1\n");
+        append(text, "light_samples = 128\n");
+        append(text, "max_reflection_bounces = 1\n");
+
+        return text;
+    }
+
+    error_t benchmark_scene_description(size_t objects, size_t lights, size_t runs)
+    {
+        using clock_t = std::chrono::steady_clock;
+
+        auto text = generate_scene_description(objects, lights);
+        auto best = std::numeric_limits<double_t>::max();
+
+        for(size_t i = 0; i < runs; ++i)
+        {
+            scene_t scene;
+
+            auto start = clock_t::now();
+            auto status = load_scene_description(string_view_t((const char_t*) text.data(), text.size()), scene);
+            auto elapsed = std::chrono::duration<double_t, std::milli>(clock_t::now() - start).count();
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            if(scene.sources.size() != objects || scene.lights.size() != lights)
+            {
+                log_error("The generated scene read back ", scene.sources.size(), " objects and ",
+                          scene.lights.size(), " lights");
+                return error_t::objects_load_fail;
+            }
+
+            best = std::min(best, elapsed);
+        }
+
+        log(
+             "Scene description with ", objects, " objects and ", lights, " lights (",
+             text.size() / 1024, " KiB): ", best, " ms, best of ", runs
+           );
+
+        return error_t::success;
+    }
+}
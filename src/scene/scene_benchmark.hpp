@@ -0,0 +1,33 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SCENE_BENCHMARK_HPP
+#define SCENE_BENCHMARK_HPP
+
+#include <common.hpp>
+#include <error.hpp>
+
+namespace bpmap
+{
+    // Generates a description with the given numbers of objects, every
+    // other one with a transform, and lights, then logs how long reading
+    // it takes. No OBJ files are read.
+    error_t benchmark_scene_description(size_t objects, size_t lights, size_t runs = 5);
+}
+
+#endif // SCENE_BENCHMARK_HPP
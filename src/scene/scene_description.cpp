@@ -0,0 +1,240 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <charconv>
+
+#include "scene_description.hpp"
+
+namespace bpmap
+{
+    static bool_t is_blank(char_t c)
+    {
+        return (unsigned char) c <= ' ';
+    }
+
+    static string_view_t trim(string_view_t text)
+    {
+        while(!text.empty() && is_blank(text.front()))
+        {
+            text.remove_prefix(1);
+        }
+
+        while(!text.empty() && is_blank(text.back()))
+        {
+            text.remove_suffix(1);
+        }
+
+        return text;
+    }
+
+    static char_t to_lower(char_t c)
+    {
+        return (c >= 'A' && c <= 'Z') ? char_t(c - 'A' + 'a') : c;
+    }
+
+    static bool_t is_same_name(string_view_t a, string_view_t b)
+    {
+        if(a.size() != b.size())
+        {
+            return false;
+        }
+
+        for(size_t i = 0; i < a.size(); ++i)
+        {
+            if(to_lower(a[i]) != to_lower(b[i]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    string_view_t description_section_t::get_value(string_view_t name) const
+    {
+        for(auto& property : properties)
+        {
+            if(is_same_name(property.name, name))
+            {
+                return property.value;
+            }
+        }
+
+        return {};
+    }
+
+
+    scene_description_t::scene_description_t() :
+        sections(arena)
+    {
+    }
+
+
+    void scene_description_t::parse(string_view_t text)
+    {
+        sections.clear();
+
+        // The tables take about as much memory as the text, reserving that
+        // keeps most descriptions in one block.
+        arena.reserve(text.size());
+        sections = arena_array_t<description_section_t>(arena);
+        sections.push_back({{}, arena_array_t<description_property_t>(arena)});
+
+        while(!text.empty())
+        {
+            auto line_end = text.find('\n');
+            auto line = text.substr(0, line_end);
+            text.remove_prefix(line_end == string_view_t::npos ? text.size() : line_end + 1);
+
+            line = trim(line);
+
+            if(line.empty() || line.front() == ';')
+            {
+                continue;
+            }
+
+            if(line.front() == '[')
+            {
+                auto close = line.find(']');
+
+                if(close != string_view_t::npos)
+                {
+                    sections.push_back(
+                    {
+                        line.substr(1, close - 1),
+                        arena_array_t<description_property_t>(arena)
+                    });
+                }
+
+                continue;
+            }
+
+            auto equals = line.find('=');
+
+            if(equals != string_view_t::npos)
+            {
+                sections.back().properties.push_back(
+                {
+                    trim(line.substr(0, equals)),
+                    trim(line.substr(equals + 1))
+                });
+            }
+        }
+    }
+
+
+    const description_section_t* scene_description_t::find_section(string_view_t name) const
+    {
+        for(auto& section : sections)
+        {
+            if(is_same_name(section.name, name))
+            {
+                return &section;
+            }
+        }
+
+        return nullptr;
+    }
+
+
+    bool_t parse_indexed_name(string_view_t name, string_view_t key, size_t& index)
+    {
+        if(name.size() <= key.size() || !is_same_name(name.substr(0, key.size()), key))
+        {
+            return false;
+        }
+
+        auto digits = name.substr(key.size());
+
+        // Leading zeros would name the same object twice.
+        if(digits.size() > 1 && digits.front() == '0')
+        {
+            return false;
+        }
+
+        auto end = digits.data() + digits.size();
+        auto [last, error] = std::from_chars(digits.data(), end, index);
+
+        return error == std::errc() && last == end;
+    }
+
+
+    // from_chars takes neither leading whitespace nor a plus sign.
+    static const char_t* skip_to_number(string_view_t text)
+    {
+        auto p = text.data();
+        auto end = p + text.size();
+
+        while(p != end && is_blank(*p))
+        {
+            ++p;
+        }
+
+        // A sign after the plus isn't a number for strtof either.
+        if(p != end && *p == '+' && (p + 1 == end || p[1] != '-'))
+        {
+            ++p;
+        }
+
+        return p;
+    }
+
+    bool_t parse_real(string_view_t& text, float_t& value)
+    {
+        auto end = text.data() + text.size();
+        auto [last, error] = std::from_chars(skip_to_number(text), end, value);
+
+        if(error != std::errc())
+        {
+            return false;
+        }
+
+        text.remove_prefix(last - text.data());
+
+        return true;
+    }
+
+    bool_t parse_unsigned(string_view_t& text, uint32_t& value)
+    {
+        auto end = text.data() + text.size();
+        auto [last, error] = std::from_chars(skip_to_number(text), end, value);
+
+        if(error != std::errc())
+        {
+            return false;
+        }
+
+        text.remove_prefix(last - text.data());
+
+        return true;
+    }
+
+    bool_t parse_reals(string_view_t text, float_t* values, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(!parse_real(text, values[i]))
+            {
+                return false;
+            }
+        }
+
+        return trim(text).empty();
+    }
+}
@@ -0,0 +1,78 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SCENE_DESCRIPTION_HPP
+#define SCENE_DESCRIPTION_HPP
+
+#include <common.hpp>
+#include <arena.hpp>
+
+namespace bpmap
+{
+    struct description_property_t
+    {
+        string_view_t name;
+        string_view_t value;
+    };
+
+    struct description_section_t
+    {
+        string_view_t name;
+        arena_array_t<description_property_t> properties;
+
+        // Value of the first property called name, empty if there is none.
+        string_view_t get_value(string_view_t name) const;
+    };
+
+    // An ini like scene description split into sections and properties in
+    // a single pass. Names are compared ignoring case, like ini.h did, and
+    // everything points into the parsed text which has to outlive it.
+    class scene_description_t
+    {
+        monotonic_arena_t arena;
+
+        // The first section holds the properties before any section.
+        arena_array_t<description_section_t> sections;
+
+    public:
+        scene_description_t();
+
+        void parse(string_view_t text);
+
+        const description_section_t* find_section(string_view_t name) const;
+
+        // The tables are allocated here, readers can put their temporaries
+        // here too. Parsing again frees all of it.
+        monotonic_arena_t& get_arena() { return arena; }
+    };
+
+    // Matches key followed by a decimal index written like std::to_string
+    // does, so basis_vec01 is basis_vec0 of the light 1.
+    bool_t parse_indexed_name(string_view_t name, string_view_t key, size_t& index);
+
+    // Parse the number at the start of text like strtof and strtoul and
+    // move text past it. Nothing is allocated. Return false if there is no
+    // number.
+    bool_t parse_real(string_view_t& text, float_t& value);
+    bool_t parse_unsigned(string_view_t& text, uint32_t& value);
+
+    // Parses count reals separated by whitespace, nothing else may follow.
+    bool_t parse_reals(string_view_t text, float_t* values, size_t count);
+}
+
+#endif // SCENE_DESCRIPTION_HPP
@@ -15,78 +15,220 @@
 // You should have received a copy of the GNU General Public License
 // along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <cctype>
+#include <algorithm>
 #include <cstring>
-#include <cstdlib>
-#include <sstream>
+#include <mutex>
 
 #include <io.hpp>
 #include <algebra.hpp>
-
-#define INI_IMPLEMENTATION
-#define TINYOBJLOADER_IMPLEMENTATION
-
-#include <ini.h>
-#include <tiny_obj_loader.h>
-
+#include <batch_transform.hpp>
+#include <thread_pool.hpp>
+
+#include "asset_cache.hpp"
+#include "binary_scene.hpp"
+#include "environment.hpp"
+#include "obj_parser.hpp"
+#include "scene_description.hpp"
 #include "scene_loader.hpp"
 
 
 namespace bpmap
 {
-    darray_t<string_t> split(const string_t& str, char_t delim)
+    static void build_light_tables(scene_t& scene)
     {
-        darray_t<string_t> result;
+        build_light_aliases(scene.lights, scene.light_aliases);
+        build_light_bvh(scene.lights, scene.light_bvh, scene.light_trails);
+    }
 
-        std::stringstream ss(str);
+    // Finds the triangles of emissive materials while the geometry goes
+    // past and makes them lights. Streamed positions are only kept when some
+    // material emits and only until the lights are made.
+    class emission_collector_t
+    {
+        const darray_t<material_t>* materials = nullptr;
+        const point3d_t* positions = nullptr;
+        darray_t<point3d_t> streamed_positions;
 
-        string_t tmp;
+        // With their indices, since the writes come in no particular order.
+        darray_t<pair_t<size_t, triangle_t>> triangles;
+        std::mutex mutex;
 
-        while(std::getline(ss,tmp, delim))
+        bool_t is_emissive_triangle(const triangle_t& triangle) const
         {
-            result.push_back(tmp);
+            return triangle.material_id != ~0u && is_emissive((*materials)[triangle.material_id]);
         }
 
-        return result;
-    }
+        void collect(geometry_array_t array, size_t first, const void* data, size_t count)
+        {
+            if(array == geometry_array_t::vertices)
+            {
+                memcpy(streamed_positions.data() + first, data, count * sizeof(point3d_t));
+                return;
+            }
+
+            if(array != geometry_array_t::triangles)
+            {
+                return;
+            }
+
+            auto written = static_cast<const triangle_t*>(data);
+            darray_t<pair_t<size_t, triangle_t>> emissive;
+
+            for(size_t i = 0; i < count; ++i)
+            {
+                if(is_emissive_triangle(written[i]))
+                {
+                    emissive.push_back({first + i, written[i]});
+                }
+            }
+
+            if(!emissive.empty())
+            {
+                std::lock_guard lock(mutex);
+                triangles.insert(triangles.end(), emissive.begin(), emissive.end());
+            }
+        }
+
+    public:
+        // The materials are complete by the time the geometry is reserved.
+        geometry_stream_t wrap(const geometry_stream_t& stream, const darray_t<material_t>& stream_materials)
+        {
+            materials = &stream_materials;
+
+            geometry_stream_t wrapped;
+
+            wrapped.reserve = [this, &stream](const geometry_sizes_t& sizes)
+            {
+                if(std::any_of(materials->begin(), materials->end(), is_emissive))
+                {
+                    streamed_positions.resize(sizes.vertices);
+                    positions = streamed_positions.data();
+                }
+
+                return stream.reserve(sizes);
+            };
+
+            wrapped.write = [this, &stream](geometry_array_t array, size_t first, const void* data, size_t count)
+            {
+                if(positions)
+                {
+                    collect(array, first, data, count);
+                }
+
+                return stream.write(array, first, data, count);
+            };
+
+            return wrapped;
+        }
+
+        // Same for geometry which is already on the host.
+        void collect_loaded(
+                             const darray_t<point3d_t>& vertices,
+                             const darray_t<triangle_t>& loaded_triangles,
+                             const darray_t<material_t>& loaded_materials
+                           )
+        {
+            materials = &loaded_materials;
+            positions = vertices.data();
+
+            for(size_t i = 0; i < loaded_triangles.size(); ++i)
+            {
+                if(is_emissive_triangle(loaded_triangles[i]))
+                {
+                    triangles.push_back({i, loaded_triangles[i]});
+                }
+            }
+        }
+
+        // Appends the lights in triangle order and sets the light ranges of
+        // the objects, whose triangle ranges index the collected geometry.
+        void add_lights(darray_t<scene_object_t>& objects, darray_t<light_t>& lights)
+        {
+            std::sort(triangles.begin(), triangles.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+            auto triangle = triangles.begin();
+
+            for(auto& object : objects)
+            {
+                auto& range = object.range;
+                auto end = range.first.triangles + range.sizes.triangles;
+
+                range.first_light = lights.size();
+
+                for(; triangle != triangles.end() && triangle->first < end; ++triangle)
+                {
+                    auto& indices = triangle->second.vertices;
+
+                    point3d_t corners[3] =
+                    {
+                        positions[indices[0].vertex_index],
+                        positions[indices[1].vertex_index],
+                        positions[indices[2].vertex_index]
+                    };
+
+                    lights.push_back(make_triangle_light(corners, (*materials)[triangle->second.material_id].emission));
+                }
+
+                range.lights_count = lights.size() - range.first_light;
+            }
+
+            positions = nullptr;
+            streamed_positions = {};
+            triangles = {};
+        }
+    };
+
 
     class scene_loader_t
     {
-        ini_t* parsed;
+        scene_description_t description;
         scene_t* scene;
+        const geometry_stream_t* stream;
+        bool_t load_geometry;
         error_t success;
 
     public:
         error_t is_loaded() { return success; }
 
-        scene_loader_t(const darray_t<uint8_t>& sd, scene_t& s)
+        // With a stream the geometry goes there and the geometry arrays of
+        // the scene stay empty. Without geometry only the list of objects is
+        // read.
+        scene_loader_t(
+                        string_view_t text,
+                        scene_t& s,
+                        const geometry_stream_t* geometry_stream = nullptr,
+                        bool_t with_geometry = true
+                      )
         {
             scene = &s;
+            stream = geometry_stream;
+            load_geometry = with_geometry;
             success = error_t::success;
 
-            parsed = ini_load((const char_t*) sd.data(), nullptr);
+            description.parse(text);
 
-            if(!parsed)
+            success = load_settings();
+
+            if(success != error_t::success)
             {
-                success = error_t::scene_settings_read_fail;
                 return;
             }
 
-            success = load_settings();
+            success = load_camera();
 
             if(success != error_t::success)
             {
                 return;
             }
 
-            success = load_camera();
+            success = load_lights();
 
             if(success != error_t::success)
             {
                 return;
             }
 
-            success = load_lights();
+            success = load_environment();
 
             if(success != error_t::success)
             {
@@ -100,41 +242,102 @@ namespace bpmap
                 return;
             }
 
-        }
+            // Without the geometry only the described lights are known.
+            if(!load_geometry)
+            {
+                return;
+            }
 
-        ~scene_loader_t()
-        {
-            ini_destroy(parsed);
+            // The environment can light a scene alone.
+            if(scene->lights.empty() && scene->environment.empty())
+            {
+                success = error_t::lights_load_fail;
+                return;
+            }
+
+            build_light_tables(*scene);
         }
 
     private:
 
         error_t load_settings()
         {
-            static constexpr const char* global_settings_section_name = "settings";
+            auto section = description.find_section("settings");
+
+            if(!section)
+            {
+                return error_t::global_settings_load_fail;
+            }
+
+            auto& settings = scene->settings;
 
-            auto global_settings_section = ini_find_section(
-                                                             parsed,
-                                                             global_settings_section_name,
-                                                             strlen(global_settings_section_name)
-                                                           );
+            // Missing values read as zero.
+            settings.resolution_x = parse_unsigned(section->get_value("resolution_x"));
+            settings.resolution_y = parse_unsigned(section->get_value("resolution_y"));
+            settings.samples_per_pixel = parse_unsigned(section->get_value("samples_per_pixel"));
+            settings.light_samples = parse_unsigned(section->get_value("light_samples"));
+            settings.max_reflection_bounces = parse_unsigned(section->get_value("max_reflection_bounces"));
+            settings.samples_per_batch = parse_unsigned(section->get_value("samples_per_batch"));
+            settings.adaptive_threshold = parse_real(section->get_value("adaptive_threshold"));
 
-            if(global_settings_section == INI_NOT_FOUND)
+            auto sample_pattern = section->get_value("sample_pattern");
+
+            if(sample_pattern.empty() || sample_pattern == "sobol")
+            {
+                settings.sample_pattern = sample_pattern_t::sobol;
+            }
+            else if(sample_pattern == "blue_noise")
+            {
+                settings.sample_pattern = sample_pattern_t::blue_noise;
+            }
+            else
             {
+                log_error("Unknown sample_pattern: ", sample_pattern);
+
                 return error_t::global_settings_load_fail;
             }
 
-            auto resolution_x = get_value(global_settings_section, "resolution_x");
-            auto resolution_y = get_value(global_settings_section, "resolution_y");
-            auto samples_per_pixel = get_value(global_settings_section, "samples_per_pixel");
-            auto light_samples = get_value(global_settings_section, "light_samples");
-            auto max_reflection_bounces = get_value(global_settings_section, "max_reflection_bounces");
+            auto light_selection = section->get_value("light_selection");
 
-            scene->settings.resolution_x = strtof(resolution_x.c_str(), nullptr);
-            scene->settings.resolution_y = strtof(resolution_y.c_str(), nullptr);
-            scene->settings.samples_per_pixel = strtoul(samples_per_pixel.c_str(), nullptr, 10);
-            scene->settings.light_samples =  strtoul(light_samples.c_str(), nullptr, 10);
-            scene->settings.max_reflection_bounces =  strtoul(max_reflection_bounces.c_str(), nullptr, 10);
+            if(light_selection.empty() || light_selection == "bvh")
+            {
+                settings.light_selection = light_selection_t::bvh;
+            }
+            else if(light_selection == "power")
+            {
+                settings.light_selection = light_selection_t::power;
+            }
+            else if(light_selection == "uniform")
+            {
+                settings.light_selection = light_selection_t::uniform;
+            }
+            else
+            {
+                log_error("Unknown light_selection: ", light_selection);
+
+                return error_t::global_settings_load_fail;
+            }
+
+            auto light_resampling = section->get_value("light_resampling");
+
+            if(light_resampling.empty() || light_resampling == "none")
+            {
+                settings.light_resampling = light_resampling_t::none;
+            }
+            else if(light_resampling == "ris")
+            {
+                settings.light_resampling = light_resampling_t::ris;
+            }
+            else if(light_resampling == "spatiotemporal")
+            {
+                settings.light_resampling = light_resampling_t::spatiotemporal;
+            }
+            else
+            {
+                log_error("Unknown light_resampling: ", light_resampling);
+
+                return error_t::global_settings_load_fail;
+            }
 
             return error_t::success;
         }
@@ -142,131 +345,272 @@ namespace bpmap
 
         error_t load_lights()
         {
-            static constexpr const char* lightsectn = "lights";
-
-            auto lights_section = ini_find_section(parsed, lightsectn, strlen(lightsectn));
+            auto section = description.find_section("lights");
 
-            if(lights_section == INI_NOT_FOUND)
+            // Scenes can be lit by their emissive objects alone.
+            if(!section)
             {
-                return error_t::lights_load_fail;
+                return error_t::success;
             }
 
-            static constexpr const char* point_of_rect_light = "point";
-            static constexpr const char* normal_of_rect_light = "normal";
-            static constexpr const char* parameter0_max_of_rect_light = "param0_max";
-            static constexpr const char* parameter1_max_of_rect_light = "param1_max";
-            static constexpr const char* basis_vec0_of_rect_light = "basis_vec0";
-            static constexpr const char* basis_vec1_of_rect_light = "basis_vec1";
-            static constexpr const char* color_of_rect_ligth = "color";
-            static constexpr const char* power_of_rect_light = "power";
+            enum light_field_t : uint32_t
+            {
+                point,
+                normal,
+                basis_vec0,
+                basis_vec1,
+                color,
+                param0_max,
+                param1_max,
+                power,
+                fields_count
+            };
+
+            static constexpr array_t<const char_t*, fields_count> keys =
+            {
+                "point",
+                "normal",
+                "basis_vec0",
+                "basis_vec1",
+                "color",
+                "param0_max",
+                "param1_max",
+                "power"
+            };
+
+            struct indexed_light_t
+            {
+                light_t light = {};
+                uint32_t fields = 0;
+            };
 
+            // The properties are visited once, each one lands in the light
+            // its name indexes.
+            arena_array_t<indexed_light_t> lights(description.get_arena());
 
-            for(auto i = 0; ; ++i)
+            for(auto& property : section->properties)
             {
-                auto light_number = std::to_string(i);
+                for(uint32_t field = 0; field < fields_count; ++field)
+                {
+                    size_t i;
+
+                    // Lights past the property count can't be complete.
+                    if(
+                        !parse_indexed_name(property.name, keys[field], i) ||
+                        i >= section->properties.size()
+                      )
+                    {
+                        continue;
+                    }
+
+                    if(i >= lights.size())
+                    {
+                        lights.resize(i + 1);
+                    }
+
+                    auto& indexed = lights[i];
+                    auto& light = indexed.light;
+                    auto bit = 1u << field;
+
+                    // The first property wins, like it did with ini.h.
+                    if(indexed.fields & bit)
+                    {
+                        break;
+                    }
+
+                    indexed.fields |= bit;
+
+                    switch(field)
+                    {
+                        case point: light.point = parse_point(property.value); break;
+                        case normal: light.normal = parse_point(property.value); break;
+                        case basis_vec0: light.basis_vec0 = parse_point(property.value); break;
+                        case basis_vec1: light.basis_vec1 = parse_point(property.value); break;
+                        case color: light.color = parse_point(property.value); break;
+                        case param0_max: light.param0_max = parse_real(property.value); break;
+                        case param1_max: light.param1_max = parse_real(property.value); break;
+                        case power: light.power = parse_real(property.value); break;
+                    }
+
+                    break;
+                }
+            }
 
-                auto point = get_value(lights_section, point_of_rect_light + light_number);
-                auto normal = get_value(lights_section, normal_of_rect_light + light_number);
-                auto param0_max = get_value(lights_section, parameter0_max_of_rect_light + light_number);
-                auto param1_max = get_value(lights_section, parameter1_max_of_rect_light + light_number);
-                auto basis0 = get_value(lights_section, basis_vec0_of_rect_light + light_number);
-                auto basis1 = get_value(lights_section, basis_vec1_of_rect_light + light_number);
-                auto color = get_value(lights_section, color_of_rect_ligth + light_number);
-                auto power = get_value(lights_section, power_of_rect_light + light_number);
+            // The lights end at the first one with missing properties.
+            static constexpr uint32_t all_fields = (1u << fields_count) - 1;
 
-                if(
-                    point.empty() ||
-                    normal.empty() ||
-                    param0_max.empty() ||
-                    param1_max.empty() ||
-                    basis0.empty() ||
-                    basis1.empty() ||
-                    color.empty() ||
-                    power.empty()
-                  )
+            scene->lights.reserve(lights.size());
+
+            for(auto& indexed : lights)
+            {
+                if(indexed.fields != all_fields)
                 {
                     break;
                 }
 
-                light_t light;
-                light.point = parse_point(point);
-                light.normal = parse_point(normal);
-                light.basis_vec0 = parse_point(basis0);
-                light.basis_vec1 = parse_point(basis1);
-                light.color = parse_point(color);
-                light.param0_max = strtof(param0_max.c_str(), nullptr);
-                light.param1_max = strtof(param1_max.c_str(), nullptr);
-                light.power = strtof(power.c_str(), nullptr);
+                scene->lights.push_back(indexed.light);
+            }
+
+            return error_t::success;
+        }
+
 
-                scene->lights.push_back(light);
+        error_t load_environment()
+        {
+            auto section = description.find_section("environment");
+
+            auto& settings = scene->settings;
+            settings.environment_width = 0;
+            settings.environment_height = 0;
+            settings.environment_intensity = 1.0f;
+
+            if(!section)
+            {
+                return error_t::success;
             }
 
-            if(scene->lights.empty())
+            scene->environment_path = section->get_value("path");
+
+            if(scene->environment_path.empty())
             {
-                return error_t::lights_load_fail;
+                log_error("The environment has no path");
+                return error_t::environment_load_fail;
             }
 
-            return error_t::success;
+            auto intensity = section->get_value("intensity");
+
+            if(!intensity.empty())
+            {
+                settings.environment_intensity = parse_real(intensity);
+            }
+
+            if(!load_geometry)
+            {
+                return error_t::success;
+            }
+
+            return bpmap::load_environment(scene->environment_path, *scene);
         }
 
 
         error_t load_objects()
         {
-            static constexpr const char* objsectn = "objects";
-
-            auto objects_section = ini_find_section(parsed, objsectn, strlen(objsectn));
+            auto section = description.find_section("objects");
 
-            if(objects_section == INI_NOT_FOUND)
+            if(!section)
             {
                 return error_t::objects_load_fail;
             }
 
-            string_t path_of_object = "objp";
-            string_t transform_of_object = "objt";
+            struct indexed_object_t
+            {
+                string_view_t path;
+                string_view_t transform;
+                bool_t has_path = false;
+                bool_t has_transform = false;
+            };
 
-            darray_t<pair_t<string_t, string_t>> objects;
+            arena_array_t<indexed_object_t> indexed(description.get_arena());
 
-            for(auto i = 0; ; ++i)
+            for(auto& property : section->properties)
             {
-                auto obj_number = std::to_string(i);
+                size_t i;
+                auto is_path = parse_indexed_name(property.name, "objp", i);
+
+                if(!is_path && !parse_indexed_name(property.name, "objt", i))
+                {
+                    continue;
+                }
 
-                auto obj_path_id = ini_find_property(
-                                                      parsed,
-                                                      objects_section,
-                                                      (path_of_object + obj_number).c_str(),
-                                                      path_of_object.size() + obj_number.size()
-                                                    );
+                // Objects past the property count have no path before them.
+                if(i >= section->properties.size())
+                {
+                    continue;
+                }
 
-                if(obj_path_id == INI_NOT_FOUND)
+                if(i >= indexed.size())
+                {
+                    indexed.resize(i + 1);
+                }
+
+                auto& object = indexed[i];
+
+                if(is_path && !object.has_path)
+                {
+                    object.path = property.value;
+                    object.has_path = true;
+                }
+                else if(!is_path && !object.has_transform)
+                {
+                    object.transform = property.value;
+                    object.has_transform = true;
+                }
+            }
+
+            auto& objects = scene->sources;
+            objects.clear();
+            objects.reserve(indexed.size());
+
+            // The objects end at the first index without a path.
+            for(auto& entry : indexed)
+            {
+                if(!entry.has_path)
                 {
                     break;
                 }
 
-                string_t obj_path = ini_property_value(parsed, objects_section, obj_path_id);
+                auto& object = objects.emplace_back();
+                object.path = entry.path;
+
+                // Objects without a transform are used as they are.
+                object.has_transform = !entry.transform.empty();
+
+                if(object.has_transform && !parse_reals(entry.transform, object.transform.components, 12))
+                {
+                    log_error("Invalid transform for ", entry.path, ": ", entry.transform);
+                    return error_t::objects_load_fail;
+                }
 
-                auto obj_transform_id = ini_find_property(
-                                                           parsed,
-                                                           objects_section,
-                                                           (transform_of_object + obj_number).c_str(),
-                                                           transform_of_object.size() + obj_number.size()
-                                                         );
+                // objtN holds the upper 3x4 part of a row major affine
+                // transform.
+                if(object.has_transform)
+                {
+                    auto& components = object.transform.components;
+                    std::fill(components + 12, components + 16, 0.0f);
+                    components[15] = 1.0f;
+                }
+            }
 
-                auto transform = ini_property_value(parsed, objects_section, obj_transform_id);
-                string_t obj_transform = (transform)? transform : "";
+            if(!load_geometry)
+            {
+                return error_t::success;
+            }
 
-                objects.push_back(std::make_pair(obj_path, obj_transform));
+            if(stream)
+            {
+                return stream_objects(objects);
             }
 
-            for(auto& path_transform_pair: objects)
+            darray_t<obj_t> loaded(objects.size());
+            darray_t<error_t> statuses(objects.size());
+
+            // Objects are loaded concurrently, each one parses in parallel
+            // too which balances a few large objects against many small ones.
+            thread_pool_t::get_global().parallel_for(objects.size(), [&](size_t i)
             {
-                auto status = parse_object(path_transform_pair.first, path_transform_pair.second);
+                statuses[i] = load_object(objects[i], loaded[i]);
+            });
 
+            for(auto status : statuses)
+            {
                 if(status != error_t::success)
                 {
                     return status;
                 }
             }
 
+            merge_objects(loaded);
+
             if(
                  scene->triangles.empty() ||
                  scene->vertices.empty() ||
@@ -276,167 +620,760 @@ namespace bpmap
                 return error_t::objects_load_fail;
             }
 
+            emission_collector_t emission;
+            emission.collect_loaded(scene->vertices, scene->triangles, scene->materials);
+            emission.add_lights(objects, scene->lights);
+
             return error_t::success;
         }
 
-        error_t parse_object(const string_t& path, const string_t& transform)
+        error_t load_object(const scene_object_t& object, obj_t& obj)
         {
-            string_t err;
+            auto status = asset_cache_t::get_global().load_obj(object.path, obj);
 
-            tinyobj::attrib_t attributes;
-            darray_t<tinyobj::material_t> materials;
-            darray_t<tinyobj::shape_t> shapes;
+            if(status != error_t::success)
+            {
+                return status;
+            }
 
-            if(!tinyobj::LoadObj(&attributes, &shapes, &materials, &err, path.c_str()))
+            if(object.has_transform)
             {
-                return error_t::objects_load_fail;
+                transform_points(object.transform, obj.vertices.data(), obj.vertices.size());
+                transform_normals(object.transform, obj.normals.data(), obj.normals.size());
             }
 
-            auto vertex_offset = scene->vertices.size();
-            auto normal_offset = scene->normals.size();
-            auto texcoord_offset = scene->texcoords.size();
-
-            scene->vertices.resize(vertex_offset + attributes.vertices.size()/3);
-            scene->normals.resize(normal_offset + attributes.normals.size()/3);
-            scene->texcoords.resize(texcoord_offset + attributes.texcoords.size()/2);
-
-            memcpy(
-                    scene->vertices.data() + vertex_offset,
-                    attributes.vertices.data(),
-                    attributes.vertices.size() * sizeof(float_t)
-                   );
-            memcpy(
-                    scene->normals.data() + normal_offset,
-                    attributes.normals.data(),
-                    attributes.normals.size() * sizeof(float_t)
-                  );
-            memcpy(
-                    scene->texcoords.data() + texcoord_offset,
-                    attributes.texcoords.data(),
-                    attributes.texcoords.size() * sizeof(float_t)
-                  );
-
-            for(auto& shape: shapes)
-            {
-                for(auto i = 0; i < shape.mesh.indices.size(); i+=3)
+            return error_t::success;
+        }
+
+        error_t stream_objects(darray_t<scene_object_t>& objects)
+        {
+            auto checked = *stream;
+
+            // Same requirements as for the loaded geometry.
+            checked.reserve = [this](const geometry_sizes_t& sizes)
+            {
+                if(sizes.triangles == 0 || sizes.vertices == 0 || sizes.normals == 0)
                 {
-                    triangle_t t;
-                    t.vertices[0].vertex_index = shape.mesh.indices[i].vertex_index + vertex_offset;
-                    t.vertices[0].normal_index = shape.mesh.indices[i].normal_index + normal_offset;
-                    t.vertices[0].texcoord_index = shape.mesh.indices[i].texcoord_index + texcoord_offset;
-                    t.vertices[1].vertex_index = shape.mesh.indices[i + 1].vertex_index + vertex_offset;
-                    t.vertices[1].normal_index = shape.mesh.indices[i + 1].normal_index + normal_offset;
-                    t.vertices[1].texcoord_index = shape.mesh.indices[i + 1].texcoord_index + texcoord_offset;
-                    t.vertices[2].vertex_index = shape.mesh.indices[i + 2].vertex_index + vertex_offset;
-                    t.vertices[2].normal_index = shape.mesh.indices[i + 2].normal_index + normal_offset;
-                    t.vertices[2].texcoord_index = shape.mesh.indices[i + 2].texcoord_index + texcoord_offset;
-                    t.material_id = shape.mesh.material_ids[i/3];
-
-                    scene->triangles.push_back(t);
+                    return error_t::objects_load_fail;
                 }
+
+                return stream->reserve(sizes);
+            };
+
+            emission_collector_t emission;
+            auto status = stream_objs(objects, scene->materials, emission.wrap(checked, scene->materials));
+
+            if(status == error_t::success)
+            {
+                emission.add_lights(objects, scene->lights);
             }
 
-            for(auto& m: materials)
+            return status;
+        }
+
+        // Appends the objects in order, their indices are rebased on the
+        // prefix sums of the attribute and material counts before them.
+        void merge_objects(darray_t<obj_t>& objects)
+        {
+            struct offsets_t
+            {
+                size_t vertices;
+                size_t normals;
+                size_t texcoords;
+                size_t triangles;
+                size_t materials;
+            };
+
+            darray_t<offsets_t> offsets(objects.size());
+
+            offsets_t total =
             {
-                material_t material;
-                material.base_color[0] = m.diffuse[0];
-                material.base_color[1] = m.diffuse[1];
-                material.base_color[2] = m.diffuse[2];
-                material.metallic = m.metallic;
-                material.roughness = m.roughness;
+                scene->vertices.size(),
+                scene->normals.size(),
+                scene->texcoords.size(),
+                scene->triangles.size(),
+                scene->materials.size()
+            };
+
+            for(size_t i = 0; i < objects.size(); ++i)
+            {
+                offsets[i] = total;
 
-                scene->materials.push_back(material);
+                scene->sources[i].range =
+                {
+                    {total.vertices, total.normals, total.texcoords, total.triangles},
+                    {
+                        objects[i].vertices.size(),
+                        objects[i].normals.size(),
+                        objects[i].texcoords.size(),
+                        objects[i].triangles.size()
+                    },
+                    total.materials,
+                    objects[i].materials.size()
+                };
+
+                total.vertices += objects[i].vertices.size();
+                total.normals += objects[i].normals.size();
+                total.texcoords += objects[i].texcoords.size();
+                total.triangles += objects[i].triangles.size();
+                total.materials += objects[i].materials.size();
             }
 
-            return error_t::success;
+            scene->vertices.resize(total.vertices);
+            scene->normals.resize(total.normals);
+            scene->texcoords.resize(total.texcoords);
+            scene->triangles.resize(total.triangles);
+            scene->materials.resize(total.materials);
+
+            thread_pool_t::get_global().parallel_for(objects.size(), [&](size_t i)
+            {
+                auto& obj = objects[i];
+                auto& offset = offsets[i];
+
+                std::copy(obj.vertices.begin(), obj.vertices.end(), scene->vertices.begin() + offset.vertices);
+                std::copy(obj.normals.begin(), obj.normals.end(), scene->normals.begin() + offset.normals);
+                std::copy(obj.texcoords.begin(), obj.texcoords.end(), scene->texcoords.begin() + offset.texcoords);
+                std::copy(obj.materials.begin(), obj.materials.end(), scene->materials.begin() + offset.materials);
+
+                // Missing normals, texcoords and materials stay ~0.
+                auto rebase = [](uint32_t index, size_t base)
+                {
+                    return (index == ~0u) ? index : uint32_t(index + base);
+                };
+
+                auto triangle = scene->triangles.begin() + offset.triangles;
+
+                for(auto t : obj.triangles)
+                {
+                    for(auto& v : t.vertices)
+                    {
+                        v.vertex_index += offset.vertices;
+                        v.normal_index = rebase(v.normal_index, offset.normals);
+                        v.texcoord_index = rebase(v.texcoord_index, offset.texcoords);
+                    }
+
+                    t.material_id = rebase(t.material_id, offset.materials);
+
+                    *triangle++ = t;
+                }
+
+                obj = {};
+            });
         }
 
         error_t load_camera()
         {
-            static constexpr const char* camerasectn = "camera";
-            static constexpr const char* uppropname = "up";
-            static constexpr const char* leftpropname = "left";
-            static constexpr const char* frontpropname = "lookat";
-            static constexpr const char* originpropname = "origin";
-            static constexpr const char* arpropname = "aspect_ratio";
-            static constexpr const char* nearpropname = "near";
-            static constexpr const char* farpropname = "far";
-            static constexpr const char* fovpropname = "fov";
+            auto section = description.find_section("camera");
 
-            auto camera_section = ini_find_section(parsed, camerasectn, strlen(camerasectn));
-
-            if(camera_section == INI_NOT_FOUND)
+            if(!section)
             {
                 return error_t::objects_load_fail;
             }
 
+            auto& camera = scene->settings.camera;
 
-            auto up = get_value(camera_section, uppropname);
-            auto left = get_value(camera_section, leftpropname);
-            auto front = get_value(camera_section, frontpropname);
-            auto origin = get_value(camera_section, originpropname);
-            auto aspect_ratio = get_value(camera_section, arpropname);
-            auto near = get_value(camera_section, nearpropname);
-            auto far = get_value(camera_section, farpropname);
-            auto fov = get_value(camera_section, fovpropname);
-
-            scene->settings.camera.up = parse_point(up);
-            scene->settings.camera.left = parse_point(left);
-            scene->settings.camera.front = parse_point(front);
-            scene->settings.camera.origin = parse_point(origin);
-            scene->settings.camera.aspect_ratio = strtof(aspect_ratio.c_str(), nullptr);
-            scene->settings.camera.near = strtof(near.c_str(), nullptr);
-            scene->settings.camera.far = strtof(far.c_str(), nullptr);
-            scene->settings.camera.field_of_view = strtof(fov.c_str(), nullptr);
+            camera.up = parse_point(section->get_value("up"));
+            camera.left = parse_point(section->get_value("left"));
+            camera.front = parse_point(section->get_value("lookat"));
+            camera.origin = parse_point(section->get_value("origin"));
+            camera.aspect_ratio = parse_real(section->get_value("aspect_ratio"));
+            camera.near = parse_real(section->get_value("near"));
+            camera.far = parse_real(section->get_value("far"));
+            camera.field_of_view = parse_real(section->get_value("fov"));
 
             return error_t::success;
         }
 
-        string_t get_value(int32_t section, const string_t& property)
+        // Malformed values read as zero, like strtof made them.
+        static float_t parse_real(string_view_t value)
         {
-           auto property_id = ini_find_property(parsed, section, property.c_str(), property.size());
-           auto value = ini_property_value(parsed, section, property_id);
+            float_t result = 0.0f;
+            bpmap::parse_real(value, result);
 
-           return (value)? string_t(value) : string_t();
+            return result;
         }
 
-        point3d_t parse_point(const string_t& p)
+        static uint32_t parse_unsigned(string_view_t value)
+        {
+            uint32_t result = 0;
+            bpmap::parse_unsigned(value, result);
+
+            return result;
+        }
+
+        static point3d_t parse_point(string_view_t value)
         {
             point3d_t result;
-            auto tokens = split(p, ' ');
 
-            if(tokens.size() < 3)
+            for(auto& component : result.components)
             {
-                result.components[0] = 0;
-                result.components[1] = 0;
-                result.components[2] = 0;
-
-                return result;
+                if(!bpmap::parse_real(value, component))
+                {
+                    return point3d_t();
+                }
             }
 
-            auto x = strtof(tokens[0].c_str(), nullptr);
-            auto y = strtof(tokens[1].c_str(), nullptr);
-            auto z = strtof(tokens[2].c_str(), nullptr);
-
-            result.components[0] = x;
-            result.components[1] = y;
-            result.components[2] = z;
-
             return result;
         }
     };
 
     error_t load_scene(const string_t& path, scene_t& scene)
     {
-        darray_t<uint8_t> scene_description;
+        if(path.ends_with(binary_scene_extension))
+        {
+            return load_binary_scene(path, scene);
+        }
+
+        mapped_file_t scene_description;
+
+        if(!scene_description.open(path))
+        {
+            return error_t::scene_settings_read_fail;
+        }
+
+        return scene_loader_t(scene_description.get_text(), scene).is_loaded();
+    }
+
+    error_t load_scene_description(string_view_t text, scene_t& scene)
+    {
+        return scene_loader_t(text, scene, nullptr, false).is_loaded();
+    }
 
-        if(!read_whole_file(path, scene_description))
+    error_t stream_scene(const string_t& path, scene_t& scene, const geometry_stream_t& stream)
+    {
+        // The geometry goes from the mapping of the file into the stream, it
+        // is never copied to the host.
+        if(path.ends_with(binary_scene_extension))
+        {
+            mapped_binary_scene_t mapped;
+
+            auto status = map_binary_scene(path, mapped);
+
+            if(status == error_t::success)
+            {
+                status = read_binary_scene(path, mapped, scene, false);
+            }
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            return stream_binary_geometry(mapped, stream);
+        }
+
+        mapped_file_t scene_description;
+
+        if(!scene_description.open(path))
         {
             return error_t::scene_settings_read_fail;
         }
 
-        scene_description.push_back('\0');
+        return scene_loader_t(scene_description.get_text(), scene, &stream).is_loaded();
+    }
+
+
+    static size_t get_size(const geometry_sizes_t& sizes, geometry_array_t array)
+    {
+        switch(array)
+        {
+            case geometry_array_t::vertices:
+                return sizes.vertices;
+
+            case geometry_array_t::normals:
+                return sizes.normals;
+
+            case geometry_array_t::texcoords:
+                return sizes.texcoords;
+
+            case geometry_array_t::triangles:
+            default:
+                return sizes.triangles;
+        }
+    }
+
+    static bool_t is_same_sizes(const geometry_sizes_t& a, const geometry_sizes_t& b)
+    {
+        return a.vertices == b.vertices &&
+               a.normals == b.normals &&
+               a.texcoords == b.texcoords &&
+               a.triangles == b.triangles;
+    }
+
+    // Passes the writes on and keeps the geometry arrays of the scene in
+    // sync with them.
+    static geometry_stream_t mirror_to_scene(scene_t& scene, const geometry_stream_t& stream)
+    {
+        geometry_stream_t mirrored;
+
+        mirrored.reserve = [&scene, &stream](const geometry_sizes_t& sizes)
+        {
+            scene.vertices.resize(sizes.vertices);
+            scene.normals.resize(sizes.normals);
+            scene.texcoords.resize(sizes.texcoords);
+            scene.triangles.resize(sizes.triangles);
+
+            return stream.reserve(sizes);
+        };
+
+        mirrored.write = [&scene, &stream](geometry_array_t array, size_t first, const void* data, size_t count)
+        {
+            switch(array)
+            {
+                case geometry_array_t::vertices:
+                    memcpy(scene.vertices.data() + first, data, count * sizeof(point3d_t));
+                    break;
+
+                case geometry_array_t::normals:
+                    memcpy(scene.normals.data() + first, data, count * sizeof(codirection3d_t));
+                    break;
+
+                case geometry_array_t::texcoords:
+                    memcpy(scene.texcoords.data() + first, data, count * sizeof(point2d_t));
+                    break;
+
+                case geometry_array_t::triangles:
+                default:
+                    memcpy(scene.triangles.data() + first, data, count * sizeof(triangle_t));
+                    break;
+            }
+
+            return stream.write(array, first, data, count);
+        };
+
+        return mirrored;
+    }
+
+    static bool_t is_same_settings(const scene_settings_t& a, const scene_settings_t& b)
+    {
+        return memcmp(&a.camera, &b.camera, sizeof(a.camera)) == 0 &&
+               a.samples_per_pixel == b.samples_per_pixel &&
+               a.light_samples == b.light_samples &&
+               a.max_reflection_bounces == b.max_reflection_bounces &&
+               a.sample_pattern == b.sample_pattern &&
+               a.light_selection == b.light_selection &&
+               a.light_resampling == b.light_resampling &&
+               a.samples_per_batch == b.samples_per_batch &&
+               a.adaptive_threshold == b.adaptive_threshold &&
+               a.environment_width == b.environment_width &&
+               a.environment_height == b.environment_height &&
+               a.environment_intensity == b.environment_intensity;
+    }
+
+    static bool_t is_same_transform(const scene_object_t& a, const scene_object_t& b)
+    {
+        if(a.has_transform != b.has_transform)
+        {
+            return false;
+        }
+
+        return !a.has_transform || memcmp(&a.transform, &b.transform, sizeof(a.transform)) == 0;
+    }
+
+    static void rebase_triangles(darray_t<triangle_t>& triangles, const geometry_sizes_t& bases)
+    {
+        // Missing normals and texcoords stay ~0.
+        auto rebase = [](uint32_t index, size_t base)
+        {
+            return (index == ~0u) ? index : uint32_t(index + base);
+        };
+
+        for(auto& triangle : triangles)
+        {
+            for(auto& v : triangle.vertices)
+            {
+                v.vertex_index += bases.vertices;
+                v.normal_index = rebase(v.normal_index, bases.normals);
+                v.texcoord_index = rebase(v.texcoord_index, bases.texcoords);
+            }
+        }
+    }
+
+    // The described lights come first, the ones of the emissive triangles of
+    // the objects follow.
+    static size_t get_described_lights_count(const scene_t& scene)
+    {
+        return scene.sources.empty() ? scene.lights.size() : scene.sources[0].range.first_light;
+    }
+
+    static void replace_described_lights(scene_t& scene, const darray_t<light_t>& lights)
+    {
+        auto described = get_described_lights_count(scene);
+
+        scene.lights.erase(scene.lights.begin(), scene.lights.begin() + described);
+        scene.lights.insert(scene.lights.begin(), lights.begin(), lights.end());
+
+        for(auto& source : scene.sources)
+        {
+            source.range.first_light = source.range.first_light - described + lights.size();
+        }
+    }
+
+    // Reloads the object into its range. Sets resized and fails when its
+    // geometry, materials or emissive triangles don't fit there anymore.
+    static error_t reload_object(
+                                  scene_t& scene,
+                                  size_t index,
+                                  const scene_object_t& source,
+                                  const geometry_stream_t& stream,
+                                  bool_t& resized
+                                )
+    {
+        auto range = scene.sources[index].range;
+
+        geometry_stream_t placed;
+
+        placed.reserve = [&range, &resized](const geometry_sizes_t& sizes)
+        {
+            resized = !is_same_sizes(sizes, range.sizes);
+
+            return resized ? error_t::objects_load_fail : error_t::success;
+        };
+
+        // The chunks write in parallel, so each write rebases its own copy
+        // since the triangles index the attributes of the object alone.
+        placed.write = [&range, &stream](geometry_array_t array, size_t first, const void* data, size_t count)
+        {
+            if(array != geometry_array_t::triangles)
+            {
+                return stream.write(array, first + get_size(range.first, array), data, count);
+            }
+
+            auto triangles = static_cast<const triangle_t*>(data);
+            darray_t<triangle_t> rebased(triangles, triangles + count);
+            rebase_triangles(rebased, range.first);
+
+            return stream.write(array, first + range.first.triangles, rebased.data(), count);
+        };
+
+        // Material ids come out right when the materials before the object
+        // are in place.
+        darray_t<material_t> materials(
+                                        scene.materials.begin(),
+                                        scene.materials.begin() + range.first_material
+                                      );
+
+        darray_t<scene_object_t> objects = {source};
+
+        emission_collector_t emission;
+        auto status = stream_objs(objects, materials, emission.wrap(placed, materials));
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        darray_t<light_t> lights;
+        emission.add_lights(objects, lights);
+
+        if(objects[0].range.materials_count != range.materials_count || lights.size() != range.lights_count)
+        {
+            resized = true;
+            return error_t::objects_load_fail;
+        }
+
+        std::copy(lights.begin(), lights.end(), scene.lights.begin() + range.first_light);
+
+        std::copy(
+                   materials.begin() + range.first_material,
+                   materials.end(),
+                   scene.materials.begin() + range.first_material
+                 );
+
+        scene.sources[index] = source;
+        scene.sources[index].range = range;
+
+        return error_t::success;
+    }
+
+    static error_t reload_objects(
+                                   const darray_t<scene_object_t>& sources,
+                                   const hash_set_t<string_t>& changed_files,
+                                   scene_t& scene,
+                                   const geometry_stream_t& stream,
+                                   scene_changes_t& changes
+                                 )
+    {
+        auto same_objects = sources.size() == scene.sources.size();
+
+        for(size_t i = 0; same_objects && i < sources.size(); ++i)
+        {
+            same_objects = sources[i].path == scene.sources[i].path;
+        }
+
+        for(size_t i = 0; same_objects && i < sources.size(); ++i)
+        {
+            auto& source = sources[i];
+
+            if(!changed_files.contains(source.path) && is_same_transform(source, scene.sources[i]))
+            {
+                continue;
+            }
+
+            auto resized = false;
+            auto status = reload_object(scene, i, source, stream, resized);
+
+            if(resized)
+            {
+                same_objects = false;
+                break;
+            }
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            changes.objects.push_back(i);
+            changes.materials = true;
+            changes.lights = changes.lights || scene.sources[i].range.lights_count > 0;
+        }
+
+        if(same_objects)
+        {
+            return error_t::success;
+        }
+
+        changes.objects.clear();
+        changes.geometry = true;
+        changes.materials = true;
+
+        auto described = get_described_lights_count(scene);
+        changes.lights = changes.lights || scene.lights.size() > described;
+
+        scene.sources = sources;
+        scene.materials.clear();
+        scene.lights.resize(described);
+
+        emission_collector_t emission;
+        auto status = stream_objs(scene.sources, scene.materials, emission.wrap(stream, scene.materials));
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        emission.add_lights(scene.sources, scene.lights);
+        changes.lights = changes.lights || scene.lights.size() > described;
+
+        return error_t::success;
+    }
+
+    // Parses the files of the objects reload_objects reads again without
+    // writing their geometry anywhere, so a broken one fails the reload
+    // before the scene or the stream are touched. Adds the lights the objects
+    // will have.
+    static error_t validate_objects(
+                                     const darray_t<scene_object_t>& sources,
+                                     const hash_set_t<string_t>& changed_files,
+                                     const scene_t& scene,
+                                     size_t& lights_count
+                                   )
+    {
+        hash_table_t<string_t, size_t> file_lights;
+
+        for(auto& source : scene.sources)
+        {
+            file_lights[source.path] = source.range.lights_count;
+        }
+
+        // Files which were loaded already only move with their transform.
+        darray_t<scene_object_t> objects;
+        hash_set_t<string_t> listed;
+
+        for(auto& source : sources)
+        {
+            auto is_read = !file_lights.contains(source.path) || changed_files.contains(source.path);
+
+            if(is_read && listed.insert(source.path).second)
+            {
+                objects.push_back(source);
+            }
+        }
+
+        if(!objects.empty())
+        {
+            geometry_stream_t discarded;
+            discarded.reserve = [](const geometry_sizes_t&) { return error_t::success; };
+            discarded.write = [](geometry_array_t, size_t, const void*, size_t) { return error_t::success; };
+
+            darray_t<material_t> materials;
+            darray_t<light_t> lights;
+
+            emission_collector_t emission;
+            auto status = stream_objs(objects, materials, emission.wrap(discarded, materials));
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            emission.add_lights(objects, lights);
+
+            for(auto& object : objects)
+            {
+                file_lights[object.path] = object.range.lights_count;
+            }
+        }
+
+        for(auto& source : sources)
+        {
+            lights_count += file_lights[source.path];
+        }
+
+        return error_t::success;
+    }
+
+    // Reads the environment into next when its file changed or another one
+    // is described, otherwise next keeps the size of the one of the scene.
+    static error_t load_next_environment(
+                                          const hash_set_t<string_t>& changed_files,
+                                          const scene_t& scene,
+                                          scene_t& next,
+                                          bool_t& changed
+                                        )
+    {
+        auto& path = next.environment_path;
+        changed = path != scene.environment_path || (!path.empty() && changed_files.contains(path));
+
+        if(!changed)
+        {
+            next.settings.environment_width = scene.settings.environment_width;
+            next.settings.environment_height = scene.settings.environment_height;
+            return error_t::success;
+        }
+
+        if(path.empty())
+        {
+            build_environment_aliases(next);
+            return error_t::success;
+        }
+
+        return load_environment(path, next);
+    }
+
+    error_t reload_scene(
+                          const string_t& path,
+                          const hash_set_t<string_t>& changed_files,
+                          scene_t& scene,
+                          const geometry_stream_t& stream,
+                          scene_changes_t& changes
+                        )
+    {
+        // Scenes which were streamed have no host geometry to keep in sync.
+        auto mirrored = mirror_to_scene(scene, stream);
+        auto& target = scene.vertices.empty() ? stream : mirrored;
+
+        scene_t next;
+        mapped_binary_scene_t mapped;
+        auto is_binary = path.ends_with(binary_scene_extension);
+        auto status = error_t::success;
+
+        if(is_binary)
+        {
+            status = map_binary_scene(path, mapped);
+
+            if(status == error_t::success)
+            {
+                status = read_binary_scene(path, mapped, next, false);
+            }
+        }
+        else
+        {
+            mapped_file_t scene_description;
+
+            if(!scene_description.open(path))
+            {
+                return error_t::scene_settings_read_fail;
+            }
+
+            status = load_scene_description(scene_description.get_text(), next);
+        }
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        next.settings.resolution_x = scene.settings.resolution_x;
+        next.settings.resolution_y = scene.settings.resolution_y;
+
+        // Everything which can fail is read before the scene is changed. The
+        // lights of a binary scene are all described.
+        auto lights_count = next.lights.size();
+        auto environment_changed = is_binary && changed_files.contains(path);
+
+        if(!is_binary)
+        {
+            status = load_next_environment(changed_files, scene, next, environment_changed);
+
+            if(status == error_t::success)
+            {
+                status = validate_objects(next.sources, changed_files, scene, lights_count);
+            }
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        if(lights_count == 0 && (environment_changed ? next.environment : scene.environment).empty())
+        {
+            return error_t::lights_load_fail;
+        }
+
+        // Only writing the geometry can still fail, so it goes first.
+        if(!is_binary)
+        {
+            status = reload_objects(next.sources, changed_files, scene, target, changes);
+        }
+        else if(changed_files.contains(path))
+        {
+            // A binary scene is replaced as a whole once it changed.
+            changes.geometry = true;
+            status = stream_binary_geometry(mapped, target);
+
+            scene.materials = std::move(next.materials);
+            scene.objects = std::move(next.objects);
+            changes.materials = true;
+        }
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        if(environment_changed)
+        {
+            scene.environment_path = next.environment_path;
+            scene.environment = std::move(next.environment);
+            scene.environment_aliases = std::move(next.environment_aliases);
+            changes.environment = true;
+        }
+
+        if(!is_same_settings(scene.settings, next.settings))
+        {
+            scene.settings = next.settings;
+            changes.settings = true;
+        }
+
+        auto described = get_described_lights_count(scene);
+
+        if(
+            next.lights.size() != described ||
+            memcmp(next.lights.data(), scene.lights.data(), described * sizeof(light_t)) != 0
+          )
+        {
+            replace_described_lights(scene, next.lights);
+            changes.lights = true;
+        }
+
+        if(changes.lights)
+        {
+            build_light_tables(scene);
+        }
 
-        return scene_loader_t(scene_description, scene).is_loaded();
+        return error_t::success;
     }
 }
@@ -1,13 +1,59 @@
 #ifndef SCENE_LOADER_HPP
 #define SCENE_LOADER_HPP
 
+#include "geometry_stream.hpp"
 #include "scene.hpp"
 #include <common.hpp>
 #include <error.hpp>
 
 namespace bpmap
 {
+    // Scenes ending with .bpscene are loaded as binary scenes, anything
+    // else is parsed as a scene description.
     error_t load_scene(const string_t& path, scene_t& scene);
+
+    // Same as load_scene except that the vertices, normals, texcoords and
+    // triangles go to the stream, parsed chunk by chunk. The geometry
+    // arrays of the scene are left empty.
+    error_t stream_scene(const string_t& path, scene_t& scene, const geometry_stream_t& stream);
+
+    // Reads only the text of a scene description. The objects are listed in
+    // scene.sources, their geometry isn't loaded.
+    error_t load_scene_description(string_view_t text, scene_t& scene);
+
+    // What reload_scene changed in the scene.
+    struct scene_changes_t
+    {
+        // Settings or camera.
+        bool_t settings = false;
+        bool_t lights = false;
+        bool_t materials = false;
+        bool_t environment = false;
+
+        // Objects reloaded in place, their ranges didn't change.
+        darray_t<size_t> objects;
+
+        // Objects were added, removed or changed sizes, so all the geometry
+        // was reloaded and reserved again.
+        bool_t geometry = false;
+
+        bool_t any() const { return settings || lights || materials || environment || geometry || !objects.empty(); }
+    };
+
+    // Reads the scene at path again and applies the differences to scene.
+    // Objects are reloaded when their file is in changed_files or their
+    // transform changed. Their geometry is written to the stream at their
+    // ranges, and to the scene arrays unless the scene was streamed. The
+    // resolution is kept since the render output isn't recreated. The files
+    // are all read before the scene changes, so one which fails to parse
+    // leaves it as it was.
+    error_t reload_scene(
+                          const string_t& path,
+                          const hash_set_t<string_t>& changed_files,
+                          scene_t& scene,
+                          const geometry_stream_t& stream,
+                          scene_changes_t& changes
+                        );
 }
 
 #endif // SCENE_LOADER_HPP
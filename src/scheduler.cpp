@@ -0,0 +1,155 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+
+#include "scheduler.hpp"
+
+namespace bpmap
+{
+    loop_mode_params_t frame_scheduler_t::get_mode_params(loop_mode_t mode)
+    {
+        static constexpr uint64_t ms = 1000000;
+
+        switch(mode)
+        {
+            case loop_mode_t::idle:
+                return {1.0 / 30, 100 * ms, -1.0, 1};
+
+            case loop_mode_t::interactive:
+                return {1.0 / 60, 4 * ms, 0.25, 3};
+
+            case loop_mode_t::max_throughput:
+            default:
+                return {0.0, 0, 0.0, 0};
+        }
+    }
+
+
+    frame_scheduler_t::frame_scheduler_t(
+                                          window_t& window,
+                                          renderer_t& renderer,
+                                          loop_mode_t mode
+                                        ) :
+        window(&window), renderer(&renderer)
+    {
+        set_mode(mode);
+    }
+
+
+    void frame_scheduler_t::set_mode(loop_mode_t m)
+    {
+        mode = m;
+        params = get_mode_params(m);
+        frame_pending = true;
+    }
+
+
+    void frame_scheduler_t::post_frame_request()
+    {
+        frame_requested = true;
+        window->wake();
+    }
+
+
+    void frame_scheduler_t::block(double_t timeout)
+    {
+        if(renderer->is_busy())
+        {
+            // While the GPU works sleep on its fence instead of the event
+            // queue, but not longer than requested so input stays responsive.
+            auto fence_timeout = params.fence_timeout;
+
+            if(timeout >= 0.0)
+            {
+                fence_timeout = std::min(fence_timeout, uint64_t(timeout * 1E9));
+            }
+
+            if(renderer->is_not_busy(fence_timeout))
+            {
+                frame_pending = true;
+            }
+
+            window->poll_events();
+        }
+        else
+        {
+            window->wait_events(timeout);
+        }
+    }
+
+
+    bool_t frame_scheduler_t::wait_for_frame()
+    {
+        window->poll_events();
+
+        while(!window->closed())
+        {
+            if(window->consume_input())
+            {
+                frame_pending = true;
+                frames_to_settle = params.settle_frames;
+            }
+
+            if(frame_requested.exchange(false))
+            {
+                frame_pending = true;
+            }
+
+            // The render output changed, it has to be shown.
+            if(renderer->is_busy() && renderer->is_not_busy())
+            {
+                frame_pending = true;
+            }
+
+            auto wants_frame = frame_pending ||
+                               frames_to_settle > 0 ||
+                               mode == loop_mode_t::max_throughput;
+
+            if(!wants_frame)
+            {
+                block(params.event_timeout);
+                continue;
+            }
+
+            auto now = clock_t::now();
+            auto elapsed = std::chrono::duration<double_t>(now - last_frame).count();
+
+            if(elapsed >= params.frame_interval)
+            {
+                last_frame = now;
+
+                if(frame_pending)
+                {
+                    frame_pending = false;
+                }
+                else if(frames_to_settle > 0)
+                {
+                    frames_to_settle--;
+                }
+
+                return true;
+            }
+
+            // Sleep until the frame is due, waking up early on new input.
+            block(params.frame_interval - elapsed);
+        }
+
+        return false;
+    }
+}
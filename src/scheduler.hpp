@@ -0,0 +1,97 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+
+#include "window/window.hpp"
+#include "vulkan/renderer.hpp"
+
+namespace bpmap
+{
+    enum class loop_mode_t
+    {
+        // Sleeps until input arrives or the renderer finishes, long timeouts.
+        idle,
+        // Same triggers as idle but with short timeouts and a higher frame cap
+        // so dragging sliders etc. stays responsive.
+        interactive,
+        // Never blocks, draws a GUI frame on every iteration.
+        max_throughput
+    };
+
+    struct loop_mode_params_t
+    {
+        // Minimal time between two GUI frames in seconds.
+        double_t frame_interval;
+        // How long to block on the render fence when the renderer is busy.
+        uint64_t fence_timeout;
+        // How long to block on window events when the renderer is idle,
+        // negative means forever.
+        double_t event_timeout;
+        // Extra frames drawn after the last input so nuklear can settle
+        // hover and active states.
+        uint32_t settle_frames;
+    };
+
+    class frame_scheduler_t
+    {
+        using clock_t = std::chrono::steady_clock;
+
+        window_t* window;
+        renderer_t* renderer;
+
+        loop_mode_t mode;
+        loop_mode_params_t params;
+
+        clock_t::time_point last_frame;
+        uint32_t frames_to_settle = 0;
+        bool_t frame_pending = true;
+        std::atomic<bool_t> frame_requested = false;
+
+        void block(double_t timeout);
+
+    public:
+        static loop_mode_params_t get_mode_params(loop_mode_t mode);
+
+        frame_scheduler_t(
+                           window_t& window,
+                           renderer_t& renderer,
+                           loop_mode_t mode = loop_mode_t::interactive
+                         );
+
+        void set_mode(loop_mode_t mode);
+        loop_mode_t get_mode() const { return mode; }
+
+        // Forces a GUI frame on the next call to wait_for_frame.
+        void request_frame() { frame_pending = true; }
+
+        // Same as request_frame but can be called from any thread, wakes up
+        // the loop if it's blocked on window events.
+        void post_frame_request();
+
+        // Blocks until a GUI frame has to be drawn. Returns false once the
+        // window was closed.
+        bool_t wait_for_frame();
+    };
+}
+
+#endif // SCHEDULER_HPP
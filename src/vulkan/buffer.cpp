@@ -39,6 +39,27 @@ namespace bpmap::vk
     }
 
 
+    error_t buffer_t::flush(size_t offset, size_t size)
+    {
+        if(vmaFlushAllocation(dev->get_allocator(), allocation, offset, size) != VK_SUCCESS)
+        {
+            return error_t::memory_mapping_fail;
+        }
+
+        return error_t::success;
+    }
+
+    error_t buffer_t::invalidate(size_t offset, size_t size)
+    {
+        if(vmaInvalidateAllocation(dev->get_allocator(), allocation, offset, size) != VK_SUCCESS)
+        {
+            return error_t::memory_mapping_fail;
+        }
+
+        return error_t::success;
+    }
+
+
     buffer_t::buffer_t()
     {
         dev = nullptr;
@@ -46,15 +67,30 @@ namespace bpmap::vk
         buffer = VK_NULL_HANDLE;
         slot = INVALID_SLOT;
         size = 0;
+        mapped = nullptr;
     }
 
 
     buffer_t::~buffer_t()
+    {
+        destroy();
+    }
+
+
+    void buffer_t::destroy()
     {
         if(dev)
         {
+            dev->unbind(this);
             vmaDestroyBuffer(dev->get_allocator(), buffer, allocation);
         }
+
+        dev = nullptr;
+        allocation = VK_NULL_HANDLE;
+        buffer = VK_NULL_HANDLE;
+        slot = INVALID_SLOT;
+        size = 0;
+        mapped = nullptr;
     }
 
 
@@ -73,12 +109,14 @@ namespace bpmap::vk
 
         VmaAllocationCreateInfo aci = {};
         aci.pool = VK_NULL_HANDLE;
-        aci.flags = 0;
+        aci.flags = desc.persistently_mapped? VMA_ALLOCATION_CREATE_MAPPED_BIT : 0;
         aci.preferredFlags = 0;
         aci.requiredFlags = 0;
         aci.pUserData = nullptr;
         aci.usage = desc.on_gpu? VMA_MEMORY_USAGE_GPU_ONLY : VMA_MEMORY_USAGE_CPU_TO_GPU;
 
+        VmaAllocationInfo allocation_info = {};
+
         if(
             vmaCreateBuffer(
                             device.get_allocator(),
@@ -86,7 +124,7 @@ namespace bpmap::vk
                             &aci,
                             &buffer,
                             &allocation,
-                            nullptr
+                            &allocation_info
                            )
            != VK_SUCCESS
           )
@@ -96,6 +134,7 @@ namespace bpmap::vk
 
         dev = &device;
         size = bci.size;
+        mapped = allocation_info.pMappedData;
 
         if (!desc.dont_bind)
         {
@@ -29,6 +29,8 @@ namespace bpmap::vk
         uint32_t usage = 0;
         bool_t on_gpu = true; 
         bool_t dont_bind = false;
+        // Keeps host visible buffers mapped for their whole lifetime.
+        bool_t persistently_mapped = false;
     };
 
     static constexpr uint32_t buffer_usage_transfer_src =
@@ -51,6 +53,7 @@ namespace bpmap::vk
         VkBuffer buffer;
         size_t size;
         uint32_t slot;
+        void* mapped;
 
         buffer_t(const buffer_t&) = delete;
         buffer_t& operator=(const buffer_t&) = delete;
@@ -61,9 +64,18 @@ namespace bpmap::vk
         uint32_t get_slot() const { return slot; }
         error_t create(const device_t& device, const buffer_desc_t& desc);
 
+        // Releases the buffer and its slot, it can be created again after.
+        void destroy();
+
         error_t map(void** data);
         void unmap();
 
+        // Only valid for buffers created with persistently_mapped.
+        void* get_mapped() const { return mapped; }
+        error_t flush(size_t offset, size_t size);
+        // Makes the writes of the device visible to the mapping.
+        error_t invalidate(size_t offset, size_t size);
+
         buffer_t();
         ~buffer_t();
     };
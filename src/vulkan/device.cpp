@@ -17,6 +17,8 @@
 
 
 #include <limits>
+#include <chrono>
+#include <algorithm>
 
 #define VMA_IMPLEMENTATION
 
@@ -327,6 +329,7 @@ namespace bpmap::vk
         indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
         indexing_features.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
         indexing_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        indexing_features.descriptorBindingVariableDescriptorCount = VK_TRUE;
 
         VkDeviceCreateInfo dci = {};
         dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -713,210 +716,509 @@ namespace bpmap::vk
         push_range.offset = 0;
         push_range.size = desc.max_push_constants * 4;
 
+        VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {};
+        indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+        indexing_properties.pNext = nullptr;
+
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &indexing_properties;
+
+        vkGetPhysicalDeviceProperties2(gpu_device, &properties);
+
+        // All tables are visible to every stage, so they share the per stage
+        // resource limit.
+        auto& limits = indexing_properties;
+        auto resources_limit = limits.maxPerStageUpdateAfterBindResources / BINDLESS_SETS_COUNT;
+
+        auto limit = [&](uint32_t set_limit, uint32_t stage_limit)
+        {
+            return std::min({set_limit, stage_limit, resources_limit, desc.max_bindless_descriptors});
+        };
+
+        auto& l = bindless_limits;
+        l[BINDLESS_SAMPLED_IMAGES_SET] = limit(
+                                                limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                                limits.maxPerStageDescriptorUpdateAfterBindSampledImages
+                                              );
+        l[BINDLESS_STORAGE_IMAGES_SET] = limit(
+                                                limits.maxDescriptorSetUpdateAfterBindStorageImages,
+                                                limits.maxPerStageDescriptorUpdateAfterBindStorageImages
+                                              );
+        l[BINDLESS_SAMPLERS_SET] = limit(
+                                          limits.maxDescriptorSetUpdateAfterBindSamplers,
+                                          limits.maxPerStageDescriptorUpdateAfterBindSamplers
+                                        );
+        l[BINDLESS_BUFFERS_SET] = limit(
+                                         limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                         limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers
+                                       );
+
+        // Sampled and storage images share the slots.
+        auto images_limit = std::min(l[BINDLESS_SAMPLED_IMAGES_SET], l[BINDLESS_STORAGE_IMAGES_SET]);
+        l[BINDLESS_SAMPLED_IMAGES_SET] = images_limit;
+        l[BINDLESS_STORAGE_IMAGES_SET] = images_limit;
+
+        auto status = create_bindless_layouts();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        image_slots.init(std::min(desc.bindless_images, images_limit), images_limit);
+        sampler_slots.init(std::min(desc.bindless_samplers, l[BINDLESS_SAMPLERS_SET]), l[BINDLESS_SAMPLERS_SET]);
+        buffer_slots.init(std::min(desc.bindless_buffers, l[BINDLESS_BUFFERS_SET]), l[BINDLESS_BUFFERS_SET]);
+
+        bindless_sizes_t sizes;
+        sizes[BINDLESS_SAMPLED_IMAGES_SET] = image_slots.get_capacity();
+        sizes[BINDLESS_STORAGE_IMAGES_SET] = image_slots.get_capacity();
+        sizes[BINDLESS_SAMPLERS_SET] = sampler_slots.get_capacity();
+        sizes[BINDLESS_BUFFERS_SET] = buffer_slots.get_capacity();
+
+        bindless_pool = VK_NULL_HANDLE;
+        bindless_generation = 0;
+
+        return allocate_bindless_sets(sizes);
+    }
+
+
+    error_t device_t::create_bindless_layouts()
+    {
+        static const VkDescriptorType types[] =
+        {
+            VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            VK_DESCRIPTOR_TYPE_SAMPLER,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+        };
+
+        static const uint32_t bindings[] =
+        {
+            BINDLESS_SAMPLED_IMAGES_SLOT,
+            BINDLESS_STORAGE_IMAGES_SLOT,
+            BINDLESS_SAMPLERS_SLOT,
+            BINDLESS_BUFFERS_SLOT
+        };
+
+        for(auto set = 0u; set < BINDLESS_SETS_COUNT; ++set)
+        {
+            // The table size in the layout is only an upper bound, the actual
+            // one is given when the set is allocated.
+            VkDescriptorSetLayoutBinding dslb[2] = {};
+
+            dslb[0].binding = bindings[set];
+            dslb[0].descriptorCount = bindless_limits[set];
+            dslb[0].descriptorType = types[set];
+            dslb[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+            VkDescriptorBindingFlags flags[2] =
+            {
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT,
+                0
+            };
+
+            uint32_t bindings_count = 1;
+
+            if(set == BINDLESS_BUFFERS_SET)
+            {
+                // The table has to stay the last binding.
+                dslb[1] = dslb[0];
+                dslb[0].binding = BINDLESS_HANDLE_BUFFER_SLOT;
+                dslb[0].descriptorCount = 1;
+                dslb[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                std::swap(flags[0], flags[1]);
+                bindings_count = 2;
+            }
+
+            VkDescriptorSetLayoutBindingFlagsCreateInfo dslbfci = {};
+            dslbfci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+            dslbfci.pNext = nullptr;
+            dslbfci.pBindingFlags = flags;
+            dslbfci.bindingCount = bindings_count;
+
+            VkDescriptorSetLayoutCreateInfo dslci = {};
+            dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            dslci.pNext = &dslbfci;
+            dslci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+            dslci.bindingCount = bindings_count;
+            dslci.pBindings = dslb;
+
+            if(vkCreateDescriptorSetLayout(device, &dslci, nullptr, &bindless_layouts[set]) != VK_SUCCESS)
+            {
+                return error_t::descriptor_set_layout_creation_fail;
+            }
+        }
+
+        return error_t::success;
+    }
+
+
+    error_t device_t::allocate_bindless_sets(const bindless_sizes_t& sizes) const
+    {
         VkDescriptorPoolSize pool_sizes[5] = {};
 
         pool_sizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-        pool_sizes[0].descriptorCount = desc.max_bindless_images;
+        pool_sizes[0].descriptorCount = sizes[BINDLESS_SAMPLED_IMAGES_SET];
         pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        pool_sizes[1].descriptorCount = desc.max_bindless_images;
+        pool_sizes[1].descriptorCount = sizes[BINDLESS_STORAGE_IMAGES_SET];
         pool_sizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLER;
-        pool_sizes[2].descriptorCount = desc.max_bindless_samplers;
+        pool_sizes[2].descriptorCount = sizes[BINDLESS_SAMPLERS_SET];
         pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        pool_sizes[3].descriptorCount = desc.max_bindless_buffers;
+        pool_sizes[3].descriptorCount = sizes[BINDLESS_BUFFERS_SET];
         pool_sizes[4].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         pool_sizes[4].descriptorCount = 1;
 
         VkDescriptorPoolCreateInfo dpci = {};
         dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         dpci.pNext = nullptr;
-        dpci.maxSets = 1;
-        dpci.flags =
-            VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT |
-            VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        dpci.maxSets = BINDLESS_SETS_COUNT;
+        dpci.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
         dpci.poolSizeCount = 5;
         dpci.pPoolSizes = pool_sizes;
 
-        if(vkCreateDescriptorPool(device, &dpci, nullptr, &bindless_pool) != VK_SUCCESS)
+        using clock_t = std::chrono::steady_clock;
+        auto start = clock_t::now();
+
+        VkDescriptorPool pool;
+
+        if(vkCreateDescriptorPool(device, &dpci, nullptr, &pool) != VK_SUCCESS)
         {
             return error_t::descriptor_pool_creation_fail;
         }
 
-        VkDescriptorSetLayoutBinding dslb[5] = {};
-
-        dslb[0].binding = BINDLESS_SAMPLED_IMAGES_SLOT;
-        dslb[0].descriptorCount = desc.max_bindless_images;
-        dslb[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-        dslb[0].stageFlags = VK_SHADER_STAGE_ALL;
-
-        dslb[1].binding = BINDLESS_STORAGE_IMAGES_SLOT;
-        dslb[1].descriptorCount = desc.max_bindless_images;
-        dslb[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        dslb[1].stageFlags = VK_SHADER_STAGE_ALL;
-
-        dslb[2].binding = BINDLESS_SAMPLERS_SLOT;
-        dslb[2].descriptorCount = desc.max_bindless_samplers;
-        dslb[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-        dslb[2].stageFlags = VK_SHADER_STAGE_ALL;
-
-        dslb[3].binding = BINDLESS_BUFFERS_SLOT;
-        dslb[3].descriptorCount = desc.max_bindless_buffers;
-        dslb[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        dslb[3].stageFlags = VK_SHADER_STAGE_ALL;
-
-        dslb[4].binding = BINDLESS_HANDLE_BUFFER_SLOT;
-        dslb[4].descriptorCount = 1;
-        dslb[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        dslb[4].stageFlags = VK_SHADER_STAGE_ALL;
-
-        VkDescriptorBindingFlags flags[] =
-        {
-            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
-            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
-            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
-            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
-            0
-        };
+        VkDescriptorSetVariableDescriptorCountAllocateInfo dsvdcai = {};
+        dsvdcai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+        dsvdcai.pNext = nullptr;
+        dsvdcai.descriptorSetCount = BINDLESS_SETS_COUNT;
+        dsvdcai.pDescriptorCounts = sizes.data();
 
-        VkDescriptorSetLayoutBindingFlagsCreateInfo dslbfci = {};
-        dslbfci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
-        dslbfci.pNext = nullptr;
-        dslbfci.pBindingFlags = flags;
-        dslbfci.bindingCount = 5;
+        VkDescriptorSetAllocateInfo dsai = {};
+        dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        dsai.pNext = &dsvdcai;
+        dsai.descriptorSetCount = BINDLESS_SETS_COUNT;
+        dsai.pSetLayouts = bindless_layouts.data();
+        dsai.descriptorPool = pool;
 
-        VkDescriptorSetLayoutCreateInfo dslci = {};
-        dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        dslci.pNext = &dslbfci;
-        dslci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
-        dslci.bindingCount = 5;
-        dslci.pBindings = dslb;
+        bindless_sets_t sets;
 
-        if(vkCreateDescriptorSetLayout(device, &dslci, nullptr, &bindless_layout) != VK_SUCCESS)
+        if(vkAllocateDescriptorSets(device, &dsai, sets.data()) != VK_SUCCESS)
         {
-            return error_t::descriptor_set_layout_creation_fail;
+            vkDestroyDescriptorPool(device, pool, nullptr);
+            return error_t::descriptor_set_allocation_fail;
         }
 
-        VkDescriptorSetAllocateInfo dsai = {};
-        dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        dsai.pNext = nullptr;
-        dsai.descriptorSetCount = 1;
-        dsai.pSetLayouts = &bindless_layout;
-        dsai.descriptorPool = bindless_pool;
+        auto elapsed = std::chrono::duration<double_t, std::milli>(clock_t::now() - start).count();
+        uint32_t descriptors = 1;
 
-        if(vkAllocateDescriptorSets(device, &dsai, &bindless_set) != VK_SUCCESS)
+        for(auto size : sizes)
         {
-            return error_t::descriptor_set_allocation_fail;
+            descriptors += size;
         }
 
+        log(
+             "Bindless descriptor pool of ", descriptors, " descriptors (", sizes[BINDLESS_SAMPLED_IMAGES_SET],
+             " sampled images, ", sizes[BINDLESS_STORAGE_IMAGES_SET], " storage images, ",
+             sizes[BINDLESS_SAMPLERS_SET], " samplers, ", sizes[BINDLESS_BUFFERS_SET],
+             " buffers, 1 uniform buffer) created and allocated in ", elapsed, " ms"
+           );
+
+        if(bindless_pool != VK_NULL_HANDLE)
+        {
+            vkDestroyDescriptorPool(device, bindless_pool, nullptr);
+        }
+
+        bindless_pool = pool;
+        bindless_sets = sets;
+        bindless_sizes = sizes;
+        bindless_generation++;
+
         return error_t::success;
     }
 
 
-    uint32_t device_t::bind(const image_t* image) const
+    error_t device_t::grow_bindless_sets(const bindless_sizes_t& sizes) const
     {
-        auto index = image_slots.allocate();
+        // The old sets may be bound by work in flight.
+        vkDeviceWaitIdle(device);
 
-        VkDescriptorImageInfo sampled_info = {};
-        sampled_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        sampled_info.imageView = image->get_view();
-        sampled_info.sampler = VK_NULL_HANDLE;
+        auto status = allocate_bindless_sets(sizes);
 
-        VkDescriptorImageInfo storage_info = sampled_info;
-        storage_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        if(status != error_t::success)
+        {
+            return status;
+        }
 
-        VkWriteDescriptorSet write = {};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write.pNext = nullptr;
-        write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-        write.descriptorCount = 1;
-        write.dstSet = bindless_set;
-        write.dstBinding = BINDLESS_SAMPLED_IMAGES_SLOT;
-        write.dstArrayElement = index;
-        write.pBufferInfo = nullptr;
-        write.pImageInfo = &sampled_info;
-        write.pTexelBufferView = nullptr;
+        // The new sets are empty, everything bound so far is written again.
+        pending_writes.clear();
+        pending_writes.reserve(bound_descriptors.size());
 
-        uint32_t writes_count = 0;
-        array_t<VkWriteDescriptorSet, 2> writes;
+        for(auto& [key, write] : bound_descriptors)
+        {
+            pending_writes.push_back(write);
+        }
 
-        if (image->get_info().usage | usage_sampled)
+        return error_t::success;
+    }
+
+
+    static uint64_t descriptor_key(uint32_t set, uint32_t index)
+    {
+        return (uint64_t(set) << 32) | index;
+    }
+
+
+    uint32_t device_t::allocate_slot(slot_allocator_t& slots) const
+    {
+        while(true)
+        {
+            auto capacity = slots.get_capacity();
+            auto index = slots.allocate();
+
+            if(index != slot_allocator_t::invalid_slot)
+            {
+                return index;
+            }
+
+            // The descriptor sets follow at the next flush.
+            if(!slots.grow(capacity))
+            {
+                return INVALID_SLOT;
+            }
+        }
+    }
+
+
+    void device_t::queue_write(const pending_write_t& write) const
+    {
+        std::lock_guard lock(pending_writes_mutex);
+        pending_writes.push_back(write);
+    }
+
+
+    void device_t::drop_writes(uint32_t set, uint32_t index) const
+    {
+        std::lock_guard lock(pending_writes_mutex);
+
+        std::erase_if(
+                       pending_writes,
+                       [set, index](const pending_write_t& write)
+                       {
+                           return write.set == set && write.index == index;
+                       }
+                     );
+
+        bound_descriptors.erase(descriptor_key(set, index));
+    }
+
+
+    error_t device_t::flush_bindless_writes() const
+    {
+        // Held while writing too, so a resource can't be unbound and
+        // destroyed while its descriptor is being written.
+        std::lock_guard lock(pending_writes_mutex);
+
+        if(pending_writes.empty())
+        {
+            return error_t::success;
+        }
+
+        // Slots may have been handed out past the current set sizes.
+        auto sizes = bindless_sizes;
+        sizes[BINDLESS_SAMPLED_IMAGES_SET] = image_slots.get_capacity();
+        sizes[BINDLESS_STORAGE_IMAGES_SET] = image_slots.get_capacity();
+        sizes[BINDLESS_SAMPLERS_SET] = sampler_slots.get_capacity();
+        sizes[BINDLESS_BUFFERS_SET] = buffer_slots.get_capacity();
+
+        for(auto& write : pending_writes)
+        {
+            sizes[write.set] = std::max(sizes[write.set], write.index + 1);
+            bound_descriptors[descriptor_key(write.set, write.index)] = write;
+        }
+
+        auto needs_growth = false;
+
+        for(auto set = 0u; set < BINDLESS_SETS_COUNT; ++set)
+        {
+            sizes[set] = std::max(sizes[set], bindless_sizes[set]);
+            needs_growth = needs_growth || sizes[set] != bindless_sizes[set];
+        }
+
+        if(needs_growth)
+        {
+            auto status = grow_bindless_sets(sizes);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        darray_t<VkWriteDescriptorSet> writes(pending_writes.size());
+
+        for(auto i = 0u; i < pending_writes.size(); ++i)
         {
-            writes[writes_count++] = write; 
+            auto& pending = pending_writes[i];
+            auto is_buffer = pending.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+            auto& write = writes[i];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.pNext = nullptr;
+            write.descriptorType = pending.type;
+            write.descriptorCount = 1;
+            write.dstSet = bindless_sets[pending.set];
+            write.dstBinding = pending.binding;
+            write.dstArrayElement = pending.index;
+            write.pBufferInfo = is_buffer? &pending.buffer_info : nullptr;
+            write.pImageInfo = is_buffer? nullptr : &pending.image_info;
+            write.pTexelBufferView = nullptr;
         }
 
-        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        write.dstBinding = BINDLESS_STORAGE_IMAGES_SLOT;
-        write.pImageInfo = &storage_info;
+        vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+
+        pending_writes.clear();
+
+        return error_t::success;
+    }
+
+
+    uint32_t device_t::bind(const image_t* image) const
+    {
+        auto index = allocate_slot(image_slots);
+
+        if(index == INVALID_SLOT)
+        {
+            return INVALID_SLOT;
+        }
+
+        pending_write_t write = {};
+        write.index = index;
+        write.image_info.imageView = image->get_view();
+        write.image_info.sampler = VK_NULL_HANDLE;
+
+        if (image->get_info().usage | usage_sampled)
+        {
+            write.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            write.set = BINDLESS_SAMPLED_IMAGES_SET;
+            write.binding = BINDLESS_SAMPLED_IMAGES_SLOT;
+            write.image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            queue_write(write);
+        }
 
         if (image->get_info().usage | usage_storage)
         {
-            writes[writes_count++] = write; 
+            write.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write.set = BINDLESS_STORAGE_IMAGES_SET;
+            write.binding = BINDLESS_STORAGE_IMAGES_SLOT;
+            write.image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            queue_write(write);
         }
-        
-        vkUpdateDescriptorSets(device, writes_count, writes.data(), 0, nullptr);
+
         return index;
     }
 
 
     uint32_t device_t::bind(const buffer_t* buffer) const
     {
-        auto index = buffer_slots.allocate();
-
-        VkDescriptorBufferInfo info = {};
-        info.buffer = buffer->get_handle();
-        info.offset = 0;
-        info.range = VK_WHOLE_SIZE;
-
-        VkWriteDescriptorSet write = {};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write.pNext = nullptr;
-        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        write.descriptorCount = 1;
-        write.dstSet = bindless_set;
-        write.dstBinding = BINDLESS_BUFFERS_SLOT;
-        write.dstArrayElement = index;
-        write.pBufferInfo = &info;
-        write.pImageInfo = nullptr;
-        write.pTexelBufferView = nullptr;
-
-        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+        auto index = allocate_slot(buffer_slots);
+
+        if(index == INVALID_SLOT)
+        {
+            return INVALID_SLOT;
+        }
+
+        pending_write_t write = {};
+        write.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.set = BINDLESS_BUFFERS_SET;
+        write.binding = BINDLESS_BUFFERS_SLOT;
+        write.index = index;
+        write.buffer_info.buffer = buffer->get_handle();
+        write.buffer_info.offset = 0;
+        write.buffer_info.range = VK_WHOLE_SIZE;
+
+        queue_write(write);
         return index;
     }
 
 
     uint32_t device_t::bind(const sampler_t* sampler) const
     {
-        auto index = sampler_slots.allocate();
-
-        VkDescriptorImageInfo info = {};
-        info.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        info.imageView = VK_NULL_HANDLE;
-        info.sampler = sampler->get_handle();
-
-        VkWriteDescriptorSet write = {};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write.pNext = nullptr;
-        write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-        write.descriptorCount = 1;
-        write.dstSet = bindless_set;
-        write.dstBinding = BINDLESS_SAMPLERS_SLOT;
-        write.dstArrayElement = index;
-        write.pBufferInfo = nullptr;
-        write.pImageInfo = &info;
-        write.pTexelBufferView = nullptr;
-
-        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+        auto index = allocate_slot(sampler_slots);
+
+        if(index == INVALID_SLOT)
+        {
+            return INVALID_SLOT;
+        }
+
+        pending_write_t write = {};
+        write.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+        write.set = BINDLESS_SAMPLERS_SET;
+        write.binding = BINDLESS_SAMPLERS_SLOT;
+        write.index = index;
+        write.image_info.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        write.image_info.imageView = VK_NULL_HANDLE;
+        write.image_info.sampler = sampler->get_handle();
+
+        queue_write(write);
         return index;
     }
 
 
+    // A slot is reused only after it was unbound, the writes which weren't
+    // flushed yet must not reach the set since they refer to dead handles.
+    void device_t::unbind(const image_t* image) const
+    {
+        auto index = image->get_slot();
+
+        if(index == INVALID_SLOT)
+        {
+            return;
+        }
+
+        drop_writes(BINDLESS_SAMPLED_IMAGES_SET, index);
+        drop_writes(BINDLESS_STORAGE_IMAGES_SET, index);
+        image_slots.free(index);
+    }
+
+
+    void device_t::unbind(const buffer_t* buffer) const
+    {
+        auto index = buffer->get_slot();
+
+        if(index == INVALID_SLOT)
+        {
+            return;
+        }
+
+        drop_writes(BINDLESS_BUFFERS_SET, index);
+        buffer_slots.free(index);
+    }
+
+
+    void device_t::unbind(const sampler_t* sampler) const
+    {
+        auto index = sampler->get_slot();
+
+        if(index == INVALID_SLOT)
+        {
+            return;
+        }
+
+        drop_writes(BINDLESS_SAMPLERS_SET, index);
+        sampler_slots.free(index);
+    }
+
+
     void device_t::destroy_bindless_system()
     {
         vkDestroyDescriptorPool(device, bindless_pool, nullptr);
-        vkDestroyDescriptorSetLayout(device, bindless_layout, nullptr);
+
+        for(auto layout : bindless_layouts)
+        {
+            vkDestroyDescriptorSetLayout(device, layout, nullptr);
+        }
     }
 
 }
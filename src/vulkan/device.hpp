@@ -21,9 +21,13 @@
 
 #include "../window/window.hpp"
 
+#include <mutex>
+
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
-#include <bitmap_tree.hpp>
+
+#include "core/slot_allocator.hpp"
+#include "vk.glslh"
 
 
 namespace bpmap::vk
@@ -37,9 +41,12 @@ namespace bpmap::vk
 
     struct device_desc_t
     {
-        uint32_t max_bindless_buffers = 4096 * 64;
-        uint32_t max_bindless_images = 4096 * 64;
-        uint32_t max_bindless_samplers = 4096 * 64;
+        // Initial sizes of the bindless tables. They grow on demand up to
+        // the device limits (capped at max_bindless_descriptors).
+        uint32_t bindless_buffers = 64;
+        uint32_t bindless_images = 64;
+        uint32_t bindless_samplers = 16;
+        uint32_t max_bindless_descriptors = 4096 * 64;
         uint32_t max_push_constants = 32;
     };
 
@@ -81,22 +88,63 @@ namespace bpmap::vk
         error_t get_swapchain_images();
         error_t create_allocator();
 
-        // Bindless system;
-        mutable bmt::tree_t<uint64_t> image_slots;
-        mutable bmt::tree_t<uint64_t> sampler_slots;
-        mutable bmt::tree_t<uint64_t> buffer_slots;
-        VkDescriptorPool bindless_pool;
-        VkDescriptorSetLayout bindless_layout;
-        VkDescriptorSet bindless_set;
+        // Bindless system. Slots can be bound from any thread, the descriptor
+        // writes are queued and applied by flush_bindless_writes on the thread
+        // which records the command buffers.
+        struct pending_write_t
+        {
+            VkDescriptorType type;
+            uint32_t set;
+            uint32_t binding;
+            uint32_t index;
+            VkDescriptorImageInfo image_info;
+            VkDescriptorBufferInfo buffer_info;
+        };
+
+        using bindless_layouts_t = array_t<VkDescriptorSetLayout, BINDLESS_SETS_COUNT>;
+        using bindless_sets_t = array_t<VkDescriptorSet, BINDLESS_SETS_COUNT>;
+        using bindless_sizes_t = array_t<uint32_t, BINDLESS_SETS_COUNT>;
+
+        mutable slot_allocator_t image_slots;
+        mutable slot_allocator_t sampler_slots;
+        mutable slot_allocator_t buffer_slots;
+        mutable std::mutex pending_writes_mutex;
+        mutable darray_t<pending_write_t> pending_writes;
+
+        // Every descriptor written so far, keyed by set and index, used to
+        // fill the new sets when the tables grow.
+        mutable hash_table_t<uint64_t, pending_write_t> bound_descriptors;
+
+        // The pool and the sets are replaced when a table grows, which can
+        // happen in any flush.
+        mutable VkDescriptorPool bindless_pool;
+        mutable bindless_sets_t bindless_sets;
+        mutable bindless_sizes_t bindless_sizes;
+        mutable uint64_t bindless_generation;
+        bindless_layouts_t bindless_layouts;
+        bindless_sizes_t bindless_limits;
         VkPushConstantRange push_range;
 
         error_t init_bindless_system(const device_desc_t& desc);
+        error_t create_bindless_layouts();
+        error_t allocate_bindless_sets(const bindless_sizes_t& sizes) const;
+        error_t grow_bindless_sets(const bindless_sizes_t& sizes) const;
         void destroy_bindless_system();
 
+        uint32_t allocate_slot(slot_allocator_t& slots) const;
+        void queue_write(const pending_write_t& write) const;
+        void drop_writes(uint32_t set, uint32_t index) const;
+
     public:
 
-        VkDescriptorSetLayout get_bindless_layout() const { return bindless_layout; }
-        VkDescriptorSet get_bindless_set() const { return bindless_set; }
+        const VkDescriptorSetLayout* get_bindless_layouts() const { return bindless_layouts.data(); }
+        const VkDescriptorSet* get_bindless_sets() const { return bindless_sets.data(); }
+        static constexpr uint32_t get_bindless_sets_count() { return BINDLESS_SETS_COUNT; }
+
+        // Changes every time the bindless sets are replaced, command buffers
+        // recorded with an older generation bind destroyed sets.
+        uint64_t get_bindless_generation() const { return bindless_generation; }
+
         const VkPushConstantRange& get_push_range() const { return push_range; }
 
         error_t init(window_t&, const device_desc_t& desc = device_desc_t());
@@ -105,6 +153,15 @@ namespace bpmap::vk
         uint32_t bind(const buffer_t* buffer) const;
         uint32_t bind(const sampler_t* sampler) const;
 
+        void unbind(const image_t* image) const;
+        void unbind(const buffer_t* buffer) const;
+        void unbind(const sampler_t* sampler) const;
+
+        // Applies the descriptor writes of all binds since the last flush,
+        // has to be called before recording work which uses new slots. Grows
+        // the bindless sets when needed, which waits for the device to idle.
+        error_t flush_bindless_writes() const;
+
         error_t create_pipeline_layout(
                                         VkPipelineLayout& layout,
                                         const VkPipelineLayoutCreateInfo& plci
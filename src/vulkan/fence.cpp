@@ -37,12 +37,12 @@ namespace bpmap::vk
         }
     }
 
-    error_t fence_t::create(const device_t& device)
+    error_t fence_t::create(const device_t& device, bool_t signaled)
     {
         VkFenceCreateInfo fci;
         fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fci.pNext = nullptr;
-        fci.flags = 0;
+        fci.flags = signaled? VK_FENCE_CREATE_SIGNALED_BIT : 0;
 
         if(vkCreateFence(device.get_device(), &fci, nullptr, &fence) != VK_SUCCESS)
         {
@@ -70,4 +70,14 @@ namespace bpmap::vk
 
         return error_t::device_lost;
     }
+
+    error_t fence_t::reset()
+    {
+        if(vkResetFences(dev->get_device(), 1, &fence) != VK_SUCCESS)
+        {
+            return error_t::device_lost;
+        }
+
+        return error_t::success;
+    }
 }
@@ -32,8 +32,9 @@ namespace bpmap::vk
 
     public:
         VkFence get_handle() const { return fence; }
-        error_t create(const device_t& device);
+        error_t create(const device_t& device, bool_t signaled = false);
         error_t wait(uint64_t timeout = 0);
+        error_t reset();
         fence_t();
         ~fence_t();
     };
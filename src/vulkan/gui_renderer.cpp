@@ -15,6 +15,7 @@
 // You should have received a copy of the GNU General Public License
 // along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cstddef>
 #include <limits>
 
@@ -239,15 +240,14 @@ namespace bpmap
     error_t gui_renderer_t::create_pipeline_layout()
     {
         auto push_range = vulkan->get_push_range();
-        auto layout = vulkan->get_bindless_layout();
         VkPipelineLayoutCreateInfo plci = {};
         plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         plci.pNext = nullptr;
         plci.flags = 0;
         plci.pushConstantRangeCount = 1;
         plci.pPushConstantRanges = &push_range;
-        plci.setLayoutCount = 1;
-        plci.pSetLayouts = &layout;
+        plci.setLayoutCount = vulkan->get_bindless_sets_count();
+        plci.pSetLayouts = vulkan->get_bindless_layouts();
 
         return vulkan->create_pipeline_layout(pipeline_layout, plci);
     }
@@ -516,7 +516,8 @@ namespace bpmap
 
     error_t gui_renderer_t::create_command_buffers()
     {
-        command_buffers.resize(framebuffers.size());
+        darray_t<VkCommandBuffer> command_buffers(frames.size());
+        darray_t<VkCommandBuffer> gui_command_buffers(frames.size());
 
         VkCommandBufferAllocateInfo cbai = {};
         cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -525,30 +526,86 @@ namespace bpmap
         cbai.commandPool = command_pool.pool;
         cbai.commandBufferCount = command_buffers.size();
 
-        return vulkan->create_command_buffers(command_buffers.data(), cbai);
-    }
+        auto status = vulkan->create_command_buffers(command_buffers.data(), cbai);
 
-    error_t gui_renderer_t::create_semaphores()
-    {
-        auto status = image_available.create(*vulkan);
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+        status = vulkan->create_command_buffers(gui_command_buffers.data(), cbai);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        return render_finished.create(*vulkan);
+        for(auto i = 0u; i < frames.size(); ++i)
+        {
+            frames[i].command_buffer = command_buffers[i];
+            frames[i].gui_command_buffer = gui_command_buffers[i];
+        }
+
+        return error_t::success;
     }
 
-    error_t gui_renderer_t::allocate_buffers()
+    error_t gui_renderer_t::create_frames(const gui_renderer_desc_t& desc)
     {
+        auto frames_in_flight = std::max(desc.frames_in_flight, 1u);
+
+        for(auto i = 0u; i < frames_in_flight; ++i)
+        {
+            auto& frame = frames.emplace_back();
+
+            auto status = frame.image_available.create(*vulkan);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = frame.render_finished.create(*vulkan);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            // Created signaled so the first wait on every frame passes.
+            status = frame.in_flight.create(*vulkan, true);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            frame.command_buffer = VK_NULL_HANDLE;
+            frame.gui_command_buffer = VK_NULL_HANDLE;
+            frame.gui_hash = 0;
+            frame.gui_generation = 0;
+            frame.gui_valid = false;
+            frame.vertex_offset = i * max_gui_vbuffer_size;
+            frame.index_offset = i * max_gui_ibuffer_size;
+        }
+
+        frame_arena.init(frames.size());
 
+        return error_t::success;
+    }
+
+    error_t gui_renderer_t::allocate_buffers()
+    {
+        // Every frame in flight gets its own region in the buffers which stay
+        // mapped for the lifetime of the renderer.
         vk::buffer_desc_t index_buffer_desc =
         {
-            .size = max_gui_ibuffer_size,
+            .size = frames.size() * max_gui_ibuffer_size,
             .usage = vk::buffer_usage_index_buffer,
             .on_gpu = false,
-            .dont_bind = true
+            .dont_bind = true,
+            .persistently_mapped = true
         };
 
         auto status = index_buffer.create(*vulkan, index_buffer_desc);
@@ -559,10 +616,11 @@ namespace bpmap
 
         vk::buffer_desc_t vertex_buffer_desc =
         {
-            .size = max_gui_vbuffer_size,
+            .size = frames.size() * max_gui_vbuffer_size,
             .usage = vk::buffer_usage_vertex_buffer,
             .on_gpu = false,
-            .dont_bind = true
+            .dont_bind = true,
+            .persistently_mapped = true
         };
 
         status = vertex_buffer.create(*vulkan, vertex_buffer_desc);
@@ -571,32 +629,126 @@ namespace bpmap
             return status;
         }
 
+        if(!index_buffer.get_mapped() || !vertex_buffer.get_mapped())
+        {
+            return error_t::memory_mapping_fail;
+        }
+
+        return error_t::success;
+    }
+
+    error_t gui_renderer_t::create_buffers(frame_t& frame)
+    {
+        auto ibuffer = (uint8_t*) index_buffer.get_mapped() + frame.index_offset;
+        auto vbuffer = (uint8_t*) vertex_buffer.get_mapped() + frame.vertex_offset;
+
+        gui->emit_buffers(frame_arena.get(), ibuffer, max_gui_ibuffer_size, vbuffer, max_gui_vbuffer_size);
+
+        auto status = index_buffer.flush(frame.index_offset, max_gui_ibuffer_size);
+
         if(status != error_t::success)
         {
             return status;
         }
 
-        return error_t::success;
+        return vertex_buffer.flush(frame.vertex_offset, max_gui_vbuffer_size);
     }
 
-    error_t gui_renderer_t::create_buffers()
+
+    error_t gui_renderer_t::record_gui_commands(frame_t& frame)
     {
-        void* ibuffer;
-        index_buffer.map(&ibuffer);
+        VkCommandBufferInheritanceInfo cbii = {};
+        cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        cbii.pNext = nullptr;
+        cbii.renderPass = render_pass_gui;
+        cbii.subpass = 0;
+        cbii.framebuffer = VK_NULL_HANDLE;
+        cbii.occlusionQueryEnable = VK_FALSE;
+        cbii.queryFlags = 0;
+        cbii.pipelineStatistics = 0;
+
+        VkCommandBufferBeginInfo cbbi = {};
+        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cbbi.pNext = nullptr;
+        cbbi.pInheritanceInfo = &cbii;
+        cbbi.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
 
-        void* vbuffer;
-        vertex_buffer.map(&vbuffer);
+        auto command_buffer = frame.gui_command_buffer;
 
-        gui->emit_buffers(ibuffer, max_gui_ibuffer_size, vbuffer, max_gui_vbuffer_size);
+        vkResetCommandBuffer(command_buffer, 0);
 
-        index_buffer.unmap();
-        vertex_buffer.unmap();
+        if(vkBeginCommandBuffer(command_buffer, &cbbi) != VK_SUCCESS)
+        {
+            return error_t::command_buffer_begin_fail;
+        }
+
+        VkViewport viewport;
+        viewport.height = gui->get_height();
+        viewport.width = gui->get_width();
+        viewport.x = 0.0;
+        viewport.y = 0.0;
+        viewport.minDepth = 0.0;
+        viewport.maxDepth = 1.0;
+
+
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+
+        vkCmdPushConstants(
+                            command_buffer,
+                            pipeline_layout,
+                            VK_SHADER_STAGE_ALL,
+                            0,
+                            sizeof(gui_data),
+                            &gui_data
+                          );
+
+        vkCmdBindDescriptorSets(
+                                 command_buffer,
+                                 VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                 pipeline_layout,
+                                 0,
+                                 vulkan->get_bindless_sets_count(),
+                                 vulkan->get_bindless_sets(),
+                                 0,
+                                 nullptr
+                                );
+
+        VkBuffer vertex_buffer_handle = vertex_buffer.get_handle();
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer_handle, &frame.vertex_offset);
+        vkCmdBindIndexBuffer(command_buffer, index_buffer.get_handle(), frame.index_offset, VK_INDEX_TYPE_UINT16);
+
+        auto cmds = gui->emit_draw_calls(frame_arena.get());
+
+        for(auto& cmd : cmds)
+        {
+            VkExtent2D extent;
+            extent.width = cmd.scissor_width;
+            extent.height = cmd.scissor_height;
+
+            VkOffset2D offset;
+            offset.x = cmd.scissor_horizontal_offset;
+            offset.y = cmd.scissor_vertical_offset;
+
+            VkRect2D scissor;
+            scissor.extent = extent;
+            scissor.offset = offset;
+
+            vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+            vkCmdDrawIndexed(command_buffer, cmd.elements, 1, cmd.offset, 0, 0);
+        }
+
+        vkEndCommandBuffer(command_buffer);
+
+        frame.gui_valid = true;
 
         return error_t::success;
     }
 
-
-    error_t gui_renderer_t::build_command_buffer(uint32_t index)
+    error_t gui_renderer_t::build_command_buffer(frame_t& frame, uint32_t fb_index)
     {
         VkCommandBufferBeginInfo cbbi = {};
         cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -604,9 +756,11 @@ namespace bpmap
         cbbi.pInheritanceInfo = nullptr;
         cbbi.flags = 0;
 
-        vkResetCommandBuffer(command_buffers[index], 0);
+        auto command_buffer = frame.command_buffer;
 
-        if(vkBeginCommandBuffer(command_buffers[index], &cbbi) != VK_SUCCESS)
+        vkResetCommandBuffer(command_buffer, 0);
+
+        if(vkBeginCommandBuffer(command_buffer, &cbbi) != VK_SUCCESS)
         {
             return error_t::command_buffer_begin_fail;
         }
@@ -628,7 +782,7 @@ namespace bpmap
         rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         rpbi.pNext = nullptr;
         rpbi.renderPass = render_pass_ro;
-        rpbi.framebuffer = framebuffers[index];
+        rpbi.framebuffer = framebuffers[fb_index];
         rpbi.clearValueCount = 1;
         rpbi.pClearValues = &clear_values;
         rpbi.renderArea = render_area;
@@ -642,34 +796,31 @@ namespace bpmap
         viewport.maxDepth = 1.0;
 
 
-        vkCmdBeginRenderPass(command_buffers[index], &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(command_buffer, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
 
-        vkCmdBindPipeline(command_buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, render_output_pipeline);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, render_output_pipeline);
 
-        auto descriptor_set = vulkan->get_bindless_set();
         vkCmdBindDescriptorSets(
-                                 command_buffers[index],
+                                 command_buffer,
                                  VK_PIPELINE_BIND_POINT_GRAPHICS,
                                  pipeline_layout,
                                  0,
-                                 1,
-                                 &descriptor_set,
+                                 vulkan->get_bindless_sets_count(),
+                                 vulkan->get_bindless_sets(),
                                  0,
                                  nullptr
                                 );
 
-        gui_data = gui->get_gui_data();
-        gui_data.font_texture_id = font_image.get_slot();
-        gui_data.font_sampler_id = font_sampler->get_slot();
-
-        darray_t<uint32_t> slots;
-        slots.push_back(renderer->get_output().get_slot());
-        slots.push_back(ro_sampler->get_slot());
-        slots.push_back(*((uint32_t*)&gui_data.render_a));
-        slots.push_back(*((uint32_t*)&gui_data.render_gamma));
+        array_t<uint32_t, 4> slots =
+        {
+            renderer->get_output().get_slot(),
+            ro_sampler->get_slot(),
+            *((uint32_t*)&gui_data.render_a),
+            *((uint32_t*)&gui_data.render_gamma)
+        };
 
         vkCmdPushConstants(
-                            command_buffers[index],
+                            command_buffer,
                             pipeline_layout,
                             VK_SHADER_STAGE_ALL,
                             0,
@@ -677,11 +828,11 @@ namespace bpmap
                             slots.data()
                           );
 
-        vkCmdSetScissor(command_buffers[index], 0, 1, &render_area);
-        vkCmdSetViewport(command_buffers[index], 0, 1, &viewport);
+        vkCmdSetScissor(command_buffer, 0, 1, &render_area);
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
-        vkCmdDraw(command_buffers[index], 6, 1, 0, 0);
-        vkCmdEndRenderPass(command_buffers[index]);
+        vkCmdDraw(command_buffer, 6, 1, 0, 0);
+        vkCmdEndRenderPass(command_buffer);
 
         VkMemoryBarrier barrier;
         barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
@@ -690,7 +841,7 @@ namespace bpmap
         barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
         vkCmdPipelineBarrier(
-                              command_buffers[index],
+                              command_buffer,
                               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                               VK_DEPENDENCY_BY_REGION_BIT,
@@ -704,75 +855,23 @@ namespace bpmap
 
         // Draw Gui
         rpbi.renderPass = render_pass_gui;
-        vkCmdBeginRenderPass(command_buffers[index], &rpbi, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdSetViewport(command_buffers[index], 0, 1, &viewport);
-
-        vkCmdBindPipeline(command_buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-
-        vkCmdPushConstants(
-                            command_buffers[index],
-                            pipeline_layout,
-                            VK_SHADER_STAGE_ALL,
-                            0,
-                            sizeof(gui_data),
-                            &gui_data
-                          );
-
-        vkCmdBindDescriptorSets(
-                                 command_buffers[index],
-                                 VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                 pipeline_layout,
-                                 0,
-                                 1,
-                                 &descriptor_set,
-                                 0,
-                                 nullptr
-                                );
-
-        VkDeviceSize off = 0;
-        VkBuffer vertex_buffer_handle = vertex_buffer.get_handle();
-        vkCmdBindVertexBuffers(command_buffers[index], 0, 1, &vertex_buffer_handle, &off);
-        vkCmdBindIndexBuffer(command_buffers[index], index_buffer.get_handle(), off, VK_INDEX_TYPE_UINT16);
-
-        auto cmds = gui->emit_draw_calls();
-
-        for(auto& cmd : cmds)
-        {
-            VkExtent2D extent;
-            extent.width = cmd.scissor_width;
-            extent.height = cmd.scissor_height;
-
-            VkOffset2D offset;
-            offset.x = cmd.scissor_horizontal_offset;
-            offset.y = cmd.scissor_vertical_offset;
-
-            VkRect2D scissor;
-            scissor.extent = extent;
-            scissor.offset = offset;
-
-            vkCmdSetScissor(command_buffers[index], 0, 1, &scissor);
+        vkCmdBeginRenderPass(command_buffer, &rpbi, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-            vkCmdDrawIndexed(command_buffers[index], cmd.elements, 1, cmd.offset, 0, 0);
-        }
+        vkCmdExecuteCommands(command_buffer, 1, &frame.gui_command_buffer);
 
-        vkCmdEndRenderPass(command_buffers[index]);
+        vkCmdEndRenderPass(command_buffer);
 
-        vkEndCommandBuffer(command_buffers[index]);
+        vkEndCommandBuffer(command_buffer);
         
         return error_t::success;
     }
 
-    error_t gui_renderer_t::submit_command_buffer(uint32_t index)
+    error_t gui_renderer_t::submit_command_buffer(frame_t& frame)
     {
-        vk::fence_t done_rendering;
-        done_rendering.create(*vulkan);
-
         VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-        auto image_available_semaphore = image_available.get_handle();
-        auto render_finished_semaphore = render_finished.get_handle();
+        auto image_available_semaphore = frame.image_available.get_handle();
+        auto render_finished_semaphore = frame.render_finished.get_handle();
         VkSubmitInfo submit_info = {};
         submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submit_info.pNext = nullptr;
@@ -782,24 +881,29 @@ namespace bpmap
         submit_info.signalSemaphoreCount = 1;
         submit_info.pSignalSemaphores = &render_finished_semaphore;
         submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffers[index];
+        submit_info.pCommandBuffers = &frame.command_buffer;
 
-        static constexpr uint64_t timeout = std::numeric_limits<uint64_t>::max();
+        auto status = frame.in_flight.reset();
 
-        vulkan->submit_work(submit_info, &done_rendering);
+        if(status != error_t::success)
+        {
+            return status;
+        }
 
-        return done_rendering.wait(timeout);
+        // No wait here, the fence is only waited on when the frame comes
+        // around again so the CPU can prepare the next frames meanwhile.
+        return vulkan->submit_work(submit_info, &frame.in_flight);
     }
 
-    error_t gui_renderer_t::present_on_screen(uint64_t index)
+    error_t gui_renderer_t::present_on_screen(frame_t& frame, uint32_t fb_index)
     {
-        return vulkan->present_on_screen(index, &render_finished);
+        return vulkan->present_on_screen(fb_index, &frame.render_finished);
     }
 
 
-    error_t gui_renderer_t::init()
+    error_t gui_renderer_t::init(const gui_renderer_desc_t& desc)
     {
-        auto status = create_semaphores();
+        auto status = create_frames(desc);
 
         if(status != error_t::success)
         {
@@ -841,6 +945,8 @@ namespace bpmap
             return status;
         }
 
+        images_in_flight.resize(framebuffers.size(), nullptr);
+
         status = create_command_pool();
 
         if(status != error_t::success)
@@ -874,45 +980,112 @@ namespace bpmap
 
     error_t gui_renderer_t::render_frame()
     {
-        gui->get_input();
-        gui->run();
+        static constexpr uint64_t timeout = std::numeric_limits<uint64_t>::max();
+
+        auto& frame = frames[current_frame];
+
+        // Only this frame's resources have to be free, the others may still be
+        // in flight.
+        auto status = frame.in_flight.wait(timeout);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
 
-        auto status = create_buffers();
+        frame_arena.begin_frame(current_frame);
+
+        // Resources may have been bound from other threads since last frame.
+        status = vulkan->flush_bindless_writes();
 
         if(status != error_t::success)
         {
             return status;
         }
 
+        gui->get_input();
+        gui->run();
+
+        gui_data = gui->get_gui_data();
+        gui_data.font_texture_id = font_image.get_slot();
+        gui_data.font_sampler_id = font_sampler->get_slot();
+
+        // The geometry and the gui pass of this frame slot are only rebuilt
+        // when the nuklear commands differ from the ones they were made from.
+        auto gui_hash = gui->get_commands_hash();
+
+        auto generation = vulkan->get_bindless_generation();
+
+        if(!frame.gui_valid || frame.gui_hash != gui_hash || frame.gui_generation != generation)
+        {
+            status = create_buffers(frame);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = record_gui_commands(frame);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            frame.gui_hash = gui_hash;
+            frame.gui_generation = generation;
+        }
+
         uint32_t fb_index;
 
-        status = vulkan->get_next_swapchain_image(fb_index, &image_available);
+        status = vulkan->get_next_swapchain_image(fb_index, &frame.image_available);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = build_command_buffer(fb_index);
+        // The image may be still used by a frame other than the current one
+        // when there are more frames in flight than swapchain images.
+        auto image_fence = images_in_flight[fb_index];
+
+        if(image_fence != nullptr && image_fence != &frame.in_flight)
+        {
+            status = image_fence->wait(timeout);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        images_in_flight[fb_index] = &frame.in_flight;
+
+        status = build_command_buffer(frame, fb_index);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = submit_command_buffer(fb_index);
+        status = submit_command_buffer(frame);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        return present_on_screen(fb_index);
+        current_frame = (current_frame + 1) % frames.size();
+
+        return present_on_screen(frame, fb_index);
     }
 
 
     gui_renderer_t::~gui_renderer_t()
     {
+        // Frames in flight still reference the pipelines and framebuffers.
+        vulkan->wait_idle();
+
         vulkan->destroy_pipeline(pipeline);
         vulkan->destroy_pipeline(render_output_pipeline);
         vulkan->destroy_pipeline_layout(pipeline_layout);
@@ -20,6 +20,7 @@
 #define GUI_RENDERER_HPP
 
 #include "core/algebra.hpp"
+#include "core/arena.hpp"
 #include "core/io.hpp"
 #include "vulkan.hpp"
 #include "renderer.hpp"
@@ -27,8 +28,37 @@
 
 namespace bpmap
 {
+    struct gui_renderer_desc_t
+    {
+        // How many frames the CPU may record ahead of the GPU.
+        uint32_t frames_in_flight = 2;
+    };
+
     class gui_renderer_t
     {
+        // Everything a frame needs that must not be touched by the CPU while
+        // the GPU still works on it.
+        struct frame_t
+        {
+            vk::semaphore_t image_available;
+            vk::semaphore_t render_finished;
+            vk::fence_t in_flight;
+
+            VkCommandBuffer command_buffer;
+
+            // Secondary command buffer with the gui pass, kept as long as the
+            // gui commands hash to the same value and the bindless sets
+            // weren't replaced.
+            VkCommandBuffer gui_command_buffer;
+            uint64_t gui_hash;
+            uint64_t gui_generation;
+            bool_t gui_valid;
+
+            // Offsets of the frame's regions in the shared gui buffers.
+            VkDeviceSize vertex_offset;
+            VkDeviceSize index_offset;
+        };
+
         VkPipeline pipeline;
         VkPipeline render_output_pipeline;
         VkPipelineLayout pipeline_layout;
@@ -41,10 +71,17 @@ namespace bpmap
         darray_t<VkFramebuffer> framebuffers;
 
         vk::command_pool_t command_pool;
-        darray_t<VkCommandBuffer> command_buffers;
 
-        vk::semaphore_t image_available;
-        vk::semaphore_t render_finished;
+        // Frames are never moved since the semaphores and fences can't be.
+        deque_t<frame_t> frames;
+        uint32_t current_frame = 0;
+
+        // The fence of the frame that last rendered to each swapchain image.
+        darray_t<vk::fence_t*> images_in_flight;
+
+        // Transient memory of the frames, the nuklear command buffer and the
+        // draw calls.
+        frame_arena_t frame_arena;
 
         vk::shader_t render_output_vertex_shader;
         vk::shader_t render_output_fragment_shader;
@@ -74,14 +111,15 @@ namespace bpmap
         error_t create_shaders();
         error_t create_command_pool();
         error_t create_command_buffers();
-        error_t create_semaphores();
+        error_t create_frames(const gui_renderer_desc_t& desc);
         error_t allocate_buffers();
-        error_t create_buffers();
+        error_t create_buffers(frame_t& frame);
         error_t upload_gui_data();
 
-        error_t build_command_buffer(uint32_t index);
-        error_t submit_command_buffer(uint32_t index);
-        error_t present_on_screen(uint64_t index);
+        error_t record_gui_commands(frame_t& frame);
+        error_t build_command_buffer(frame_t& frame, uint32_t fb_index);
+        error_t submit_command_buffer(frame_t& frame);
+        error_t present_on_screen(frame_t& frame, uint32_t fb_index);
 
     public:
         static constexpr const char_t* gui_vs_name = "gui.vert.spv";
@@ -89,6 +127,11 @@ namespace bpmap
         static constexpr const char_t* render_output_vs_name = "render_output.vert.spv";
         static constexpr const char_t* render_output_fs_name = "render_output.frag.spv";
 
+        // Bindless resources the gui renderer binds, the font image and the
+        // font and render output samplers.
+        static constexpr uint32_t bindless_images_count = 1;
+        static constexpr uint32_t bindless_samplers_count = 2;
+
         static constexpr uint32_t max_gui_ibuffer_size = 1 << 16;
         static constexpr uint32_t max_gui_vbuffer_size = 1 << 20;
 
@@ -100,7 +143,7 @@ namespace bpmap
                         const renderer_t& r
                       );
 
-        error_t init();
+        error_t init(const gui_renderer_desc_t& desc = gui_renderer_desc_t());
 
         error_t render_frame();
 
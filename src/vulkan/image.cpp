@@ -146,6 +146,7 @@ namespace bpmap::vk
         }
         if(view != VK_NULL_HANDLE)
         {
+            dev->unbind(this);
             vkDestroyImageView(dev->get_device(), view, nullptr);
         }
     }
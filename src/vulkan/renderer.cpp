@@ -2,6 +2,7 @@
 #include <limits>
 
 #include <core/io.hpp>
+#include <scene/scene_loader.hpp>
 
 #include "renderer.hpp"
 
@@ -69,6 +70,23 @@ namespace bpmap
             return status;
         }
 
+        status = create_render_buffers();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        if(!streamed)
+        {
+            status = create_upload_ring();
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
         status = create_buffers();
 
         if(status != error_t::success)
@@ -79,7 +97,210 @@ namespace bpmap
         return error_t::success;
     }
 
-    bool_t renderer_t::is_not_busy()
+    error_t renderer_t::stream_scene(const string_t& path, scene_t& scene)
+    {
+        auto status = create_upload_ring();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        status = bpmap::stream_scene(path, scene, get_geometry_stream());
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        streamed = true;
+
+        return upload_ring.flush();
+    }
+
+    geometry_stream_t renderer_t::get_geometry_stream()
+    {
+        geometry_stream_t stream;
+
+        stream.reserve = [this](const geometry_sizes_t& sizes)
+        {
+            // The old buffers may still be the destination of copies.
+            auto status = upload_ring.finish();
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = create_device_buffer(vertices, sizes.vertices * sizeof(point3d_t));
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = create_device_buffer(normals, sizes.normals * sizeof(codirection3d_t));
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = create_device_buffer(texcoords, sizes.texcoords * sizeof(point2d_t));
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            return create_device_buffer(triangles, sizes.triangles * sizeof(triangle_t));
+        };
+
+        stream.write = [this](geometry_array_t array, size_t first, const void* data, size_t count)
+        {
+            switch(array)
+            {
+                case geometry_array_t::vertices:
+                    return upload_ring.upload(vertices, first * sizeof(point3d_t), data, count * sizeof(point3d_t));
+
+                case geometry_array_t::normals:
+                    return upload_ring.upload(
+                                               normals,
+                                               first * sizeof(codirection3d_t),
+                                               data,
+                                               count * sizeof(codirection3d_t)
+                                             );
+
+                case geometry_array_t::texcoords:
+                    return upload_ring.upload(texcoords, first * sizeof(point2d_t), data, count * sizeof(point2d_t));
+
+                case geometry_array_t::triangles:
+                default:
+                    return upload_ring.upload(triangles, first * sizeof(triangle_t), data, count * sizeof(triangle_t));
+            }
+        };
+
+        return stream;
+    }
+
+    error_t renderer_t::reload_scene(
+                                      const string_t& path,
+                                      const hash_set_t<string_t>& changed_files,
+                                      scene_t& scene
+                                    )
+    {
+        // Everything below rewrites buffers the render work reads.
+        is_not_busy(std::numeric_limits<uint64_t>::max());
+
+        scene_changes_t changes;
+
+        // A reload which failed part way may have created the geometry
+        // buffers again already, so what it applied is uploaded and recorded
+        // all the same.
+        auto loaded = bpmap::reload_scene(path, changed_files, scene, get_geometry_stream(), changes);
+        auto status = error_t::success;
+
+        if(changes.settings)
+        {
+            void* mapped_settings;
+            status = scene_settings.map(&mapped_settings);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            memcpy(mapped_settings, &scene.settings, sizeof(scene.settings));
+            scene_settings.unmap();
+
+            // The light resampling may have changed.
+            status = create_reservoirs();
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        if(changes.lights)
+        {
+            status = update_buffer(lights, scene.lights);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = update_buffer(light_aliases, scene.light_aliases);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = update_buffer(light_bvh, scene.light_bvh);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = update_buffer(light_trails, scene.light_trails);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        if(changes.environment)
+        {
+            status = update_buffer(environment, scene.environment);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = update_buffer(environment_aliases, scene.environment_aliases);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        if(changes.materials)
+        {
+            status = update_buffer(materials, scene.materials);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        status = upload_ring.finish();
+
+        if(status != error_t::success || !changes.any())
+        {
+            return (status == error_t::success) ? loaded : status;
+        }
+
+        // Buffers which were created again have new slots.
+        status = build_command_buffers();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        status = submit_command_buffers();
+
+        return (status == error_t::success) ? loaded : status;
+    }
+
+    bool_t renderer_t::is_not_busy(uint64_t timeout)
     {
         if(!busy)
         {
@@ -87,7 +308,7 @@ namespace bpmap
         }
 
 
-        if(render_finished.wait() == error_t::success)
+        if(render_finished.wait(timeout) == error_t::success)
         {
             busy = false;
         }
@@ -97,6 +318,15 @@ namespace bpmap
 
     error_t renderer_t::build_command_buffers()
     {
+        auto status = vulkan->flush_bindless_writes();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        recorded_generation = vulkan->get_bindless_generation();
+
         VkCommandBufferBeginInfo cbbi = {};
         cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         cbbi.pNext = nullptr;
@@ -112,14 +342,13 @@ namespace bpmap
 
         vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,compute_pipelines[raytrace_pipeline]);
 
-        auto descriptor_set = vulkan->get_bindless_set();
         vkCmdBindDescriptorSets(
                                   command_buffer,
                                   VK_PIPELINE_BIND_POINT_COMPUTE,
                                   compute_pipeline_layouts[raytrace_pipeline],
                                   0,
-                                  1,
-                                  &descriptor_set,
+                                  vulkan->get_bindless_sets_count(),
+                                  vulkan->get_bindless_sets(),
                                   0,
                                   nullptr
                                 );
@@ -128,15 +357,26 @@ namespace bpmap
         static constexpr uint32_t local_group_size_y = 8;
 
 
-        darray_t<uint32_t> slots;
-        slots.push_back(vertices.get_slot());
-        slots.push_back(normals.get_slot());
-        slots.push_back(texcoords.get_slot());
-        slots.push_back(materials.get_slot());
-        slots.push_back(triangles.get_slot());
-        slots.push_back(lights.get_slot());
-        slots.push_back(scene_settings.get_slot());
-        slots.push_back(render_output.get_slot());
+        array_t<uint32_t, 17> slots =
+        {
+            vertices.get_slot(),
+            normals.get_slot(),
+            texcoords.get_slot(),
+            materials.get_slot(),
+            triangles.get_slot(),
+            lights.get_slot(),
+            light_aliases.get_slot(),
+            light_bvh.get_slot(),
+            light_trails.get_slot(),
+            environment.get_slot(),
+            environment_aliases.get_slot(),
+            scene_settings.get_slot(),
+            render_output.get_slot(),
+            pixel_estimates.get_slot(),
+            tile_states.get_slot(),
+            render_state.get_slot(),
+            reservoirs.get_slot()
+        };
 
         vkCmdPushConstants(
                             command_buffer,
@@ -147,11 +387,86 @@ namespace bpmap
                             slots.data()
                           );
 
-        vkCmdDispatch(
-                       command_buffer,scene->settings.resolution_x / local_group_size_x,
-                       scene->settings.resolution_y / local_group_size_y,
-                       1
-                     );
+        // Spatiotemporal resampling takes every sample of a batch in two
+        // passes, the reservoirs of all the pixels are kept before any is
+        // reused.
+        darray_t<pair_t<raytrace_pass_t, uint32_t>> passes;
+
+        auto& settings = scene->settings;
+
+        if(settings.light_resampling == light_resampling_t::spatiotemporal)
+        {
+            auto samples_per_batch = settings.samples_per_batch ? settings.samples_per_batch : settings.samples_per_pixel;
+
+            for(uint32_t i = 0; i < samples_per_batch; ++i)
+            {
+                passes.push_back({raytrace_pass_t::candidates, i});
+                passes.push_back({raytrace_pass_t::shading, i});
+            }
+        }
+        else
+        {
+            passes.push_back({raytrace_pass_t::samples, 0});
+        }
+
+        // A pass continues the estimates, tile states and reservoirs of the
+        // last one.
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+
+        for(auto& [pass, sample] : passes)
+        {
+            array_t<uint32_t, 2> pass_constants = {uint32_t(pass), sample};
+
+            vkCmdPushConstants(
+                                command_buffer,
+                                compute_pipeline_layouts[raytrace_pipeline],
+                                VK_SHADER_STAGE_ALL,
+                                slots.size() * 4,
+                                pass_constants.size() * 4,
+                                pass_constants.data()
+                              );
+
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(
+                                  command_buffer,
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                  0,
+                                  1,
+                                  &barrier,
+                                  0,
+                                  nullptr,
+                                  0,
+                                  nullptr
+                                );
+
+            vkCmdDispatch(
+                           command_buffer,scene->settings.resolution_x / local_group_size_x,
+                           scene->settings.resolution_y / local_group_size_y,
+                           1
+                         );
+        }
+
+        // The host reads the count of active tiles.
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+        vkCmdPipelineBarrier(
+                              command_buffer,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_HOST_BIT,
+                              0,
+                              1,
+                              &barrier,
+                              0,
+                              nullptr,
+                              0,
+                              nullptr
+                            );
 
         vkEndCommandBuffer(command_buffer);
 
@@ -160,29 +475,106 @@ namespace bpmap
 
     error_t renderer_t::submit_command_buffers()
     {
-        if(is_not_busy())
+        if(!is_not_busy())
+        {
+            return error_t::success;
+        }
+
+        batch = 0;
+        converged = false;
+
+        return submit_batch();
+    }
+
+    error_t renderer_t::submit_next_batch()
+    {
+        if(converged || !is_not_busy())
+        {
+            return error_t::success;
+        }
+
+        auto status = render_state.invalidate(0, sizeof(render_state_t));
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        auto state = (const render_state_t*) render_state.get_mapped();
+
+        // Without adaptive sampling the first batch takes all the samples.
+        if(state->active_tiles == 0)
+        {
+            converged = true;
+            log("Render finished after ", batch + 1, " batches");
+
+            return error_t::success;
+        }
+
+        ++batch;
+
+        return submit_batch();
+    }
+
+    error_t renderer_t::submit_batch()
+    {
+        auto state = (render_state_t*) render_state.get_mapped();
+        state->batch = batch;
+        state->active_tiles = 0;
+
+        auto status = render_state.flush(0, sizeof(render_state_t));
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        // The command buffer binds the bindless sets, which are replaced
+        // when a table grows.
+        status = vulkan->flush_bindless_writes();
+
+        if(status != error_t::success)
         {
-            VkSubmitInfo submit_info = {};
-            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submit_info.pNext = nullptr;
-            submit_info.waitSemaphoreCount = 0;
-            submit_info.pWaitSemaphores = nullptr;
-            submit_info.pWaitDstStageMask = nullptr;
-            submit_info.signalSemaphoreCount = 0;
-            submit_info.pSignalSemaphores = nullptr;
-            submit_info.commandBufferCount = 1;
-            submit_info.pCommandBuffers = &command_buffer;
+            return status;
+        }
 
-            auto status = vulkan->submit_work(submit_info, &render_finished);
+        if(recorded_generation != vulkan->get_bindless_generation())
+        {
+            status = build_command_buffers();
 
             if(status != error_t::success)
             {
                 return status;
             }
+        }
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = nullptr;
+        submit_info.waitSemaphoreCount = 0;
+        submit_info.pWaitSemaphores = nullptr;
+        submit_info.pWaitDstStageMask = nullptr;
+        submit_info.signalSemaphoreCount = 0;
+        submit_info.pSignalSemaphores = nullptr;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+
+        status = render_finished.reset();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        status = vulkan->submit_work(submit_info, &render_finished);
 
-            busy = true;
+        if(status != error_t::success)
+        {
+            return status;
         }
 
+        busy = true;
+
         return error_t::success;
     }
 
@@ -314,68 +706,91 @@ namespace bpmap
     }
 
 
+    error_t renderer_t::create_upload_ring()
+    {
+        return upload_ring.init(*vulkan);
+    }
+
+
     error_t renderer_t::create_buffers()
     {
-        auto staging_buffer_size = std::max({
-                                                scene->vertices.size() * sizeof(decltype(scene->vertices)::value_type),
-                                                scene->normals.size() * sizeof(decltype(scene->normals)::value_type),
-                                                scene->texcoords.size() * sizeof(decltype(scene->texcoords)::value_type),
-                                                scene->materials.size() * sizeof(decltype(scene->materials)::value_type),
-                                                scene->triangles.size() * sizeof(decltype(scene->triangles)::value_type),
-                                                scene->lights.size() * sizeof(decltype(scene->lights)::value_type),
-                                                scene->objects.size() *  sizeof(decltype(scene->objects)::value_type)
-                                            });
-        vk::buffer_t staging_buffer;
-        
-        vk::buffer_desc_t staging_buffer_desc =
+        auto status = error_t::success;
+
+        // Streamed geometry is in its buffers already.
+        if(!streamed)
         {
-            .size = staging_buffer_size,
-            .usage = vk::buffer_usage_transfer_src,
-            .on_gpu = false,
-            .dont_bind = true,
-        };
+            status = create_and_upload_buffer(vertices, scene->vertices);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = create_and_upload_buffer(normals, scene->normals);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = create_and_upload_buffer(texcoords, scene->texcoords);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = create_and_upload_buffer(triangles, scene->triangles);
 
-        if(staging_buffer.create(*vulkan, staging_buffer_desc) != error_t::success)
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        status = create_and_upload_buffer(lights, scene->lights);
+
+        if(status != error_t::success)
         {
-            return error_t::buffer_creation_fail;
+            return status;
         }
 
-        auto status = create_and_upload_buffer(vertices, scene->vertices, staging_buffer);
+        status = create_and_upload_buffer(light_aliases, scene->light_aliases);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = create_and_upload_buffer(normals, scene->normals, staging_buffer);
+        status = create_and_upload_buffer(light_bvh, scene->light_bvh);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = create_and_upload_buffer(texcoords, scene->texcoords, staging_buffer);
+        status = create_and_upload_buffer(light_trails, scene->light_trails);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = create_and_upload_buffer(lights, scene->lights, staging_buffer);
+        status = create_and_upload_buffer(environment, scene->environment);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = create_and_upload_buffer(materials, scene->materials, staging_buffer);
+        status = create_and_upload_buffer(environment_aliases, scene->environment_aliases);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        status = create_and_upload_buffer(triangles, scene->triangles, staging_buffer);
+        status = create_and_upload_buffer(materials, scene->materials);
 
         if(status != error_t::success)
         {
@@ -404,100 +819,115 @@ namespace bpmap
         memcpy(mapped_settings, &scene->settings, sizeof(scene->settings));
         scene_settings.unmap();
 
-        return error_t::success;
+        // The render work submitted afterwards needs all the copies.
+        return upload_ring.finish();
     }
 
-    template<typename T>
-    error_t renderer_t::create_and_upload_buffer(
-                                                  vk::buffer_t& buffer,
-                                                  const T& data,
-                                                  vk::buffer_t& staging_buffer
-                                                 )
+    error_t renderer_t::create_render_buffers()
     {
-        vk::buffer_desc_t desc =
-        {
-            .size = data.size() * sizeof(typename T::value_type),
-            .usage = vk::buffer_usage_transfer_dst | vk::buffer_usage_storage_buffer,
-            .on_gpu = true
-        };
+        auto pixels_count = size_t(scene->settings.resolution_x) * scene->settings.resolution_y;
+        auto status = create_device_buffer(pixel_estimates, pixels_count * sizeof(pixel_estimate_t));
 
-        if(buffer.create(*vulkan, desc) != error_t::success)
+        if(status != error_t::success)
         {
-            return error_t::buffer_creation_fail;
+            return status;
         }
 
-        void* mapped;
-        auto status = staging_buffer.map(&mapped);
+        status = create_reservoirs();
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        memcpy(mapped, data.data(), desc.size);
-
-        staging_buffer.unmap();
-
-        VkCommandBuffer tmp_cmd_buffer;
-
-        VkCommandBufferAllocateInfo cbai = {};
-        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        cbai.pNext = nullptr;
-        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        cbai.commandPool = command_pool.pool;
-        cbai.commandBufferCount = 1;
-
-        status = vulkan->create_command_buffers(&tmp_cmd_buffer, cbai);
+        auto tiles_count = pixels_count / (8 * 8);
+        status = create_device_buffer(tile_states, tiles_count * sizeof(uint32_t));
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        VkCommandBufferBeginInfo cbbi = {};
-        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        cbbi.pNext = nullptr;
-        cbbi.pInheritanceInfo = nullptr;
-        cbbi.flags = 0;
+        vk::buffer_desc_t render_state_desc =
+        {
+            .size = sizeof(render_state_t),
+            .usage = vk::buffer_usage_storage_buffer,
+            .on_gpu = false,
+            .persistently_mapped = true
+        };
 
-        if(vkBeginCommandBuffer(tmp_cmd_buffer, &cbbi) != VK_SUCCESS)
+        if(render_state.create(*vulkan, render_state_desc) != error_t::success)
         {
             return error_t::buffer_creation_fail;
         }
 
-        VkBufferCopy regions;
-        regions.srcOffset = 0;
-        regions.dstOffset = 0;
-        regions.size = desc.size;
+        return error_t::success;
+    }
+
+    error_t renderer_t::create_reservoirs()
+    {
+        // The candidates of the pixels, then the reservoirs kept after the
+        // reuse.
+        auto pixels_count = size_t(scene->settings.resolution_x) * scene->settings.resolution_y;
+        auto is_kept = scene->settings.light_resampling == light_resampling_t::spatiotemporal;
+        auto size = is_kept ? 2 * pixels_count * sizeof(reservoir_t) : 0;
+
+        if(reservoirs.get_size() == std::max<size_t>(size, sizeof(uint32_t)))
+        {
+            return error_t::success;
+        }
 
-        vkCmdCopyBuffer(tmp_cmd_buffer, staging_buffer.get_handle(), buffer.get_handle(), 1, &regions);
+        return create_device_buffer(reservoirs, size);
+    }
 
-        vkEndCommandBuffer(tmp_cmd_buffer);
+    error_t renderer_t::create_device_buffer(vk::buffer_t& buffer, size_t size)
+    {
+        buffer.destroy();
 
-        VkSubmitInfo submit_info;
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.pNext = nullptr;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &tmp_cmd_buffer;
-        submit_info.signalSemaphoreCount = 0;
-        submit_info.waitSemaphoreCount = 0;
+        // Vulkan has no empty buffers. A word is shorter than any element, so
+        // the shaders still see no elements.
+        vk::buffer_desc_t desc =
+        {
+            .size = std::max<size_t>(size, sizeof(uint32_t)),
+            .usage = vk::buffer_usage_transfer_dst | vk::buffer_usage_storage_buffer,
+            .on_gpu = true
+        };
+
+        if(buffer.create(*vulkan, desc) != error_t::success)
+        {
+            return error_t::buffer_creation_fail;
+        }
+
+        return error_t::success;
+    }
 
-        vk::fence_t fence;
+    template<typename T>
+    error_t renderer_t::create_and_upload_buffer(vk::buffer_t& buffer, const T& data)
+    {
+        auto size = data.size() * sizeof(typename T::value_type);
 
-        status = fence.create(*vulkan);
+        auto status = create_device_buffer(buffer, size);
 
         if(status != error_t::success)
         {
             return status;
         }
 
-        auto timeout = std::numeric_limits<uint64_t>::max();
+        return upload_ring.upload(buffer, 0, data.data(), size);
+    }
 
-        vulkan->submit_work(submit_info, &fence);
 
-        fence.wait(timeout);
+    template<typename T>
+    error_t renderer_t::update_buffer(vk::buffer_t& buffer, const T& data)
+    {
+        auto size = data.size() * sizeof(typename T::value_type);
 
-        return error_t::success;
+        if(size != buffer.get_size())
+        {
+            return create_and_upload_buffer(buffer, data);
+        }
+
+        return upload_ring.upload(buffer, 0, data.data(), size);
     }
 
 
@@ -506,15 +936,14 @@ namespace bpmap
         compute_pipeline_layouts.resize(pipeline_count);
     
         auto push_range = vulkan->get_push_range();
-        auto layout = vulkan->get_bindless_layout();
         VkPipelineLayoutCreateInfo plci = {};
         plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         plci.pNext = nullptr;
         plci.flags = 0;
         plci.pushConstantRangeCount = 1;
         plci.pPushConstantRanges = &push_range;
-        plci.setLayoutCount = 1;
-        plci.pSetLayouts = &layout;
+        plci.setLayoutCount = vulkan->get_bindless_sets_count();
+        plci.pSetLayouts = vulkan->get_bindless_layouts();
 
         return vulkan->create_pipeline_layout(compute_pipeline_layouts[raytrace_pipeline], plci);
     }
@@ -23,6 +23,8 @@ namespace bpmap
         vk::fence_t tmp_fence;
 
         bool_t busy = false;
+        bool_t streamed = false;
+        uint64_t recorded_generation = 0;
 
         static constexpr uint32_t pipeline_count = 1;
         static constexpr uint32_t raytrace_pipeline = 0;
@@ -34,6 +36,8 @@ namespace bpmap
         VkCommandBuffer command_buffer;
         vk::command_pool_t command_pool;
 
+        vk::upload_ring_t upload_ring;
+
 
         vk::buffer_t triangles;
 
@@ -44,12 +48,68 @@ namespace bpmap
         vk::buffer_t materials;
 
         vk::buffer_t lights;
+        vk::buffer_t light_aliases;
+        vk::buffer_t light_bvh;
+        vk::buffer_t light_trails;
+        vk::buffer_t environment;
+        vk::buffer_t environment_aliases;
 
         vk::buffer_t scene_settings;
 
+        // Matches pixel_estimate_t in geometry.glslh.
+        struct pixel_estimate_t
+        {
+            color3df_t mean;
+            float_t m2;
+            uint32_t samples_count;
+        };
+
+        // Matches render_state_t in geometry.glslh.
+        struct render_state_t
+        {
+            uint32_t batch;
+            uint32_t active_tiles;
+        };
+
+        // Matches reservoir_t in geometry.glslh.
+        struct reservoir_t
+        {
+            point3d_t light_point;
+            uint32_t light;
+            point3d_t surface_point;
+            uint32_t material_id;
+            direction3d_t surface_normal;
+            float_t weight;
+            direction3d_t out_dir;
+            float_t confidence;
+        };
+
+        // Matches RAYTRACE_PASS_* in raytrace.comp.
+        enum class raytrace_pass_t : uint32_t
+        {
+            samples,
+            candidates,
+            shading
+        };
+
+        // Renders go in batches until no tile is active.
+        vk::buffer_t pixel_estimates;
+        vk::buffer_t tile_states;
+        vk::buffer_t render_state;
+        // Light samples spatiotemporal resampling keeps from one sample of
+        // the pixels for the next, empty with the other modes.
+        vk::buffer_t reservoirs;
+        uint32_t batch = 0;
+        bool_t converged = false;
+
         error_t create_shaders();
 
+        error_t create_upload_ring();
         error_t create_buffers();
+        error_t create_device_buffer(vk::buffer_t& buffer, size_t size);
+        error_t create_render_buffers();
+        error_t create_reservoirs();
+        error_t submit_batch();
         error_t create_compute_pipeline_layouts();
         error_t create_compute_pipelines();
         error_t create_command_pool();
@@ -58,12 +118,24 @@ namespace bpmap
         error_t create_image();
 
         template <typename T>
-        error_t create_and_upload_buffer(vk::buffer_t& buffer, const T& data, vk::buffer_t& staging_buffer);
+        error_t create_and_upload_buffer(vk::buffer_t& buffer, const T& data);
+
+        // Uploads in place when the size didn't change.
+        template <typename T>
+        error_t update_buffer(vk::buffer_t& buffer, const T& data);
+
+        // Writes the geometry into the device buffers, reserving creates
+        // them again.
+        geometry_stream_t get_geometry_stream();
 
 
     public:
         static constexpr const char* raytrace_cs_name = "raytrace.comp.spv";
 
+        // Bindless resources the renderer binds for a scene.
+        static constexpr uint32_t bindless_buffers_count = 16;
+        static constexpr uint32_t bindless_images_count = 1;
+
         renderer_t(
                     const vk::device_t& vulkan,
                     const scene_t& scene,
@@ -71,13 +143,37 @@ namespace bpmap
                     vk::sampler_registry_t& sr
                   );
 
+        // Loads the scene into scene and streams its geometry into the device
+        // buffers while it is parsed, instead of uploading it from scene in
+        // init. Has to be called before init.
+        error_t stream_scene(const string_t& path, scene_t& scene);
+
         error_t init();
 
-        bool_t is_not_busy();
+        // Reads the scene at path again after the files in changed_files
+        // changed and updates only what differs. Waits for the render work,
+        // then starts rendering again if anything changed.
+        error_t reload_scene(
+                              const string_t& path,
+                              const hash_set_t<string_t>& changed_files,
+                              scene_t& scene
+                            );
+
+        // Waits up to timeout nanoseconds for the submitted work to finish.
+        bool_t is_not_busy(uint64_t timeout = 0);
+        bool_t is_busy() const { return busy; }
 
         error_t build_command_buffers();
+
+        // Starts the render over with the first batch, without the history
+        // of the light resampling.
         error_t submit_command_buffers();
 
+        // Submits the next batch once the last one is done, until the tiles
+        // converged or took all their samples.
+        error_t submit_next_batch();
+        bool_t is_converged() const { return converged; }
+
         ~renderer_t();
 
         const vk::image_t& get_output() const { return render_output; }
@@ -84,6 +84,7 @@ namespace bpmap::vk
     {
         if (dev)
         {
+            dev->unbind(this);
             vkDestroySampler(dev->get_device(), sampler, nullptr);
         }
     }
@@ -54,16 +54,15 @@ namespace bpmap::vk
 
     error_t shader_registry_t::add_from_file(const string_t& name, shader_stage_t type)
     {
-        darray_t<uint8_t> shader_data;
+        mapped_file_t shader_data;
 
-        if (!read_whole_file(name, shader_data))
+        if (!shader_data.open(name))
         {
             return error_t::shader_read_fail;
         }
 
-        add(name, (uint32_t*)shader_data.data(), shader_data.size(), type);
-
-        return error_t::success;
+        // The module keeps its own copy of the code.
+        return add(name, (const uint32_t*)shader_data.get_data(), shader_data.get_size(), type);
     }
 
 
@@ -0,0 +1,301 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <limits>
+
+#include "vulkan.hpp"
+#include "upload_ring.hpp"
+
+
+namespace bpmap::vk
+{
+    upload_ring_t::upload_ring_t()
+    {
+        dev = nullptr;
+        slot_size = 0;
+        current = 0;
+    }
+
+
+    upload_ring_t::~upload_ring_t()
+    {
+        // The staging buffer has to outlive the copies.
+        for(auto& slot : slots)
+        {
+            if(slot.in_flight)
+            {
+                slot.fence.wait(std::numeric_limits<uint64_t>::max());
+            }
+        }
+    }
+
+
+    error_t upload_ring_t::init(const device_t& device, const upload_ring_desc_t& desc)
+    {
+        dev = &device;
+        slot_size = desc.slot_size;
+        current = 0;
+
+        buffer_desc_t staging_desc =
+        {
+            .size = slot_size * desc.slots_count,
+            .usage = buffer_usage_transfer_src,
+            .on_gpu = false,
+            .dont_bind = true,
+            .persistently_mapped = true
+        };
+
+        if(staging.create(device, staging_desc) != error_t::success)
+        {
+            return error_t::buffer_creation_fail;
+        }
+
+        auto status = device.create_command_pool(command_pool);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        for(auto i = 0u; i < desc.slots_count; ++i)
+        {
+            auto& slot = slots.emplace_back();
+
+            VkCommandBufferAllocateInfo cbai = {};
+            cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cbai.pNext = nullptr;
+            cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cbai.commandPool = command_pool.pool;
+            cbai.commandBufferCount = 1;
+
+            status = device.create_command_buffers(&slot.command_buffer, cbai);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+
+            status = slot.fence.create(device);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        return error_t::success;
+    }
+
+
+    error_t upload_ring_t::wait(slot_t& slot)
+    {
+        if(!slot.in_flight)
+        {
+            return error_t::success;
+        }
+
+        auto status = slot.fence.wait(std::numeric_limits<uint64_t>::max());
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        slot.in_flight = false;
+
+        return slot.fence.reset();
+    }
+
+
+    error_t upload_ring_t::begin(slot_t& slot)
+    {
+        auto status = wait(slot);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        VkCommandBufferBeginInfo cbbi = {};
+        cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cbbi.pNext = nullptr;
+        cbbi.pInheritanceInfo = nullptr;
+        cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkResetCommandBuffer(slot.command_buffer, 0);
+
+        if(vkBeginCommandBuffer(slot.command_buffer, &cbbi) != VK_SUCCESS)
+        {
+            return error_t::command_buffer_begin_fail;
+        }
+
+        slot.used = 0;
+        slot.recording = true;
+
+        return error_t::success;
+    }
+
+
+    error_t upload_ring_t::submit(slot_t& slot)
+    {
+        auto status = staging.flush(current * slot_size, slot.used);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        // Makes the copies visible to the compute work submitted later.
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(
+                              slot.command_buffer,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              0,
+                              1,
+                              &barrier,
+                              0,
+                              nullptr,
+                              0,
+                              nullptr
+                            );
+
+        vkEndCommandBuffer(slot.command_buffer);
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = nullptr;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &slot.command_buffer;
+        submit_info.signalSemaphoreCount = 0;
+        submit_info.waitSemaphoreCount = 0;
+
+        slot.recording = false;
+
+        status = dev->submit_work(submit_info, &slot.fence);
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        slot.in_flight = true;
+        current = (current + 1) % slots.size();
+
+        return error_t::success;
+    }
+
+
+    error_t upload_ring_t::upload(
+                                   const buffer_t& destination,
+                                   size_t offset,
+                                   const void* data,
+                                   size_t size
+                                 )
+    {
+        std::lock_guard lock(mutex);
+
+        auto bytes = (const uint8_t*) data;
+
+        // Larger uploads are split over several slots.
+        while(size > 0)
+        {
+            auto& slot = slots[current];
+
+            if(!slot.recording)
+            {
+                auto status = begin(slot);
+
+                if(status != error_t::success)
+                {
+                    return status;
+                }
+            }
+
+            auto count = std::min(size, slot_size - slot.used);
+            auto staging_offset = current * slot_size + slot.used;
+
+            memcpy((uint8_t*) staging.get_mapped() + staging_offset, bytes, count);
+
+            VkBufferCopy region;
+            region.srcOffset = staging_offset;
+            region.dstOffset = offset;
+            region.size = count;
+
+            vkCmdCopyBuffer(slot.command_buffer, staging.get_handle(), destination.get_handle(), 1, &region);
+
+            slot.used += count;
+            bytes += count;
+            offset += count;
+            size -= count;
+
+            if(slot.used == slot_size)
+            {
+                auto status = submit(slot);
+
+                if(status != error_t::success)
+                {
+                    return status;
+                }
+            }
+        }
+
+        return error_t::success;
+    }
+
+
+    error_t upload_ring_t::flush()
+    {
+        std::lock_guard lock(mutex);
+
+        auto& slot = slots[current];
+
+        return slot.recording ? submit(slot) : error_t::success;
+    }
+
+
+    error_t upload_ring_t::finish()
+    {
+        auto status = flush();
+
+        if(status != error_t::success)
+        {
+            return status;
+        }
+
+        std::lock_guard lock(mutex);
+
+        for(auto& slot : slots)
+        {
+            status = wait(slot);
+
+            if(status != error_t::success)
+            {
+                return status;
+            }
+        }
+
+        return error_t::success;
+    }
+}
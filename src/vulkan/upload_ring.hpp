@@ -0,0 +1,78 @@
+// Copyright 2023 Mihail Mladenov
+//
+// This file is part of bpmap.
+//
+// bpmap is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// bpmap is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with bpmap.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef VULKAN_UPLOAD_RING_HPP
+#define VULKAN_UPLOAD_RING_HPP
+
+
+namespace bpmap::vk
+{
+    struct upload_ring_desc_t
+    {
+        size_t slot_size = 16 * 1024 * 1024;
+        uint32_t slots_count = 4;
+    };
+
+    // Copies host data into device buffers through a ring of staging slots.
+    // A slot is submitted once it is full and reused after its fence
+    // signals, so the caller only blocks when all slots are in flight.
+    class upload_ring_t
+    {
+        struct slot_t
+        {
+            VkCommandBuffer command_buffer;
+            fence_t fence;
+            size_t used = 0;
+            bool_t recording = false;
+            bool_t in_flight = false;
+        };
+
+        const device_t* dev;
+        buffer_t staging;
+        command_pool_t command_pool;
+        deque_t<slot_t> slots;
+        size_t slot_size;
+        uint32_t current;
+        std::mutex mutex;
+
+        upload_ring_t(const upload_ring_t&) = delete;
+        upload_ring_t& operator=(const upload_ring_t&) = delete;
+
+        error_t begin(slot_t& slot);
+        error_t submit(slot_t& slot);
+        error_t wait(slot_t& slot);
+
+    public:
+        error_t init(const device_t& device, const upload_ring_desc_t& desc = upload_ring_desc_t());
+
+        // Can be called from any thread. The copy is visible to the work
+        // submitted after the next flush.
+        error_t upload(const buffer_t& destination, size_t offset, const void* data, size_t size);
+
+        // Submits the copies recorded so far.
+        error_t flush();
+
+        // Submits the recorded copies and waits for all of them.
+        error_t finish();
+
+        upload_ring_t();
+        ~upload_ring_t();
+    };
+}
+
+#endif
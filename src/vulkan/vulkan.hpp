@@ -30,6 +30,7 @@
 #include "shader.hpp"
 #include "semaphore.hpp"
 #include "fence.hpp"
+#include "upload_ring.hpp"
 
 
 #include "sampler_registry.hpp"
@@ -42,9 +42,58 @@ namespace bpmap
                                    nullptr
                                   );
 
+        if(window == nullptr)
+        {
+            return error_t::window_creation_fail;
+        }
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetCursorPosCallback(window, on_cursor_pos);
+        glfwSetMouseButtonCallback(window, on_mouse_button);
+        glfwSetScrollCallback(window, on_scroll);
+        glfwSetKeyCallback(window, on_key);
+        glfwSetWindowRefreshCallback(window, on_refresh);
+        glfwSetWindowFocusCallback(window, on_focus);
+
         return error_t::success;
     }
 
+    void window_t::on_input(GLFWwindow* window)
+    {
+        auto self = (window_t*) glfwGetWindowUserPointer(window);
+        self->input_pending = true;
+    }
+
+    void window_t::on_cursor_pos(GLFWwindow* window, double_t, double_t)
+    {
+        on_input(window);
+    }
+
+    void window_t::on_mouse_button(GLFWwindow* window, int_t, int_t, int_t)
+    {
+        on_input(window);
+    }
+
+    void window_t::on_scroll(GLFWwindow* window, double_t, double_t)
+    {
+        on_input(window);
+    }
+
+    void window_t::on_key(GLFWwindow* window, int_t, int_t, int_t, int_t)
+    {
+        on_input(window);
+    }
+
+    void window_t::on_refresh(GLFWwindow* window)
+    {
+        on_input(window);
+    }
+
+    void window_t::on_focus(GLFWwindow* window, int_t)
+    {
+        on_input(window);
+    }
+
     bool window_t::closed()
     {
         return glfwWindowShouldClose(window);
@@ -55,6 +104,35 @@ namespace bpmap
         glfwPollEvents();
     }
 
+    void window_t::wait_events(double_t timeout)
+    {
+        if(timeout < 0.0)
+        {
+            glfwWaitEvents();
+        }
+        else if(timeout == 0.0)
+        {
+            glfwPollEvents();
+        }
+        else
+        {
+            glfwWaitEventsTimeout(timeout);
+        }
+    }
+
+    void window_t::wake() const
+    {
+        glfwPostEmptyEvent();
+    }
+
+    bool_t window_t::consume_input()
+    {
+        auto pending = input_pending;
+        input_pending = false;
+
+        return pending;
+    }
+
     darray_t<const char_t*> window_t::get_required_extensions() const
     {
         uint32_t count;
@@ -48,6 +48,18 @@ namespace bpmap
         window_init_params_t parameters;
         error_t error;
 
+        // Set from the GLFW callbacks whenever something that can change what
+        // the GUI shows has arrived since the last consume_input().
+        bool_t input_pending = true;
+
+        static void on_input(GLFWwindow* window);
+        static void on_cursor_pos(GLFWwindow* window, double_t x, double_t y);
+        static void on_mouse_button(GLFWwindow* window, int_t button, int_t action, int_t mods);
+        static void on_scroll(GLFWwindow* window, double_t x, double_t y);
+        static void on_key(GLFWwindow* window, int_t key, int_t scancode, int_t action, int_t mods);
+        static void on_refresh(GLFWwindow* window);
+        static void on_focus(GLFWwindow* window, int_t focused);
+
     public:
 
         error_t init(window_init_params_t wip);
@@ -55,6 +67,14 @@ namespace bpmap
         error_t get_status() const { return error; }
         void poll_events();
 
+        // Blocks until at least one event arrives or the timeout (in seconds)
+        // expires. A negative timeout waits indefinitely.
+        void wait_events(double_t timeout);
+        // Wakes up a thread blocked in wait_events.
+        void wake() const;
+
+        bool_t consume_input();
+
         darray_t<const char_t*> get_required_extensions() const;
         bool queue_supports_presentation(VkInstance, VkPhysicalDevice, uint32_t) const;
 